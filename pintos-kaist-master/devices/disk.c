@@ -84,7 +84,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct disk *);
 static void identify_ata_device (struct disk *);
 
-static void select_sector (struct disk *, disk_sector_t);
+static void select_sector (struct disk *, disk_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -209,47 +209,81 @@ disk_size (struct disk *d) {
    per-disk locking is unneeded. */
 void
 disk_read (struct disk *d, disk_sector_t sec_no, void *buffer) {
+	disk_read_sectors (d, sec_no, 1, buffer);
+}
+
+/* Write sector SEC_NO to disk D from BUFFER, which must contain
+   DISK_SECTOR_SIZE bytes.  Returns after the disk has
+   acknowledged receiving the data.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+void
+disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+	disk_write_sectors (d, sec_no, 1, buffer);
+}
+
+/* Reads the CNT consecutive sectors starting at SEC_NO from disk
+   D into BUFFER, which must have room for CNT * DISK_SECTOR_SIZE
+   bytes, with a single command.  CNT must be between 1 and
+   DISK_MAX_SECTORS.  The drive interrupts once per sector, but
+   only has to seek once. */
+void
+disk_read_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		void *buffer) {
 	struct channel *c;
+	uint8_t *p = buffer;
+	size_t i;
 
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
+	ASSERT (cnt > 0 && cnt <= DISK_MAX_SECTORS);
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	select_sector (d, sec_no, cnt);
 	issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-	sema_down (&c->completion_wait);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-	input_sector (c, buffer);
-	d->read_cnt++;
+	for (i = 0; i < cnt; i++, p += DISK_SECTOR_SIZE) {
+		sema_down (&c->completion_wait);
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name,
+					sec_no + (disk_sector_t) i);
+		input_sector (c, p);
+	}
+	d->read_cnt += cnt;
 	lock_release (&c->lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   DISK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Writes the CNT consecutive sectors starting at SEC_NO on disk
+   D from BUFFER, which must contain CNT * DISK_SECTOR_SIZE
+   bytes, with a single command, and returns after the disk has
+   acknowledged receiving all of them.  CNT must be between 1 and
+   DISK_MAX_SECTORS. */
 void
-disk_write (struct disk *d, disk_sector_t sec_no, const void *buffer) {
+disk_write_sectors (struct disk *d, disk_sector_t sec_no, size_t cnt,
+		const void *buffer) {
 	struct channel *c;
+	const uint8_t *p = buffer;
+	size_t i;
 
 	ASSERT (d != NULL);
 	ASSERT (buffer != NULL);
+	ASSERT (cnt > 0 && cnt <= DISK_MAX_SECTORS);
 
 	c = d->channel;
 	lock_acquire (&c->lock);
-	select_sector (d, sec_no);
+	select_sector (d, sec_no, cnt);
 	issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-	if (!wait_while_busy (d))
-		PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-	output_sector (c, buffer);
-	sema_down (&c->completion_wait);
-	d->write_cnt++;
+	for (i = 0; i < cnt; i++, p += DISK_SECTOR_SIZE) {
+		if (!wait_while_busy (d))
+			PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name,
+					sec_no + (disk_sector_t) i);
+		output_sector (c, p);
+		sema_down (&c->completion_wait);
+	}
+	d->write_cnt += cnt;
 	lock_release (&c->lock);
 }
-
+
 /* Disk detection and identification. */
 
 static void print_ata_string (char *string, size_t size);
@@ -402,17 +436,19 @@ print_ata_string (char *string, size_t size) {
 }
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number of sectors CNT to the disk's
+   sector selection registers.  (We use LBA mode.)  A count of 0
+   in the register means 256. */
 static void
-select_sector (struct disk *d, disk_sector_t sec_no) {
+select_sector (struct disk *d, disk_sector_t sec_no, size_t cnt) {
 	struct channel *c = d->channel;
 
 	ASSERT (sec_no < d->capacity);
+	ASSERT (cnt <= d->capacity - sec_no);
 	ASSERT (sec_no < (1UL << 28));
 
 	select_device_wait (d);
-	outb (reg_nsect (c), 1);
+	outb (reg_nsect (c), cnt == DISK_MAX_SECTORS ? 0 : cnt);
 	outb (reg_lbal (c), sec_no);
 	outb (reg_lbam (c), sec_no >> 8);
 	outb (reg_lbah (c), (sec_no >> 16));
@@ -0,0 +1,218 @@
+#include "devices/ktimer.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+
+/* Hierarchical timing wheel.  See [Varghese] for the design.
+
+   The wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots each.
+   Level 0 has one slot per tick, level 1 one slot per
+   WHEEL_SLOTS ticks, and so on.  A timer is filed in the
+   finest level whose span covers its distance from `clk', the
+   next tick the wheel will process.  Each tick processes one
+   level-0 slot; whenever the level-0 index wraps around, the
+   next slot of level 1 is "cascaded", that is, its timers are
+   re-filed into level 0 now that they are close enough, and so
+   on up the levels.
+
+   Four levels of 64 slots cover 2**24 ticks, about 46 hours at
+   100 Hz.  Timers further out than that are parked in the last
+   slot of the top level and re-filed when it cascades. */
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+
+/* Largest distance from `clk' that the wheel can represent. */
+#define WHEEL_MAX_DELTA ((1LL << (WHEEL_LEVELS * WHEEL_BITS)) - 1)
+
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/* Next tick to be processed by ktimer_run(). */
+static int64_t clk;
+
+static void file_timer (struct ktimer *);
+static void cascade (int level);
+
+/* Returns the index of the slot in LEVEL for tick EXPIRES. */
+static inline int
+slot_index (int64_t expires, int level) {
+	return (expires >> (level * WHEEL_BITS)) & WHEEL_MASK;
+}
+
+/* Initializes the timing wheel.  Must be called before any
+   timer is armed. */
+void
+ktimer_subsystem_init (void) {
+	int level, slot;
+
+	for (level = 0; level < WHEEL_LEVELS; level++)
+		for (slot = 0; slot < WHEEL_SLOTS; slot++)
+			list_init (&wheel[level][slot]);
+	clk = 0;
+}
+
+/* Initializes T as a disarmed timer that calls FUNC with AUX
+   when it fires. */
+void
+ktimer_init (struct ktimer *t, ktimer_func *func, void *aux) {
+	ASSERT (t != NULL);
+	ASSERT (func != NULL);
+
+	t->expires = 0;
+	t->period = 0;
+	t->func = func;
+	t->aux = aux;
+	t->pending = false;
+}
+
+/* Arms T to fire at timer tick EXPIRES, or on the next tick if
+   EXPIRES is already in the past.  If PERIOD is positive, T is
+   re-armed to fire every PERIOD ticks after that until it is
+   cancelled.  If T is already pending, it is re-armed.
+
+   May be called from an interrupt handler, including from a
+   timer's own callback. */
+void
+ktimer_arm (struct ktimer *t, int64_t expires, int64_t period) {
+	enum intr_level old_level;
+
+	ASSERT (t != NULL);
+	ASSERT (period >= 0);
+
+	old_level = intr_disable ();
+	if (t->pending)
+		list_remove (&t->elem);
+	t->expires = expires;
+	t->period = period;
+	t->pending = true;
+	file_timer (t);
+	intr_set_level (old_level);
+}
+
+/* Disarms T.  Returns true if T was pending, false if it had
+   already fired (or was never armed). */
+bool
+ktimer_cancel (struct ktimer *t) {
+	enum intr_level old_level;
+	bool was_pending;
+
+	ASSERT (t != NULL);
+
+	old_level = intr_disable ();
+	was_pending = t->pending;
+	if (was_pending) {
+		list_remove (&t->elem);
+		t->pending = false;
+	}
+	intr_set_level (old_level);
+
+	return was_pending;
+}
+
+/* Returns true if T is armed and has not fired yet. */
+bool
+ktimer_pending (const struct ktimer *t) {
+	return t->pending;
+}
+
+/* Fires every timer that is due at or before tick NOW.
+   Called from the timer interrupt handler. */
+void
+ktimer_run (int64_t now) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	while (clk <= now) {
+		int index = slot_index (clk, 0);
+		struct list *slot = &wheel[0][index];
+
+		/* Level 0 wrapped: pull the next slot of each coarser
+		   level that has come due down into the finer ones. */
+		if (index == 0) {
+			int level;
+			for (level = 1; level < WHEEL_LEVELS; level++) {
+				cascade (level);
+				if (slot_index (clk, level) != 0)
+					break;
+			}
+		}
+
+		/* Advance first, so that a periodic timer re-armed by
+		   the loop below lands in a future slot. */
+		clk++;
+		while (!list_empty (slot)) {
+			struct ktimer *t = list_entry (list_pop_front (slot),
+					struct ktimer, elem);
+
+			t->pending = false;
+			if (t->period > 0) {
+				t->expires += t->period;
+				t->pending = true;
+				file_timer (t);
+			}
+			t->func (t, t->aux);
+		}
+	}
+}
+
+/* Returns the first tick, no later than LIMIT, at which
+   ktimer_run() has work to do: a non-empty level-0 slot, or a
+   cascade that might bring timers down into level 0.  Returns
+   LIMIT if there is nothing to do before then.  Used to decide
+   how long the periodic tick can be stopped while idle.
+
+   Looks at no more than one level-0 slot per tick up to LIMIT,
+   so callers should keep LIMIT close. */
+int64_t
+ktimer_next_event (int64_t limit) {
+	int64_t tick;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (tick = clk; tick < limit; tick++) {
+		int index = slot_index (tick, 0);
+		if (index == 0 || !list_empty (&wheel[0][index]))
+			return tick;
+	}
+	return limit;
+}
+
+/* Puts T into the wheel slot matching its expiry time. */
+static void
+file_timer (struct ktimer *t) {
+	int64_t delta = t->expires - clk;
+	int64_t expires = t->expires;
+	int level;
+
+	if (delta < 0) {
+		/* Already due: fire on the very next tick processed. */
+		expires = clk;
+		delta = 0;
+	} else if (delta > WHEEL_MAX_DELTA) {
+		/* Beyond the wheel's reach: park it as far out as we
+		   can; it will be re-filed when that slot cascades. */
+		expires = clk + WHEEL_MAX_DELTA;
+		delta = WHEEL_MAX_DELTA;
+	}
+
+	for (level = 0; level < WHEEL_LEVELS - 1; level++)
+		if (delta < 1LL << ((level + 1) * WHEEL_BITS))
+			break;
+	list_push_back (&wheel[level][slot_index (expires, level)], &t->elem);
+}
+
+/* Re-files every timer in the slot of LEVEL that `clk' has just
+   reached into finer levels. */
+static void
+cascade (int level) {
+	struct list *slot = &wheel[level][slot_index (clk, level)];
+	struct list due;
+
+	/* Detach the whole slot first: re-filing a timer may put it
+	   back into this very list if it is still far away. */
+	list_init (&due);
+	while (!list_empty (slot))
+		list_push_back (&due, list_pop_front (slot));
+	while (!list_empty (&due))
+		file_timer (list_entry (list_pop_front (&due), struct ktimer, elem));
+}
@@ -0,0 +1,206 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/mmu.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Local APIC.
+
+   Each CPU has a local APIC, which receives interrupts for that
+   CPU and lets it send inter-processor interrupts (IPIs) to the
+   others.  Its registers are memory-mapped, at the same physical
+   address on every CPU; each CPU sees its own.  See [IA32-v3a]
+   chapter 10 "Advanced Programmable Interrupt Controller".
+
+   We keep device interrupts on the 8259A PICs, which are wired
+   to the BSP's LINT0 pin in "virtual wire" mode, so the local
+   APICs are only used for IPIs and to start the APs. */
+
+/* Register offsets, in bytes.  See [IA32-v3a] table 10-1. */
+#define LAPIC_ID      0x020     /* ID. */
+#define LAPIC_TPR     0x080     /* Task priority. */
+#define LAPIC_EOI     0x0b0     /* End of interrupt. */
+#define LAPIC_SVR     0x0f0     /* Spurious interrupt vector. */
+#define LAPIC_ESR     0x280     /* Error status. */
+#define LAPIC_ICR_LO  0x300     /* Interrupt command, bits 0...31. */
+#define LAPIC_ICR_HI  0x310     /* Interrupt command, bits 32...63. */
+#define LAPIC_TIMER   0x320     /* Local vector table: timer. */
+#define LAPIC_LINT0   0x350     /* Local vector table: LINT0 pin. */
+#define LAPIC_LINT1   0x360     /* Local vector table: LINT1 pin. */
+#define LAPIC_ERROR   0x370     /* Local vector table: error. */
+
+/* Register bits. */
+#define SVR_ENABLE    0x00000100        /* APIC software enable. */
+#define LVT_MASKED    0x00010000        /* Interrupt masked. */
+#define LVT_NMI       0x00000400        /* Deliver as NMI. */
+#define LVT_EXTINT    0x00000700        /* Deliver as from 8259A. */
+#define ICR_FIXED     0x00000000        /* Fixed delivery. */
+#define ICR_INIT      0x00000500        /* INIT. */
+#define ICR_STARTUP   0x00000600        /* Start-up (SIPI). */
+#define ICR_PENDING   0x00001000        /* Delivery status: send pending. */
+#define ICR_ASSERT    0x00004000        /* Level assert. */
+#define ICR_LEVEL     0x00008000        /* Level triggered. */
+#define ICR_OTHERS    0x000c0000        /* Shorthand: all excluding self. */
+
+/* Registers, or a null pointer if there is no local APIC. */
+static volatile uint32_t *lapic;
+
+static uint32_t lapic_read (int reg);
+static void lapic_write (int reg, uint32_t value);
+static void send_icr (uint8_t apic_id, uint32_t command);
+
+/* Maps the local APIC's registers, at physical address PADDR,
+   into the kernel's address space, uncached.  Must be called
+   before any other function in this file, and before any page
+   table other than base_pml4 exists, since those share its
+   kernel mappings only at the top level. */
+void
+lapic_map (uint64_t paddr) {
+	uint64_t va = (uint64_t) ptov (paddr);
+	uint64_t *pte;
+
+	ASSERT (pg_ofs (paddr) == 0);
+
+	pte = pml4e_walk (base_pml4, va, 1);
+	if (pte == NULL)
+		PANIC ("cannot map local APIC");
+	*pte = paddr | PTE_P | PTE_W | PTE_PWT | PTE_PCD;
+	invlpg (va);
+
+	lapic = (volatile uint32_t *) va;
+}
+
+/* Returns true if lapic_map() has been called. */
+bool
+lapic_present (void) {
+	return lapic != NULL;
+}
+
+/* Enables the running CPU's local APIC.  BSP says whether this
+   is the bootstrap processor, which keeps receiving the PICs'
+   interrupts through LINT0. */
+void
+lapic_init (bool bsp) {
+	ASSERT (lapic != NULL);
+
+	lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS);
+	lapic_write (LAPIC_TIMER, LVT_MASKED);
+	lapic_write (LAPIC_LINT0, bsp ? LVT_EXTINT : LVT_MASKED);
+	lapic_write (LAPIC_LINT1, LVT_NMI);
+	lapic_write (LAPIC_ERROR, LVT_MASKED);
+
+	/* Clear error status, which takes back-to-back writes, and
+	   acknowledge any outstanding interrupt. */
+	lapic_write (LAPIC_ESR, 0);
+	lapic_write (LAPIC_ESR, 0);
+	lapic_write (LAPIC_EOI, 0);
+
+	/* Accept interrupts of every priority. */
+	lapic_write (LAPIC_TPR, 0);
+}
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t
+lapic_id (void) {
+	return lapic != NULL ? lapic_read (LAPIC_ID) >> 24 : 0;
+}
+
+/* Acknowledges the interrupt being handled, which must have
+   come through the local APIC. */
+void
+lapic_eoi (void) {
+	ASSERT (lapic != NULL);
+	lapic_write (LAPIC_EOI, 0);
+}
+
+/* Sends interrupt VEC to the CPU whose local APIC ID is APIC_ID.
+   Must be called with interrupts off. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (vec >= LAPIC_IPI_FIRST && vec <= LAPIC_IPI_LAST);
+
+	send_icr (apic_id, ICR_FIXED | vec);
+}
+
+/* Sends interrupt VEC to every CPU but the running one.  APs
+   that have not been started ignore it.  Must be called with
+   interrupts off. */
+void
+lapic_broadcast_ipi (uint8_t vec) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (vec >= LAPIC_IPI_FIRST && vec <= LAPIC_IPI_LAST);
+
+	send_icr (0, ICR_OTHERS | ICR_FIXED | vec);
+}
+
+/* Starts the AP whose local APIC ID is APIC_ID executing real
+   mode code at physical address PADDR, which must be a page
+   boundary below 1 MB.  This is the "universal start-up
+   algorithm" of [MP] appendix B.4: INIT, then two start-up IPIs.
+   Must be called with interrupts on, since it sleeps. */
+void
+lapic_start_ap (uint8_t apic_id, uint64_t paddr) {
+	uint16_t *warm_reset_vector = ptov (0x467);
+	enum intr_level old_level;
+	int i;
+
+	ASSERT (pg_ofs (paddr) == 0 && paddr < 0x100000);
+
+	/* Older CPUs start at the BIOS warm reset vector after INIT,
+	   if the CMOS shutdown code says so.  See [MP] B.4. */
+	outb (0x70, 0x0f);
+	outb (0x71, 0x0a);
+	warm_reset_vector[0] = 0;
+	warm_reset_vector[1] = paddr >> 4;
+
+	old_level = intr_disable ();
+	send_icr (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+	intr_set_level (old_level);
+	timer_usleep (200);
+	old_level = intr_disable ();
+	send_icr (apic_id, ICR_INIT | ICR_LEVEL);
+	intr_set_level (old_level);
+	timer_msleep (10);
+
+	for (i = 0; i < 2; i++) {
+		old_level = intr_disable ();
+		send_icr (apic_id, ICR_STARTUP | (paddr >> 12));
+		intr_set_level (old_level);
+		timer_usleep (200);
+	}
+}
+
+/* Reads local APIC register REG. */
+static uint32_t
+lapic_read (int reg) {
+	return lapic[reg / sizeof *lapic];
+}
+
+/* Writes VALUE to local APIC register REG. */
+static void
+lapic_write (int reg, uint32_t value) {
+	lapic[reg / sizeof *lapic] = value;
+
+	/* Read back, to wait for the write to complete. */
+	lapic_read (LAPIC_ID);
+}
+
+/* Issues interrupt COMMAND to the local APIC with ID APIC_ID,
+   after waiting for any previous command to be sent. */
+static void
+send_icr (uint8_t apic_id, uint32_t command) {
+	ASSERT (lapic != NULL);
+
+	while (lapic_read (LAPIC_ICR_LO) & ICR_PENDING)
+		asm volatile ("pause");
+	lapic_write (LAPIC_ICR_HI, (uint32_t) apic_id << 24);
+	lapic_write (LAPIC_ICR_LO, command);
+	while (lapic_read (LAPIC_ICR_LO) & ICR_PENDING)
+		asm volatile ("pause");
+}
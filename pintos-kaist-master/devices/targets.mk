@@ -1,4 +1,6 @@
 devices_SRC  = devices/timer.c		# Timer device.
+devices_SRC += devices/ktimer.c		# Kernel timer wheel.
+devices_SRC += devices/lapic.c		# Local APIC.
 devices_SRC += devices/kbd.c		# Keyboard device.
 devices_SRC += devices/vga.c		# Video device.
 devices_SRC += devices/serial.c		# Serial port device.
@@ -3,6 +3,9 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/ktimer.h"
+#include "devices/lapic.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/synch.h"
@@ -17,14 +20,49 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
+/* 8254 input frequency divided by TIMER_FREQ, rounded to
+   nearest: the number of PIT counts in one timer tick. */
+#define PIT_TICK_COUNT ((1193180 + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Longest one-shot delay the 16-bit PIT counter can express,
+   in whole ticks. */
+#define PIT_MAX_TICKS (0xffff / PIT_TICK_COUNT)
+
 /* Number of timer ticks since OS booted. */
 static int64_t ticks;
 
+/* -tickless: Stop the periodic tick while idle? */
+bool timer_tickless;
+
+/* Tickless idle state.  While `idle_oneshot' is true, the PIT is
+   in one-shot mode, armed to interrupt after `idle_counts' PIT
+   counts, the first `idle_phase' of which complete the tick that
+   was in progress on entry.  That one-shot ends exactly on the
+   tick boundary `idle_ticks' ticks after entry.
+
+   `resync' is true while a one-shot is armed only to reach the
+   next tick boundary after an early wakeup, at which point
+   periodic mode resumes in phase. */
+static bool idle_oneshot;
+static unsigned idle_counts;
+static unsigned idle_phase;
+static int64_t idle_ticks;
+static bool resync;
+
+/* Number of ticks skipped while idle, for statistics. */
+static int64_t skipped_ticks;
+
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
 static intr_handler_func timer_interrupt;
+static intr_handler_func timer_ipi;
+static ktimer_func wake_sleeper;
+static void pit_periodic (void);
+static void pit_oneshot (unsigned counts);
+static unsigned pit_read_count (bool *out);
+static void fold_skipped_ticks (int64_t skipped);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -34,15 +72,11 @@ static void real_time_sleep (int64_t num, int32_t denom);
    corresponding interrupt. */
 void
 timer_init (void) {
-	/* 8254 input frequency divided by TIMER_FREQ, rounded to
-	   nearest. */
-	uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
-
-	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-	outb (0x40, count & 0xff);
-	outb (0x40, count >> 8);
+	pit_periodic ();
 
+	ktimer_subsystem_init ();
 	intr_register_ext (0x20, timer_interrupt, "8254 Timer");
+	intr_register_ipi (LAPIC_IPI_TICK, timer_ipi, "Timer tick IPI");
 }
 
 /* Calibrates loops_per_tick, used to implement brief delays. */
@@ -73,9 +107,9 @@ timer_calibrate (void) {
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) {
-	enum intr_level old_level = intr_disable ();
-	int64_t t = ticks;
-	intr_set_level (old_level);
+	/* An aligned 64-bit load is atomic, so there is no need to
+	   turn off interrupts to read `ticks' in one piece. */
+	int64_t t = *(volatile int64_t *) &ticks;
 	barrier ();
 	return t;
 }
@@ -87,14 +121,25 @@ timer_elapsed (int64_t then) {
 	return timer_ticks () - then;
 }
 
-/* Suspends execution for approximately TICKS timer ticks. */
+/* Suspends execution for approximately TICKS timer ticks.
+
+   The calling thread blocks on a one-shot kernel timer, so it
+   costs nothing until the timer interrupt that wakes it up. */
 void
 timer_sleep (int64_t ticks) {
 	int64_t start = timer_ticks ();
+	struct ktimer alarm;
+	enum intr_level old_level;
 
 	ASSERT (intr_get_level () == INTR_ON);
-	while (timer_elapsed (start) < ticks)
-		thread_yield ();
+	if (ticks <= 0)
+		return;
+
+	ktimer_init (&alarm, wake_sleeper, thread_current ());
+	old_level = intr_disable ();
+	ktimer_arm (&alarm, start + ticks, 0);
+	thread_block ();
+	intr_set_level (old_level);
 }
 
 /* Suspends execution for approximately MS milliseconds. */
@@ -118,16 +163,185 @@ timer_nsleep (int64_t ns) {
 /* Prints timer statistics. */
 void
 timer_print_stats (void) {
-	printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+	printf ("Timer: %"PRId64" ticks", timer_ticks ());
+	if (timer_tickless)
+		printf (" (%"PRId64" skipped while idle)", skipped_ticks);
+	printf ("\n");
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  In tickless mode, replaces the periodic tick by a
+   single one-shot interrupt at the next tick on which a kernel
+   timer is due, if that is at least two ticks away. */
+void
+timer_idle_enter (void) {
+	unsigned phase;
+	int64_t next;
+	bool out;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (!timer_tickless || idle_oneshot)
+		return;
+
+	/* The other CPUs get their ticks from the BSP's, so only stop
+	   it if there are no other CPUs. */
+	if (cpu_cnt > 1)
+		return;
+
+	/* PIT counts left until the current tick ends.  If a resync
+	   one-shot already ran out, its interrupt is pending and will
+	   end the tick as soon as we halt. */
+	phase = pit_read_count (&out);
+	if ((resync && out) || phase == 0 || phase > PIT_TICK_COUNT)
+		return;
+
+	next = ktimer_next_event (ticks + PIT_MAX_TICKS);
+	if (next - ticks < 2)
+		return;
+
+	idle_ticks = next - ticks;
+	idle_phase = phase;
+	idle_counts = phase + (idle_ticks - 1) * PIT_TICK_COUNT;
+	idle_oneshot = true;
+	resync = false;
+	pit_oneshot (idle_counts);
+}
+
+/* Called on entry to every external interrupt handler.  If the
+   tick was stopped for idle, works out how many ticks went by,
+   folds them back into the tick count and the statistics, and
+   fires any kernel timers that came due.  TIMER_IRQ says whether
+   the interrupt being handled is the timer's own. */
+void
+timer_idle_exit (bool timer_irq) {
+	int64_t skipped;
+	unsigned remaining = 0;
+	bool expired = false;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	if (!idle_oneshot)
+		return;
+	idle_oneshot = false;
+
+	if (!timer_irq)
+		remaining = pit_read_count (&expired);
+	if (timer_irq || expired) {
+		/* The one-shot ran out.  Its interrupt, being handled now
+		   or still pending, accounts for the final tick. */
+		skipped = idle_ticks - 1;
+		pit_periodic ();
+	} else {
+		/* Woken early by some other device.  Count the whole
+		   ticks that passed and run a one-shot up to the next
+		   tick boundary, so that the periodic tick resumes in
+		   phase. */
+		unsigned elapsed = idle_counts - remaining;
+		unsigned to_boundary;
+
+		if (elapsed < idle_phase) {
+			skipped = 0;
+			to_boundary = idle_phase - elapsed;
+		} else {
+			skipped = 1 + (elapsed - idle_phase) / PIT_TICK_COUNT;
+			to_boundary = PIT_TICK_COUNT
+				- (elapsed - idle_phase) % PIT_TICK_COUNT;
+		}
+		resync = true;
+		pit_oneshot (to_boundary);
+	}
+	fold_skipped_ticks (skipped);
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED) {
+	if (resync) {
+		/* We are on a tick boundary again. */
+		resync = false;
+		pit_periodic ();
+	}
+
 	ticks++;
+	ktimer_run (ticks);
+	thread_tick ();
+
+	/* Only the BSP receives the PIT's interrupts.  Pass the tick
+	   on to the other CPUs. */
+	if (cpu_cnt > 1)
+		lapic_broadcast_ipi (LAPIC_IPI_TICK);
+}
+
+/* Timer tick IPI handler, run by every CPU but the BSP on each
+   timer tick. */
+static void
+timer_ipi (struct intr_frame *args UNUSED) {
 	thread_tick ();
 }
 
+/* Kernel timer callback for timer_sleep(): wakes up SLEEPER,
+   preempting the interrupted thread if SLEEPER outranks it. */
+static void
+wake_sleeper (struct ktimer *alarm UNUSED, void *sleeper_) {
+	struct thread *sleeper = sleeper_;
+
+	thread_unblock (sleeper);
+	if (sleeper->priority > thread_current ()->priority)
+		intr_yield_on_return ();
+}
+
+/* Adds SKIPPED ticks that passed without timer interrupts to the
+   tick count and the idle statistics, and fires the kernel
+   timers that came due in the meantime. */
+static void
+fold_skipped_ticks (int64_t skipped) {
+	int64_t i;
+
+	for (i = 0; i < skipped; i++) {
+		ticks++;
+		ktimer_run (ticks);
+	}
+	skipped_ticks += skipped;
+	thread_tick_skipped (skipped);
+}
+
+/* Programs PIT counter 0 to interrupt TIMER_FREQ times per
+   second. */
+static void
+pit_periodic (void) {
+	uint16_t count = PIT_TICK_COUNT;
+
+	outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
+	outb (0x40, count & 0xff);
+	outb (0x40, count >> 8);
+}
+
+/* Programs PIT counter 0 to interrupt once, COUNTS input clock
+   cycles from now. */
+static void
+pit_oneshot (unsigned counts) {
+	ASSERT (counts > 0 && counts <= 0xffff);
+
+	outb (0x43, 0x30);    /* CW: counter 0, LSB then MSB, mode 0, binary. */
+	outb (0x40, counts & 0xff);
+	outb (0x40, counts >> 8);
+}
+
+/* Returns the current value of PIT counter 0, and sets *OUT to
+   the state of its output pin.  In one-shot mode, the output
+   goes high once the count runs out. */
+static unsigned
+pit_read_count (bool *out) {
+	uint8_t status, lo, hi;
+
+	outb (0x43, 0xc2);    /* Read-back: latch status and count of counter 0. */
+	status = inb (0x40);
+	lo = inb (0x40);
+	hi = inb (0x40);
+
+	*out = (status & 0x80) != 0;
+	return lo | (hi << 8);
+}
+
 /* Returns true if LOOPS iterations waits for more than one timer
    tick, otherwise false. */
 static bool
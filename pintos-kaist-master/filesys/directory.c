@@ -4,7 +4,7 @@
 #include <list.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* A directory. */
 struct dir {
@@ -19,6 +19,15 @@ struct dir_entry {
 	bool in_use;                        /* In use or free? */
 };
 
+/* Cache of open directories. */
+static struct kmem_cache dir_cache;
+
+/* Initializes the directory module. */
+void
+dir_init (void) {
+	kmem_cache_init (&dir_cache, "dir", sizeof (struct dir), 0, NULL);
+}
+
 /* Creates a directory with space for ENTRY_CNT entries in the
  * given SECTOR.  Returns true if successful, false on failure. */
 bool
@@ -30,14 +39,14 @@ dir_create (disk_sector_t sector, size_t entry_cnt) {
  * it takes ownership.  Returns a null pointer on failure. */
 struct dir *
 dir_open (struct inode *inode) {
-	struct dir *dir = calloc (1, sizeof *dir);
+	struct dir *dir = kmem_cache_alloc (&dir_cache);
 	if (inode != NULL && dir != NULL) {
 		dir->inode = inode;
 		dir->pos = 0;
 		return dir;
 	} else {
 		inode_close (inode);
-		free (dir);
+		kmem_cache_free (&dir_cache, dir);
 		return NULL;
 	}
 }
@@ -61,7 +70,7 @@ void
 dir_close (struct dir *dir) {
 	if (dir != NULL) {
 		inode_close (dir->inode);
-		free (dir);
+		kmem_cache_free (&dir_cache, dir);
 	}
 }
 
@@ -0,0 +1,44 @@
+#ifndef DEVICES_KTIMER_H
+#define DEVICES_KTIMER_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kernel timers.
+
+   A kernel timer invokes a callback once the timer tick count
+   reaches a given deadline, and optionally again every PERIOD
+   ticks after that.  Callbacks run inside the timer interrupt
+   handler, with interrupts off, so they must not sleep; the
+   usual thing to do in one is thread_unblock() or sema_up().
+
+   Timers are kept in a hierarchical timing wheel, so arming and
+   cancelling a timer are O(1) and each timer tick touches only
+   the timers that are due (plus an occasional cascade of a
+   coarser slot), no matter how many timers are pending.
+
+   A struct ktimer is owned by its caller and must stay valid
+   until it fires (for one-shot timers) or is cancelled. */
+
+struct ktimer;
+typedef void ktimer_func (struct ktimer *, void *aux);
+
+struct ktimer {
+	struct list_elem elem;      /* Element in a wheel slot. */
+	int64_t expires;            /* Tick at which the timer fires. */
+	int64_t period;             /* Re-arm interval, or 0 if one-shot. */
+	ktimer_func *func;          /* Callback. */
+	void *aux;                  /* Callback argument. */
+	bool pending;               /* Armed and not yet fired? */
+};
+
+void ktimer_subsystem_init (void);
+void ktimer_init (struct ktimer *, ktimer_func *, void *aux);
+void ktimer_arm (struct ktimer *, int64_t expires, int64_t period);
+bool ktimer_cancel (struct ktimer *);
+bool ktimer_pending (const struct ktimer *);
+void ktimer_run (int64_t now);
+int64_t ktimer_next_event (int64_t limit);
+
+#endif /* devices/ktimer.h */
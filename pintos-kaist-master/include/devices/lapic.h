@@ -0,0 +1,26 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vectors used for inter-processor interrupts (IPIs).
+   They sit at the top of the vector space, above everything
+   else, so that they have the highest priority. */
+#define LAPIC_IPI_FIRST   0xf0  /* First IPI vector. */
+#define LAPIC_IPI_TICK    0xf0  /* Timer tick, relayed by the BSP. */
+#define LAPIC_IPI_RESCHED 0xf1  /* Run queue changed: reschedule. */
+#define LAPIC_IPI_TLB     0xf2  /* Page table changed: flush TLB. */
+#define LAPIC_IPI_LAST    0xfe  /* Last IPI vector. */
+#define LAPIC_SPURIOUS    0xff  /* Spurious interrupt vector. */
+
+void lapic_map (uint64_t paddr);
+bool lapic_present (void);
+void lapic_init (bool bsp);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+void lapic_broadcast_ipi (uint8_t vec);
+void lapic_start_ap (uint8_t apic_id, uint64_t paddr);
+
+#endif /* devices/lapic.h */
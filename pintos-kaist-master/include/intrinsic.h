@@ -50,6 +50,37 @@ static __inline uint64_t rcr3(void) {
 	return val;
 }
 
+__attribute__((always_inline))
+static __inline uint64_t rcr0(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr0,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr0(uint64_t val) {
+	__asm __volatile("movq %0, %%cr0" : : "r" (val));
+}
+
+__attribute__((always_inline))
+static __inline uint64_t rcr4(void) {
+	uint64_t val;
+	__asm __volatile("movq %%cr4,%0" : "=r" (val));
+	return val;
+}
+
+__attribute__((always_inline))
+static __inline void lcr4(uint64_t val) {
+	__asm __volatile("movq %0, %%cr4" : : "r" (val));
+}
+
+/* Clears CR0's Task Switched flag, allowing FPU instructions
+   without a #NM exception. */
+__attribute__((always_inline))
+static __inline void clts(void) {
+	__asm __volatile("clts");
+}
+
 __attribute__((always_inline))
 static __inline uint64_t rrax(void) {
 	uint64_t val;
@@ -119,6 +150,22 @@ static __inline uint64_t rcr2(void) {
 	return val;
 }
 
+__attribute__((always_inline))
+static __inline uint64_t rdtsc(void) {
+	uint32_t lo, hi;
+	__asm __volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((uint64_t) hi << 32) | lo;
+}
+
+/* Executes CPUID for LEAF, storing EAX, EBX, ECX, and EDX in
+   REGS[0...3]. */
+__attribute__((always_inline))
+static __inline void cpuid(uint32_t leaf, uint32_t regs[4]) {
+	__asm __volatile("cpuid"
+			: "=a" (regs[0]), "=b" (regs[1]), "=c" (regs[2]), "=d" (regs[3])
+			: "a" (leaf), "c" (0));
+}
+
 __attribute__((always_inline))
 static __inline void write_msr(uint32_t ecx, uint64_t val) {
 	uint32_t edx, eax;
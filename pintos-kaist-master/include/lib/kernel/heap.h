@@ -0,0 +1,66 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Pairing heap.
+ *
+ * A priority queue: insertion takes O(1) time, finding the least
+ * element O(1), and removing the least element, or any other,
+ * O(log n) amortized time.  An element whose key changes can be
+ * moved to its new place with heap_update().
+ *
+ * Like the list and hash table, the heap does not use dynamic
+ * allocation.  Each structure that can be in a heap must embed a
+ * struct heap_elem member, and heap_entry() converts a pointer
+ * to that member back to a pointer to the structure.  Elements
+ * are ordered by a comparison function supplied to heap_init().
+ * The order among elements that compare equal is unspecified.
+ *
+ * See M. L. Fredman et al., "The Pairing Heap: A New Form of
+ * Self-Adjusting Heap", Algorithmica 1(1), 1986. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem {
+	struct heap_elem *child;    /* First child, or null. */
+	struct heap_elem *next;     /* Next sibling, or null. */
+	struct heap_elem *prev;     /* Previous sibling, or parent if
+	                               first child, or null if root. */
+};
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+ * the structure that HEAP_ELEM is embedded inside.  Supply the
+ * name of the outer structure STRUCT and the member name MEMBER
+ * of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)                   \
+	((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child            \
+		- offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+		const struct heap_elem *b,
+		void *aux);
+
+/* Pairing heap. */
+struct heap {
+	struct heap_elem *root;     /* Least element, or null if empty. */
+	size_t size;                /* Number of elements. */
+	heap_less_func *less;       /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+struct heap_elem *heap_min (const struct heap *);
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,33 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+/* LZ77 compression, in the LZ4 block format.
+ *
+ * Fast rather than thorough: the compressor finds matches
+ * through a hash table of the positions where each 4-byte
+ * sequence was last seen, and the decompressor is a loop of
+ * copies.  Meant for small buffers, such as pages; the input to
+ * lz_compress() may be at most LZ_MAX_INPUT bytes.
+ *
+ * The compressor needs LZ_WORK_SIZE bytes of scratch space,
+ * which the caller provides, so that it neither allocates memory
+ * nor uses much stack. */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Most bytes that lz_compress() takes at once. */
+#define LZ_MAX_INPUT 65536
+
+/* Bytes of scratch space that lz_compress() needs. */
+#define LZ_WORK_SIZE (4096 * sizeof (uint16_t))
+
+/* Returned by lz_decompress() for malformed input. */
+#define LZ_ERROR SIZE_MAX
+
+size_t lz_compress (const void *src, size_t src_size, void *dst,
+		size_t dst_size, void *work);
+size_t lz_decompress (const void *src, size_t src_size, void *dst,
+		size_t dst_size);
+
+#endif /* lib/kernel/lz.h */
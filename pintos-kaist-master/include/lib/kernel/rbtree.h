@@ -0,0 +1,66 @@
+#ifndef __LIB_KERNEL_RBTREE_H
+#define __LIB_KERNEL_RBTREE_H
+
+/* Red-black tree.
+ *
+ * A balanced binary search tree: insertion and removal take
+ * O(log n) time, and finding the minimum element takes O(1),
+ * because the tree keeps a pointer to it.
+ *
+ * Like the list and hash table, the tree does not use dynamic
+ * allocation.  Each structure that can be in a tree must embed
+ * a struct rb_elem member, and rb_entry() converts a pointer to
+ * that member back to a pointer to the structure.  Elements are
+ * ordered by a comparison function supplied to rb_init().
+ * Elements that compare equal are kept in insertion order, so
+ * that the first one inserted is the first one found.
+ *
+ * See [CLR] chapter 13 "Red-Black Trees". */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Red-black tree element. */
+struct rb_elem {
+	struct rb_elem *parent;     /* Parent, or null for the root. */
+	struct rb_elem *left;       /* Left child, or null. */
+	struct rb_elem *right;      /* Right child, or null. */
+	bool red;                   /* Red if true, black if false. */
+};
+
+/* Converts pointer to tree element RB_ELEM into a pointer to the
+ * structure that RB_ELEM is embedded inside.  Supply the name of
+ * the outer structure STRUCT and the member name MEMBER of the
+ * tree element. */
+#define rb_entry(RB_ELEM, STRUCT, MEMBER)                       \
+	((STRUCT *) ((uint8_t *) &(RB_ELEM)->parent             \
+		- offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two tree elements A and B, given
+ * auxiliary data AUX.  Returns true if A is less than B, or
+ * false if A is greater than or equal to B. */
+typedef bool rb_less_func (const struct rb_elem *a,
+		const struct rb_elem *b,
+		void *aux);
+
+/* Red-black tree. */
+struct rb_tree {
+	struct rb_elem *root;       /* Root, or null if empty. */
+	struct rb_elem *min;        /* Leftmost element, or null if empty. */
+	size_t size;                /* Number of elements. */
+	rb_less_func *less;         /* Comparison function. */
+	void *aux;                  /* Auxiliary data for `less'. */
+};
+
+void rb_init (struct rb_tree *, rb_less_func *, void *aux);
+void rb_insert (struct rb_tree *, struct rb_elem *);
+void rb_remove (struct rb_tree *, struct rb_elem *);
+
+struct rb_elem *rb_min (const struct rb_tree *);
+struct rb_elem *rb_floor (const struct rb_tree *, const struct rb_elem *key);
+struct rb_elem *rb_next (struct rb_elem *);
+size_t rb_size (const struct rb_tree *);
+bool rb_empty (const struct rb_tree *);
+
+#endif /* lib/kernel/rbtree.h */
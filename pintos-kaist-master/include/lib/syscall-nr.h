@@ -38,4 +38,19 @@ enum {
 	SYS_UMOUNT,
 };
 
+/* Selectors for get_sched_stat(), which is int 0x45. */
+enum {
+	SCHED_STAT_RUN_CYCLES,      /* TSC cycles this thread has run. */
+	SCHED_STAT_WAIT_CYCLES,     /* TSC cycles it has waited, ready. */
+	SCHED_STAT_VOLUNTARY,       /* Times it blocked or yielded. */
+	SCHED_STAT_INVOLUNTARY,     /* Times it was preempted. */
+
+	/* SCHED_STAT_LATENCY + N, for 0 <= N < SCHED_LATENCY_BUCKETS:
+	   wakeups, system-wide, after which the woken thread took
+	   2**N to 2**(N+1) - 1 cycles to run.  The last bucket also
+	   counts longer waits. */
+	SCHED_STAT_LATENCY,
+};
+#define SCHED_LATENCY_BUCKETS 32
+
 #endif /* lib/syscall-nr.h */
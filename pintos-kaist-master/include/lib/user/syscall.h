@@ -78,4 +78,14 @@ get_fs_disk_write_cnt (void) {
 	return write_cnt;
 }
 
+/* Returns the scheduler statistic selected by WHICH, one of the
+   SCHED_STAT_* values in syscall-nr.h, or -1 if there is no such
+   statistic. */
+static inline long long
+get_sched_stat (int which) {
+	long long value;
+	asm volatile ("int $0x45" : "=a" (value) : "d" ((long long) which));
+	return value;
+}
+
 #endif /* lib/user/syscall.h */
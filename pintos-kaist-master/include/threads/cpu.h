@@ -0,0 +1,72 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/runqueue.h"
+
+/* Maximum number of CPUs we will bring up. */
+#define CPU_MAX 8
+
+struct thread;
+struct task_state;
+
+/* Per-CPU state.
+ *
+ * cpus[0] is the bootstrap processor (BSP), the one that runs
+ * main().  The others are application processors (APs), started
+ * by smp_init().  A thread finds the CPU it is running on
+ * through the `cpu' member of its struct thread, which the
+ * scheduler sets whenever it switches to the thread; see
+ * cpu_current().
+ *
+ * Members owned by the scheduler are only touched with
+ * interrupts off, which on SMP also means with the interrupt
+ * lock held (see interrupt.c), so threads on other CPUs may read
+ * and update them too, for example to queue a thread on a CPU
+ * other than their own. */
+struct cpu {
+	/* Used by userprog/syscall-entry.S, which finds this
+	   structure through the kernel GS base before it has a
+	   stack.  Keep these first, at the offsets it expects. */
+	uint64_t syscall_scratch[2];        /* Saved user %rbx and %r12. */
+	struct task_state *tss;             /* This CPU's TSS. */
+
+	/* Owned by threads/smp.c. */
+	int id;                             /* Index in cpus[]. */
+	uint8_t apic_id;                    /* Local APIC ID. */
+	volatile bool started;              /* Done booting? */
+
+	/* Owned by threads/thread.c. */
+	struct thread *idle_thread;         /* This CPU's idle thread. */
+	struct thread *curr;                /* Thread running on this CPU. */
+	struct runqueue rq;                 /* Threads ready to run here. */
+	unsigned thread_ticks;              /* Timer ticks since last yield. */
+	bool preempting;                    /* In thread_preempt()? */
+	long long idle_ticks;               /* Timer ticks spent idle. */
+	long long kernel_ticks;             /* Timer ticks in kernel threads. */
+	long long user_ticks;               /* Timer ticks in user programs. */
+
+	/* Owned by threads/interrupt.c. */
+	bool in_external_intr;              /* Processing an external interrupt? */
+	bool yield_on_return;               /* Yield on interrupt return? */
+
+	/* Owned by threads/fpu.c. */
+	struct thread *fpu_owner;           /* Thread whose state the FPU holds. */
+	bool fpu_kernel;                    /* In kernel_fpu_begin()? */
+	enum intr_level fpu_kernel_level;   /* Level before kernel_fpu_begin(). */
+};
+
+/* All the CPUs, of which the first CPU_CNT are online. */
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+/* -cpus=N: Maximum number of CPUs to use. */
+extern int cpu_limit;
+
+struct cpu *cpu_current (void);
+
+void smp_init (void);
+
+#endif /* threads/cpu.h */
@@ -0,0 +1,45 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* 17.14 fixed-point real arithmetic, as used by the 4.4BSD
+   scheduler.  A fixed_t X represents the real number X / F.
+   Products and quotients are computed in 64 bits, so they do not
+   overflow for any result that fits. */
+typedef int64_t fixed_t;
+
+#define FP_SHIFT 14
+#define FP_F (1 << FP_SHIFT)
+
+/* Converts integer N to fixed point. */
+static inline fixed_t
+fp_from_int (int n) {
+	return (fixed_t) n * FP_F;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_to_int (fixed_t x) {
+	return x / FP_F;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_t x) {
+	return x >= 0 ? (x + FP_F / 2) / FP_F : (x - FP_F / 2) / FP_F;
+}
+
+/* Returns X * Y. */
+static inline fixed_t
+fp_mul (fixed_t x, fixed_t y) {
+	return x * y / FP_F;
+}
+
+/* Returns X / Y. */
+static inline fixed_t
+fp_div (fixed_t x, fixed_t y) {
+	return x * FP_F / y;
+}
+
+#endif /* threads/fixed-point.h */
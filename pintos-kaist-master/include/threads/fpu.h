@@ -0,0 +1,21 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdbool.h>
+
+struct thread;
+
+void fpu_init (void);
+void fpu_init_ap (void);
+void fpu_switch (struct thread *prev, struct thread *next);
+void fpu_save (struct thread *);
+bool fpu_copy (struct thread *dst, struct thread *src);
+void fpu_release (struct thread *);
+void fpu_print_stats (void);
+
+/* Brackets kernel code that uses FPU, MMX, or SSE instructions.
+   Such code runs with interrupts off and must not nest. */
+void kernel_fpu_begin (void);
+void kernel_fpu_end (void);
+
+#endif /* threads/fpu.h */
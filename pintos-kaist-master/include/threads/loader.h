@@ -25,6 +25,11 @@
 #define LOADER_ARGS (LOADER_SIG - LOADER_ARGS_LEN)     /* Command-line args. */
 #define LOADER_ARG_CNT (LOADER_ARGS - LOADER_ARG_CNT_LEN) /* Number of args. */
 
+/* Physical address to which threads/smp.c copies the real-mode
+   startup code for application processors.  Must be a page
+   boundary below 1 MB that the kernel does not otherwise use. */
+#define LOADER_AP_START 0x8000
+
 /* Sizes of loader data structures. */
 #define LOADER_SIG_LEN 2
 #define LOADER_ARGS_LEN 128
@@ -4,7 +4,19 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Number of the smallest size classes that have per-thread
+   magazines. */
+#define MALLOC_MAG_CLASSES 12
+
+/* A thread's cache of free blocks of one size class, which it
+   can allocate and free without locking. */
+struct malloc_magazine {
+	void *top;                  /* Most recently freed block, or null. */
+	unsigned cnt;               /* Number of blocks. */
+};
+
 void malloc_init (void);
+void malloc_thread_exit (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
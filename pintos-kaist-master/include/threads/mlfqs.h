@@ -0,0 +1,22 @@
+#ifndef THREADS_MLFQS_H
+#define THREADS_MLFQS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Range of nice values. */
+#define NICE_MIN -20
+#define NICE_MAX 20
+
+void mlfqs_init_thread (struct thread *, const struct thread *parent);
+bool mlfqs_tick (void);
+void mlfqs_update (struct thread *);
+int64_t mlfqs_epoch (void);
+
+void mlfqs_set_nice (struct thread *, int nice);
+int mlfqs_get_recent_cpu (struct thread *);
+int mlfqs_get_load_avg (void);
+
+#endif /* threads/mlfqs.h */
@@ -0,0 +1,72 @@
+#ifndef THREADS_RUNQUEUE_H
+#define THREADS_RUNQUEUE_H
+
+#include <list.h>
+#include <rbtree.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Number of distinct priority levels, PRI_MIN...PRI_MAX. */
+#define RQ_LEVELS 64
+
+/* Priority-indexed run queue.
+ *
+ * Keeps one FIFO list of ready threads per priority level, plus a
+ * bitmap whose bit P is set if and only if level P is non-empty.
+ * Finding the highest non-empty level is then a single
+ * find-last-set instruction, so enqueue, dequeue, and pick-next
+ * are all O(1) regardless of how many threads are runnable.
+ *
+ * With -mlfqs, queued threads' priorities go stale once a second,
+ * when their recent_cpu decays.  The queue also keeps its threads
+ * in the order they were queued, so that the stale ones are at the
+ * front, and each timer tick on the queue's CPU recomputes a few
+ * of them and moves them to their new levels, with
+ * runqueue_refresh(), so that neither runqueue_pop() nor the timer
+ * interrupt has to visit every thread; see mlfqs.c.
+ *
+ * With -cfs, the completely fair scheduler, threads are instead
+ * kept in a red-black tree ordered by virtual runtime, the CPU
+ * time each has received scaled down by a weight derived from
+ * its priority.  The thread that has received the least is
+ * picked first, so that over time every thread gets a share of
+ * the CPU proportional to its weight.
+ *
+ * Callers are responsible for mutual exclusion, which in
+ * practice means calling with interrupts off. */
+struct runqueue {
+	struct list levels[RQ_LEVELS];  /* Ready threads, one list per level. */
+	uint64_t bitmap;                /* Bit P set iff levels[P] non-empty. */
+	size_t size;                    /* Number of queued threads. */
+	struct list mlfqs_order;        /* With -mlfqs, in order queued. */
+
+	/* Used instead of the above with -cfs. */
+	struct rb_tree fair;            /* Ready threads, by vruntime. */
+	int64_t min_vruntime;           /* Never decreases. */
+};
+
+void runqueue_init (struct runqueue *);
+void runqueue_push (struct runqueue *, struct thread *);
+void runqueue_remove (struct runqueue *, struct thread *);
+struct thread *runqueue_pop (struct runqueue *);
+struct thread *runqueue_steal (struct runqueue *from, struct runqueue *to);
+int runqueue_max_priority (const struct runqueue *);
+bool runqueue_charge (struct runqueue *, struct thread *, unsigned ticks);
+void runqueue_refresh (struct runqueue *, size_t max);
+
+/* Returns true if RQ has no ready threads. */
+static inline bool
+runqueue_empty (const struct runqueue *rq) {
+	return rq->size == 0;
+}
+
+/* Returns the number of threads queued in RQ. */
+static inline size_t
+runqueue_size (const struct runqueue *rq) {
+	return rq->size;
+}
+
+#endif /* threads/runqueue.h */
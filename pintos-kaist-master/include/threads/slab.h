@@ -0,0 +1,50 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Size of a cache line, for aligning objects that are written by
+   different CPUs. */
+#define CACHE_LINE_SIZE 64
+
+/* Puts a new object into its initial state.  Called once, when
+   the object's slab is created, not on every allocation. */
+typedef void kmem_ctor (void *obj);
+
+/* A cache of objects of one size. */
+struct kmem_cache {
+	const char *name;           /* Name, for statistics. */
+	size_t obj_size;            /* Object size, rounded up to `align'. */
+	size_t align;               /* Object alignment. */
+	size_t objs_per_slab;       /* Number of objects in a slab. */
+	size_t first_ofs;           /* Offset of first object in a slab. */
+	kmem_ctor *ctor;            /* Constructor, or null. */
+	struct lock lock;           /* Protects the slab lists. */
+	struct list partial;        /* Slabs with some objects free. */
+	struct list full;           /* Slabs with no objects free. */
+	struct list empty;          /* At most one slab with all free. */
+	struct list_elem elem;      /* Element in list of all caches. */
+
+	/* Statistics. */
+	long long alloc_cnt;        /* Objects allocated. */
+	size_t slab_cnt;            /* Slabs held. */
+	size_t in_use;              /* Objects allocated and not freed. */
+	size_t max_in_use;          /* Greatest value of `in_use'. */
+};
+
+void kmem_init (void);
+void kmem_cache_init (struct kmem_cache *, const char *name, size_t size,
+		size_t align, kmem_ctor *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_print_stats (void);
+
+/* For malloc.c. */
+bool kmem_owns (const void *);
+void kmem_free (void *);
+size_t kmem_size (const void *);
+
+#endif /* threads/slab.h */
@@ -0,0 +1,35 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct cpu;
+
+/* Spin lock.
+ *
+ * Unlike a `struct lock', a spin lock never sleeps: a CPU that
+ * finds it held busy-waits until the holder releases it.  That
+ * makes it usable where sleeping is not, such as in interrupt
+ * handlers and inside the scheduler, but it must only be held
+ * for short stretches, and only with interrupts off, so that the
+ * holder cannot be descheduled or interrupted by code that tries
+ * to take the same lock on the same CPU.
+ *
+ * Spin locks are not recursive. */
+struct spinlock {
+	volatile unsigned locked;   /* Nonzero while held. */
+	struct cpu *cpu;            /* CPU holding the lock (for debugging). */
+	const char *name;           /* Name (for debugging). */
+};
+
+/* Initializer for a spin lock named NAME that starts out free. */
+#define SPINLOCK_INITIALIZER(NAME) { 0, NULL, (NAME) }
+
+void spin_init (struct spinlock *, const char *name);
+void spin_acquire (struct spinlock *);
+bool spin_try_acquire (struct spinlock *);
+void spin_release (struct spinlock *);
+bool spin_held (const struct spinlock *);
+
+#endif /* threads/spinlock.h */
@@ -1,13 +1,14 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
 
 /* A counting semaphore. */
 struct semaphore {
 	unsigned value;             /* Current value. */
-	struct list waiters;        /* List of waiting threads. */
+	struct heap waiters;        /* Waiting threads, by priority. */
 };
 
 void sema_init (struct semaphore *, unsigned value);
@@ -20,6 +21,7 @@ void sema_self_test (void);
 struct lock {
 	struct thread *holder;      /* Thread holding lock (for debugging). */
 	struct semaphore semaphore; /* Binary semaphore controlling access. */
+	struct list_elem elem;      /* Element in holder's `held_locks'. */
 };
 
 void lock_init (struct lock *);
@@ -30,7 +32,7 @@ bool lock_held_by_current_thread (const struct lock *);
 
 /* Condition variable. */
 struct condition {
-	struct list waiters;        /* List of waiting threads. */
+	struct heap waiters;        /* Waiting threads, by priority. */
 };
 
 void cond_init (struct condition *);
@@ -38,6 +40,32 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock policy, for choosing between waiting
+ * readers and writers. */
+enum rwlock_policy {
+	RWLOCK_FAIR,                /* Alternate writers with batches of
+	                               all the waiting readers. */
+	RWLOCK_PREFER_WRITERS,      /* Waiting writers go first. */
+};
+
+/* Readers-writer lock. */
+struct rwlock {
+	struct thread *writer;      /* Thread holding lock for writing. */
+	unsigned readers;           /* Number of threads reading. */
+	enum rwlock_policy policy;  /* Policy. */
+	struct heap read_waiters;   /* Threads waiting to read. */
+	struct heap write_waiters;  /* Threads waiting to write. */
+};
+
+void rw_init (struct rwlock *, enum rwlock_policy);
+void rw_read_acquire (struct rwlock *);
+bool rw_try_read_acquire (struct rwlock *);
+void rw_read_release (struct rwlock *);
+void rw_write_acquire (struct rwlock *);
+bool rw_try_write_acquire (struct rwlock *);
+void rw_write_release (struct rwlock *);
+bool rw_write_held_by_current_thread (const struct rwlock *);
+
 /* Optimization barrier.
  *
  * The compiler will not reorder operations across an
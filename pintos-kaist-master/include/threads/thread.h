@@ -2,9 +2,13 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
+#include <rbtree.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #ifdef VM
 #include "vm/vm.h"
 #endif
@@ -80,24 +84,65 @@ typedef int tid_t;
  * set to THREAD_MAGIC.  Stack overflow will normally change this
  * value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
- * the run queue (thread.c), or it can be an element in a
- * semaphore wait list (synch.c).  It can be used these two ways
+ * the run queue (thread.c), or it can be an element in the list
+ * of dying threads (thread.c).  It can be used these two ways
  * only because they are mutually exclusive: only a thread in the
- * ready state is on the run queue, whereas only a thread in the
- * blocked state is on a semaphore wait list. */
+ * ready state is on the run queue, whereas only a dying thread
+ * is on the list of dying threads.  A thread that is blocked on
+ * a semaphore or condition variable (synch.c) is in its waiters
+ * heap through `wait_elem' instead. */
 struct thread {
 	/* Owned by thread.c. */
 	tid_t tid;                          /* Thread identifier. */
 	enum thread_status status;          /* Thread state. */
 	char name[16];                      /* Name (for debugging purposes). */
-	int priority;                       /* Priority. */
+	int priority;                       /* Priority, including donations. */
 
 	/* Shared between thread.c and synch.c. */
 	struct list_elem elem;              /* List element. */
+	struct runqueue *rq;                /* Run queue while ready. */
+	int rq_level;                       /* Run queue level while ready. */
+	struct list_elem mlfqs_elem;        /* Run queue's `mlfqs_order'. */
+	int base_priority;                  /* Priority before donations. */
+	struct list held_locks;             /* Locks held, for donations. */
+	struct lock *wait_lock;             /* Lock being waited for, or null. */
+	struct heap_elem wait_elem;         /* Element in a waiters heap. */
+	struct heap *wait_heap;             /* Heap `wait_elem' is in, or null. */
+	uint64_t wait_seq;                  /* Order of arrival in `wait_heap'. */
+	struct rb_elem fair_elem;           /* Run queue element with -cfs. */
+	int64_t vruntime;                   /* Weighted CPU time, for -cfs. */
+
+	/* Owned by threads/mlfqs.c. */
+	int nice;                           /* Niceness, for -mlfqs. */
+	fixed_t recent_cpu;                 /* Recent CPU time, for -mlfqs. */
+	int64_t mlfqs_epoch;                /* Seconds of decay applied. */
+
+	/* Owned by thread.c. */
+	struct cpu *cpu;                    /* CPU this thread last ran on. */
+	uint64_t switch_rsp;                /* Saved by switch_fast(), or 0. */
+	uint64_t run_cycles;                /* TSC cycles spent running. */
+	uint64_t wait_cycles;               /* TSC cycles spent ready. */
+	uint64_t acct_tsc;                  /* TSC at last state change. */
+	long long voluntary_switches;       /* Blocked or yielded. */
+	long long involuntary_switches;     /* Preempted. */
+	bool woken;                         /* Ready because unblocked? */
+	int preempt_count;                  /* Depth of preempt_disable(). */
+	bool preempt_pending;               /* Preempted while disabled? */
+
+	/* Owned by threads/fpu.c. */
+	void *fpu_buf;                      /* Saved FPU state, if FPU used. */
+
+	/* Owned by threads/malloc.c. */
+	struct malloc_magazine magazines[MALLOC_MAG_CLASSES];
 
 #ifdef USERPROG
 	/* Owned by userprog/process.c. */
 	uint64_t *pml4;                     /* Page map level 4 */
+	int exit_status;                    /* Reported by process_exit(). */
+	struct list children;               /* Records of our children. */
+	struct child *child;                /* Our record in our parent. */
+	struct file **fds;                  /* Open files, indexed by fd. */
+	struct file *exec_file;             /* Our executable, kept unwritable. */
 #endif
 #ifdef VM
 	/* Table for whole virtual memory owned by thread. */
@@ -114,11 +159,34 @@ struct thread {
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler.
+   Controlled by kernel command-line option "-cfs". */
+extern bool thread_cfs;
+
+/* If false (default), switch between threads through the fast
+   path in switch.S where possible.
+   If true, always save and restore a full intr_frame.
+   Controlled by kernel command-line option "-iret-switch". */
+extern bool thread_iret_switch;
+
+/* If true, log every scheduling decision for
+   thread_sched_trace_dump().
+   Controlled by kernel command-line option "-sched-trace". */
+extern bool thread_sched_trace;
+
+struct cpu;
+
 void thread_init (void);
 void thread_start (void);
+bool thread_prepare_ap (struct cpu *);
+void thread_init_ap (void);
+void thread_start_ap (void) NO_RETURN;
 
 void thread_tick (void);
+void thread_tick_skipped (int64_t skipped);
 void thread_print_stats (void);
+void thread_sched_trace_dump (void);
+long long thread_sched_stat (int which);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
@@ -132,9 +200,15 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
+void thread_yield_if_outranked (void);
+void preempt_disable (void);
+void preempt_enable (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_reprioritize (struct thread *, int priority);
+void thread_refresh_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
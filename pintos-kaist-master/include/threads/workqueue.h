@@ -0,0 +1,47 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A function to be called later by a worker thread. */
+typedef void work_func (void *aux);
+
+/* An item of deferred work.  Once queued, it belongs to the
+   workqueue until its function starts running, at which point it
+   may be queued again, or freed by the function itself. */
+struct work {
+	struct list_elem elem;      /* Element in a workqueue's `items'. */
+	work_func *func;            /* Function to call. */
+	void *aux;                  /* Argument to `func'. */
+	bool pending;               /* Queued and not yet started? */
+	uint64_t queued_tsc;        /* TSC when queued. */
+};
+
+/* A queue of deferred work, run by a shared pool of worker
+   threads at the queue's priority. */
+struct workqueue {
+	const char *name;           /* Name, for statistics. */
+	int priority;               /* Priority to run items at. */
+	struct list items;          /* Pending items, in order queued. */
+	struct list_elem elem;      /* Element in list of all queues. */
+
+	/* Statistics. */
+	size_t depth;               /* Number of items in `items'. */
+	size_t max_depth;           /* Greatest value of `depth'. */
+	long long run_cnt;          /* Items run. */
+	long long batch_cnt;        /* Batches taken by workers. */
+	uint64_t latency_sum;       /* Cycles from queueing to running. */
+	uint64_t latency_max;       /* Greatest such latency. */
+};
+
+void workqueue_pool_init (void);
+void workqueue_init (struct workqueue *, const char *name, int priority);
+void work_init (struct work *, work_func *, void *aux);
+bool queue_work (struct workqueue *, struct work *);
+void flush_work (struct work *);
+void workqueue_print_stats (void);
+
+#endif /* threads/workqueue.h */
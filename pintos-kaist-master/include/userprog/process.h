@@ -3,6 +3,8 @@
 
 #include "threads/thread.h"
 
+struct file;
+
 tid_t process_create_initd (const char *file_name);
 tid_t process_fork (const char *name, struct intr_frame *if_);
 int process_exec (void *f_name);
@@ -10,4 +12,8 @@ int process_wait (tid_t);
 void process_exit (void);
 void process_activate (struct thread *next);
 
+int process_add_file (struct file *);
+struct file *process_get_file (int fd);
+void process_close_file (int fd);
+
 #endif /* userprog/process.h */
@@ -1,6 +1,11 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
+#include "threads/synch.h"
+
 void syscall_init (void);
 
+/* Serializes the system calls that use the file system. */
+extern struct lock filesys_lock;
+
 #endif /* userprog/syscall.h */
@@ -23,7 +23,9 @@ struct task_state {
 }__attribute__ ((packed));
 
 struct task_state;
+struct cpu;
 void tss_init (void);
+void tss_init_ap (struct cpu *);
 struct task_state *tss_get (void);
 void tss_update (struct thread *next);
 
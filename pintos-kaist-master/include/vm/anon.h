@@ -5,9 +5,12 @@ struct page;
 enum vm_type;
 
 struct anon_page {
+	size_t slot;                /* Swap slot, or SWAP_SLOT_NONE. */
+	void *zswap;                /* Compressed copy in pool, or null. */
 };
 
 void vm_anon_init (void);
 bool anon_initializer (struct page *page, enum vm_type type, void *kva);
+void anon_read_swapped (struct page *page, void *kva);
 
 #endif
@@ -7,6 +7,9 @@ struct page;
 enum vm_type;
 
 struct file_page {
+	struct file *file;          /* File the page is mapped from, or null. */
+	off_t offset;               /* Offset of the page in `file'. */
+	size_t bytes;               /* Bytes of the page that are in `file'. */
 };
 
 void vm_file_init (void);
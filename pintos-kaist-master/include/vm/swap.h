@@ -0,0 +1,36 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct disk;
+
+/* The swap disk is divided into page-sized slots, numbered from
+ * 0.  This is no slot. */
+#define SWAP_SLOT_NONE SIZE_MAX
+
+/* Number of slots a process reserves at a time, so that the pages
+ * it swaps out end up next to each other on disk and can be read
+ * back together. */
+#define SWAP_CLUSTER 8
+
+/* A process's reserved run of swap slots: NEXT is the slot its
+ * next page goes to, and END is just past the last one. */
+struct swap_cursor {
+	size_t next;
+	size_t end;
+};
+
+void swap_init (struct disk *);
+void swap_print_stats (void);
+
+void swap_cursor_init (struct swap_cursor *);
+void swap_cursor_release (struct swap_cursor *);
+
+size_t swap_write (struct swap_cursor *, const void *kva);
+void swap_flush (void);
+void swap_read (size_t slot, void *kva);
+void swap_free (size_t slot);
+
+#endif /* vm/swap.h */
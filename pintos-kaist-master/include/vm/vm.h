@@ -1,5 +1,8 @@
 #ifndef VM_VM_H
 #define VM_VM_H
+#include <hash.h>
+#include <list.h>
+#include <rbtree.h>
 #include <stdbool.h>
 #include "threads/palloc.h"
 
@@ -27,6 +30,7 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/swap.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -46,6 +50,12 @@ struct page {
 	struct frame *frame;   /* Back reference for frame */
 
 	/* Your implementation */
+	struct thread *owner;       /* Process whose page this is. */
+	struct hash_elem spt_elem;  /* Element in supplemental page table. */
+	struct vma *vma;            /* Area the page was created for, or null. */
+	struct list_elem vma_elem;  /* Element in its VMA's `pages'. */
+	struct list_elem frame_elem; /* Element in its frame's `pages'. */
+	bool writable;              /* Writable by the user? */
 
 	/* Per-type data are binded into the union.
 	 * Each function automatically detects the current union */
@@ -59,10 +69,23 @@ struct page {
 	};
 };
 
-/* The representation of "frame" */
+/* Allocate `struct page's with kmem_cache_alloc() from this. */
+extern struct kmem_cache page_struct_cache;
+
+/* The representation of "frame"
+ *
+ * After fork(), a frame may hold the same page of several
+ * processes, mapped read-only in each until one of them writes
+ * to it and gets a copy of its own.  PAGE is then the first of
+ * them, or null if there are none. */
 struct frame {
 	void *kva;
 	struct page *page;
+	struct list pages;          /* Pages that share the frame. */
+	unsigned ref_cnt;           /* Number of pages in `pages'. */
+	struct list_elem elem;      /* Element in the frame table. */
+	bool pinned;                /* Not to be evicted, e.g. while loading. */
+	bool selected;              /* Chosen by the current eviction scan. */
 };
 
 /* The function table for page operations.
@@ -81,10 +104,35 @@ struct page_operations {
 #define destroy(page) \
 	if ((page)->operations->destroy) (page)->operations->destroy (page)
 
+/* A virtual memory area: a run of pages with the same backing
+ * and permissions.  Its `struct page's are only created when the
+ * pages are first touched, so that a large mapping costs no more
+ * than a small one until it is used. */
+struct vma {
+	void *start;                /* First page. */
+	void *end;                  /* Just past the last page. */
+	enum vm_type type;          /* VM_ANON or VM_FILE, with markers. */
+	bool writable;              /* Writable by the user? */
+	struct file *file;          /* Backing file, or null. */
+	off_t offset;               /* Offset in `file' of `start'. */
+	size_t file_bytes;          /* Bytes from `file'; the rest are zeros. */
+	struct list pages;          /* Pages created so far. */
+	struct rb_elem elem;        /* Element in supplemental page table. */
+};
+
 /* Representation of current process's memory space.
- * We don't want to force you to obey any specific design for this struct.
- * All designs up to you for this. */
+ *
+ * The address space is a set of non-overlapping VMAs, in a tree
+ * ordered by start address, plus a hash table of the pages that
+ * exist so far, by address.  A page either belongs to a VMA or
+ * was created on its own by vm_alloc_page_with_initializer().
+ * The VMA that was found last is remembered, since successive
+ * faults tend to fall in the same one. */
 struct supplemental_page_table {
+	struct hash pages;          /* Pages, by `va'. */
+	struct rb_tree vmas;        /* VMAs, by `start'. */
+	struct vma *last_vma;       /* VMA found last, or null. */
+	struct swap_cursor swap_cursor; /* Swap slots for anonymous pages. */
 };
 
 #include "threads/thread.h"
@@ -96,8 +144,10 @@ struct page *spt_find_page (struct supplemental_page_table *spt,
 		void *va);
 bool spt_insert_page (struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page (struct supplemental_page_table *spt, struct page *page);
+struct vma *spt_find_vma (struct supplemental_page_table *spt, void *va);
 
 void vm_init (void);
+void vm_print_stats (void);
 bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 		bool write, bool not_present);
 
@@ -105,6 +155,9 @@ bool vm_try_handle_fault (struct intr_frame *f, void *addr, bool user,
 	vm_alloc_page_with_initializer ((type), (upage), (writable), NULL, NULL)
 bool vm_alloc_page_with_initializer (enum vm_type type, void *upage,
 		bool writable, vm_initializer *init, void *aux);
+bool vm_map_range (void *addr, size_t length, enum vm_type type,
+		bool writable, struct file *file, off_t offset, size_t file_bytes);
+void vm_unmap_range (struct vma *vma);
 void vm_dealloc_page (struct page *page);
 bool vm_claim_page (void *va);
 enum vm_type page_get_type (struct page *page);
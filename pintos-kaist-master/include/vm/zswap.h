@@ -0,0 +1,12 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+
+void zswap_init (void);
+void zswap_print_stats (void);
+
+void *zswap_store (const void *kva);
+bool zswap_load (const void *handle, void *kva);
+void zswap_free (void *handle);
+
+#endif /* vm/zswap.h */
@@ -7,6 +7,7 @@
 #include <string.h>
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/thread.h"
 #include "devices/serial.h"
 
 /* Halts the OS, printing the source file name, line number, and
@@ -30,6 +31,7 @@ debug_panic (const char *file, int line, const char *function,
 		va_end (args);
 
 		debug_backtrace ();
+		thread_sched_trace_dump ();
 	} else if (level == 2)
 		printf ("Kernel PANIC recursion at %s:%d in %s().\n",
 				file, line, function);
@@ -0,0 +1,172 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* Pairing heap.
+
+   See heap.h for basic information.
+
+   The heap is a tree in which every element is no greater than
+   its children.  Each element keeps its children in a list,
+   through `child' and the children's `next' and `prev' members,
+   and the root is the least element.
+
+   Two heaps are joined by "linking" their roots: the greater
+   root becomes the first child of the lesser.  Insertion links
+   the new element with the root.  Removing an element leaves its
+   children as a list of heaps, which are linked in pairs from
+   left to right and then the pairs are linked together from
+   right to left; this two-pass pairing is what makes the
+   amortized cost of removal logarithmic. */
+
+static struct heap_elem *link (struct heap *, struct heap_elem *,
+		struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+static void cut (struct heap_elem *);
+
+/* Initializes HEAP as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *heap, heap_less_func *less, void *aux) {
+	ASSERT (heap != NULL);
+	ASSERT (less != NULL);
+
+	heap->root = NULL;
+	heap->size = 0;
+	heap->less = less;
+	heap->aux = aux;
+}
+
+/* Inserts ELEM into HEAP. */
+void
+heap_push (struct heap *heap, struct heap_elem *elem) {
+	ASSERT (heap != NULL);
+	ASSERT (elem != NULL);
+
+	elem->child = elem->next = elem->prev = NULL;
+	heap->root = heap->root != NULL ? link (heap, heap->root, elem) : elem;
+	heap->size++;
+}
+
+/* Removes and returns the least element in HEAP, or returns a
+   null pointer if HEAP is empty. */
+struct heap_elem *
+heap_pop (struct heap *heap) {
+	struct heap_elem *min = heap->root;
+
+	if (min != NULL)
+		heap_remove (heap, min);
+	return min;
+}
+
+/* Removes ELEM, which must be in HEAP. */
+void
+heap_remove (struct heap *heap, struct heap_elem *elem) {
+	struct heap_elem *children;
+
+	ASSERT (heap != NULL);
+	ASSERT (heap->size > 0);
+	ASSERT (elem != NULL);
+
+	children = merge_pairs (heap, elem->child);
+	if (elem == heap->root)
+		heap->root = children;
+	else {
+		cut (elem);
+		if (children != NULL)
+			heap->root = link (heap, heap->root, children);
+	}
+	heap->size--;
+}
+
+/* Moves ELEM, which must be in HEAP, to its place in HEAP after
+   a change to its value. */
+void
+heap_update (struct heap *heap, struct heap_elem *elem) {
+	heap_remove (heap, elem);
+	heap_push (heap, elem);
+}
+
+/* Returns the least element in HEAP, or a null pointer if HEAP
+   is empty. */
+struct heap_elem *
+heap_min (const struct heap *heap) {
+	return heap->root;
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+heap_size (const struct heap *heap) {
+	return heap->size;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+heap_empty (const struct heap *heap) {
+	return heap->root == NULL;
+}
+
+/* Links A and B, the roots of two heaps with no siblings, and
+   returns the root of the result. */
+static struct heap_elem *
+link (struct heap *heap, struct heap_elem *a, struct heap_elem *b) {
+	if (heap->less (b, a, heap->aux)) {
+		struct heap_elem *t = a;
+		a = b;
+		b = t;
+	}
+
+	b->next = a->child;
+	if (b->next != NULL)
+		b->next->prev = b;
+	b->prev = a;
+	a->child = b;
+	return a;
+}
+
+/* Links the heaps in the sibling list that starts at FIRST into
+   one heap, by two-pass pairing, and returns its root, or a null
+   pointer if the list is empty. */
+static struct heap_elem *
+merge_pairs (struct heap *heap, struct heap_elem *first) {
+	struct heap_elem *pairs = NULL;
+	struct heap_elem *root = NULL;
+
+	/* First pass: link pairs from left to right, stacking the
+	   results on PAIRS through their `next' members. */
+	while (first != NULL) {
+		struct heap_elem *a = first;
+		struct heap_elem *b = a->next;
+
+		first = b != NULL ? b->next : NULL;
+		a->next = a->prev = NULL;
+		if (b != NULL) {
+			b->next = b->prev = NULL;
+			a = link (heap, a, b);
+		}
+		a->next = pairs;
+		pairs = a;
+	}
+
+	/* Second pass: link the pairs from right to left. */
+	while (pairs != NULL) {
+		struct heap_elem *next = pairs->next;
+
+		pairs->next = NULL;
+		root = root != NULL ? link (heap, root, pairs) : pairs;
+		pairs = next;
+	}
+	return root;
+}
+
+/* Removes non-root ELEM, with its children, from its parent's
+   list of children. */
+static void
+cut (struct heap_elem *elem) {
+	if (elem->prev->child == elem)
+		elem->prev->child = elem->next;
+	else
+		elem->prev->next = elem->next;
+	if (elem->next != NULL)
+		elem->next->prev = elem->prev;
+	elem->next = elem->prev = NULL;
+}
@@ -0,0 +1,206 @@
+#include "lz.h"
+#include <stdbool.h>
+#include <string.h>
+#include "../debug.h"
+
+/* LZ77 compression.
+
+   See lz.h for basic information.
+
+   The compressed data is a series of sequences.  Each starts
+   with a token byte, whose upper 4 bits are a count of literal
+   bytes and whose lower 4 bits are a match length, less
+   MIN_MATCH.  A count of 15 in either half continues in the
+   bytes that follow, each added in, until one that is not 255.
+   The literals come next, then the match offset, 2 bytes little
+   endian, and the match's continuation bytes, if any.  The match
+   is a copy of the LENGTH bytes that start OFFSET bytes back in
+   the output, where the source may overlap the copy, so that a
+   run of one byte takes just one literal and one match.  The last
+   sequence has only literals. */
+
+/* Shortest match worth encoding. */
+#define MIN_MATCH 4
+
+/* The hash table in the work space: 2**HASH_BITS positions. */
+#define HASH_BITS 12
+
+/* Longest match offset. */
+#define MAX_OFFSET 0xffff
+
+static uint8_t *put_sequence (uint8_t *op, uint8_t *oend,
+		const uint8_t *lit, size_t lit_len, size_t offset, size_t match_len);
+static uint8_t *put_length (uint8_t *op, uint8_t *oend, size_t len);
+static bool get_length (const uint8_t **ip, const uint8_t *iend,
+		size_t *len);
+
+/* Returns the 4 bytes at P. */
+static inline uint32_t
+read32 (const uint8_t *p) {
+	uint32_t x;
+
+	memcpy (&x, p, sizeof x);
+	return x;
+}
+
+/* Returns the hash table index for 4-byte sequence X. */
+static inline size_t
+hash_seq (uint32_t x) {
+	return (x * 2654435761u) >> (32 - HASH_BITS);
+}
+
+/* Compresses the SRC_SIZE bytes at SRC into the DST_SIZE bytes at
+   DST, using the LZ_WORK_SIZE bytes at WORK as scratch space.
+   Returns the size of the compressed data, or 0 if it would not
+   fit in DST_SIZE bytes. */
+size_t
+lz_compress (const void *src_, size_t src_size, void *dst_,
+		size_t dst_size, void *work) {
+	const uint8_t *src = src_;
+	const uint8_t *end = src + src_size;
+	const uint8_t *ip = src;
+	const uint8_t *anchor = src;
+	uint8_t *dst = dst_;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dst_size;
+	uint16_t *table = work;
+
+	ASSERT (src_size <= LZ_MAX_INPUT);
+
+	/* Position 0 is as good as empty: it never precedes IP when it
+	   is looked up for IP, and matches are checked anyhow. */
+	memset (table, 0, LZ_WORK_SIZE);
+
+	while (end - ip >= MIN_MATCH) {
+		uint32_t seq = read32 (ip);
+		size_t h = hash_seq (seq);
+		const uint8_t *ref = src + table[h];
+
+		table[h] = ip - src;
+		if (ref < ip && ip - ref <= MAX_OFFSET && read32 (ref) == seq) {
+			size_t len = MIN_MATCH;
+
+			while (ip + len < end && ref[len] == ip[len])
+				len++;
+			op = put_sequence (op, oend, anchor, ip - anchor, ip - ref, len);
+			if (op == NULL)
+				return 0;
+			ip += len;
+			anchor = ip;
+		} else
+			ip++;
+	}
+
+	op = put_sequence (op, oend, anchor, end - anchor, 0, 0);
+	return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Decompresses the SRC_SIZE bytes of compressed data at SRC into
+   the DST_SIZE bytes at DST.  Returns the size of the
+   decompressed data, or LZ_ERROR if SRC is not valid compressed
+   data or would decompress to more than DST_SIZE bytes. */
+size_t
+lz_decompress (const void *src_, size_t src_size, void *dst_,
+		size_t dst_size) {
+	const uint8_t *ip = src_;
+	const uint8_t *iend = ip + src_size;
+	uint8_t *dst = dst_;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + dst_size;
+
+	while (ip < iend) {
+		unsigned token = *ip++;
+		size_t len = token >> 4;
+		size_t offset;
+		const uint8_t *ref;
+
+		if (len == 15 && !get_length (&ip, iend, &len))
+			return LZ_ERROR;
+		if (len > (size_t) (iend - ip) || len > (size_t) (oend - op))
+			return LZ_ERROR;
+		memcpy (op, ip, len);
+		ip += len;
+		op += len;
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return LZ_ERROR;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > (size_t) (op - dst))
+			return LZ_ERROR;
+
+		len = token & 15;
+		if (len == 15 && !get_length (&ip, iend, &len))
+			return LZ_ERROR;
+		len += MIN_MATCH;
+		if (len > (size_t) (oend - op))
+			return LZ_ERROR;
+		for (ref = op - offset; len > 0; len--)
+			*op++ = *ref++;
+	}
+	return op - dst;
+}
+
+/* Appends to the output at OP, which ends at OEND, a sequence of
+   the LIT_LEN literals at LIT followed by a match of MATCH_LEN
+   bytes OFFSET back, or no match if MATCH_LEN is 0.  Returns the
+   new end of the output, or a null pointer if it does not fit. */
+static uint8_t *
+put_sequence (uint8_t *op, uint8_t *oend, const uint8_t *lit,
+		size_t lit_len, size_t offset, size_t match_len) {
+	size_t ml = match_len > 0 ? match_len - MIN_MATCH : 0;
+
+	if (op >= oend)
+		return NULL;
+	*op++ = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+	if (lit_len >= 15 && (op = put_length (op, oend, lit_len)) == NULL)
+		return NULL;
+	if ((size_t) (oend - op) < lit_len)
+		return NULL;
+	memcpy (op, lit, lit_len);
+	op += lit_len;
+	if (match_len == 0)
+		return op;
+
+	if (oend - op < 2)
+		return NULL;
+	*op++ = offset;
+	*op++ = offset >> 8;
+	if (ml >= 15 && (op = put_length (op, oend, ml)) == NULL)
+		return NULL;
+	return op;
+}
+
+/* Appends the continuation bytes of LEN, which is at least 15, to
+   the output at OP, which ends at OEND.  Returns the new end of
+   the output, or a null pointer if they do not fit. */
+static uint8_t *
+put_length (uint8_t *op, uint8_t *oend, size_t len) {
+	for (len -= 15; len >= 255; len -= 255) {
+		if (op >= oend)
+			return NULL;
+		*op++ = 255;
+	}
+	if (op >= oend)
+		return NULL;
+	*op++ = len;
+	return op;
+}
+
+/* Adds the continuation bytes at *IP, which ends at IEND, to
+   *LEN, and advances *IP past them.  Returns false if they run
+   past IEND. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *iend, size_t *len) {
+	unsigned b;
+
+	do {
+		if (*ip >= iend)
+			return false;
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return true;
+}
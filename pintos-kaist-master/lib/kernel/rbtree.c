@@ -0,0 +1,335 @@
+#include "rbtree.h"
+#include "../debug.h"
+
+/* Red-black tree.
+
+   See rbtree.h for basic information.
+
+   Every element is either red or black, and the tree maintains
+   two invariants: a red element has no red child, and every
+   path from the root down to a missing child passes through the
+   same number of black elements.  Together they keep the
+   longest path at most twice as long as the shortest, so the
+   height is O(log n).  Missing children count as black. */
+
+static void rotate_left (struct rb_tree *, struct rb_elem *);
+static void rotate_right (struct rb_tree *, struct rb_elem *);
+static void replace_child (struct rb_tree *, struct rb_elem *parent,
+		struct rb_elem *old, struct rb_elem *new);
+static void insert_fixup (struct rb_tree *, struct rb_elem *);
+static void remove_fixup (struct rb_tree *, struct rb_elem *,
+		struct rb_elem *parent);
+
+/* Returns true if E is red.  A null E is black. */
+static inline bool
+is_red (const struct rb_elem *e) {
+	return e != NULL && e->red;
+}
+
+/* Initializes TREE as an empty tree ordered by LESS, given
+   auxiliary data AUX. */
+void
+rb_init (struct rb_tree *tree, rb_less_func *less, void *aux) {
+	ASSERT (tree != NULL);
+	ASSERT (less != NULL);
+
+	tree->root = NULL;
+	tree->min = NULL;
+	tree->size = 0;
+	tree->less = less;
+	tree->aux = aux;
+}
+
+/* Inserts ELEM into TREE, after any elements equal to it. */
+void
+rb_insert (struct rb_tree *tree, struct rb_elem *elem) {
+	struct rb_elem *parent = NULL;
+	struct rb_elem **link = &tree->root;
+	bool leftmost = true;
+
+	ASSERT (tree != NULL);
+	ASSERT (elem != NULL);
+
+	while (*link != NULL) {
+		parent = *link;
+		if (tree->less (elem, parent, tree->aux))
+			link = &parent->left;
+		else {
+			link = &parent->right;
+			leftmost = false;
+		}
+	}
+
+	elem->parent = parent;
+	elem->left = elem->right = NULL;
+	elem->red = true;
+	*link = elem;
+	if (leftmost)
+		tree->min = elem;
+	tree->size++;
+
+	insert_fixup (tree, elem);
+}
+
+/* Removes ELEM, which must be in TREE. */
+void
+rb_remove (struct rb_tree *tree, struct rb_elem *elem) {
+	struct rb_elem *child, *parent;
+	bool removed_red;
+
+	ASSERT (tree != NULL);
+	ASSERT (tree->size > 0);
+	ASSERT (elem != NULL);
+
+	if (tree->min == elem)
+		tree->min = rb_next (elem);
+
+	if (elem->left == NULL || elem->right == NULL) {
+		/* At most one child: splice ELEM out. */
+		child = elem->left != NULL ? elem->left : elem->right;
+		parent = elem->parent;
+		removed_red = elem->red;
+		if (child != NULL)
+			child->parent = parent;
+		replace_child (tree, parent, elem, child);
+	} else {
+		/* Two children: move ELEM's successor, which has no left
+		   child, into ELEM's place. */
+		struct rb_elem *succ = elem->right;
+		while (succ->left != NULL)
+			succ = succ->left;
+
+		child = succ->right;
+		removed_red = succ->red;
+		if (succ->parent == elem)
+			parent = succ;
+		else {
+			parent = succ->parent;
+			if (child != NULL)
+				child->parent = parent;
+			parent->left = child;
+			succ->right = elem->right;
+			succ->right->parent = succ;
+		}
+		succ->left = elem->left;
+		succ->left->parent = succ;
+		succ->parent = elem->parent;
+		succ->red = elem->red;
+		replace_child (tree, elem->parent, elem, succ);
+	}
+	tree->size--;
+
+	/* Removing a black element shortened the paths through
+	   CHILD by one black element. */
+	if (!removed_red)
+		remove_fixup (tree, child, parent);
+}
+
+/* Returns the least element in TREE, or a null pointer if TREE
+   is empty.  Among equal elements, returns the one inserted
+   first. */
+struct rb_elem *
+rb_min (const struct rb_tree *tree) {
+	return tree->min;
+}
+
+/* Returns the greatest element in TREE that is not greater than
+   KEY, or a null pointer if every element is greater than KEY.
+   Among equal elements, returns the one inserted last.  KEY
+   need not be in TREE. */
+struct rb_elem *
+rb_floor (const struct rb_tree *tree, const struct rb_elem *key) {
+	struct rb_elem *e = tree->root;
+	struct rb_elem *floor = NULL;
+
+	ASSERT (key != NULL);
+
+	while (e != NULL)
+		if (tree->less (key, e, tree->aux))
+			e = e->left;
+		else {
+			floor = e;
+			e = e->right;
+		}
+	return floor;
+}
+
+/* Returns the element following ELEM in its tree, or a null
+   pointer if ELEM is the greatest. */
+struct rb_elem *
+rb_next (struct rb_elem *elem) {
+	ASSERT (elem != NULL);
+
+	if (elem->right != NULL) {
+		elem = elem->right;
+		while (elem->left != NULL)
+			elem = elem->left;
+		return elem;
+	}
+	while (elem->parent != NULL && elem == elem->parent->right)
+		elem = elem->parent;
+	return elem->parent;
+}
+
+/* Returns the number of elements in TREE. */
+size_t
+rb_size (const struct rb_tree *tree) {
+	return tree->size;
+}
+
+/* Returns true if TREE is empty, false otherwise. */
+bool
+rb_empty (const struct rb_tree *tree) {
+	return tree->root == NULL;
+}
+
+/* Makes NEW take the place of OLD as PARENT's child, or as the
+   root of TREE if PARENT is null. */
+static void
+replace_child (struct rb_tree *tree, struct rb_elem *parent,
+		struct rb_elem *old, struct rb_elem *new) {
+	if (parent == NULL)
+		tree->root = new;
+	else if (parent->left == old)
+		parent->left = new;
+	else
+		parent->right = new;
+}
+
+/* Rotates the subtree rooted at X to the left, so that X's right
+   child takes its place and X becomes that child's left child. */
+static void
+rotate_left (struct rb_tree *tree, struct rb_elem *x) {
+	struct rb_elem *y = x->right;
+
+	x->right = y->left;
+	if (y->left != NULL)
+		y->left->parent = x;
+	y->parent = x->parent;
+	replace_child (tree, x->parent, x, y);
+	y->left = x;
+	x->parent = y;
+}
+
+/* Rotates the subtree rooted at X to the right, the mirror image
+   of rotate_left(). */
+static void
+rotate_right (struct rb_tree *tree, struct rb_elem *x) {
+	struct rb_elem *y = x->left;
+
+	x->left = y->right;
+	if (y->right != NULL)
+		y->right->parent = x;
+	y->parent = x->parent;
+	replace_child (tree, x->parent, x, y);
+	y->right = x;
+	x->parent = y;
+}
+
+/* Restores the invariants after inserting red element E, which
+   may have a red parent. */
+static void
+insert_fixup (struct rb_tree *tree, struct rb_elem *e) {
+	while (is_red (e->parent)) {
+		struct rb_elem *parent = e->parent;
+		struct rb_elem *grandparent = parent->parent;
+
+		if (parent == grandparent->left) {
+			struct rb_elem *uncle = grandparent->right;
+			if (is_red (uncle)) {
+				/* Push the grandparent's blackness down. */
+				parent->red = uncle->red = false;
+				grandparent->red = true;
+				e = grandparent;
+			} else {
+				if (e == parent->right) {
+					rotate_left (tree, parent);
+					e = parent;
+					parent = e->parent;
+				}
+				parent->red = false;
+				grandparent->red = true;
+				rotate_right (tree, grandparent);
+			}
+		} else {
+			struct rb_elem *uncle = grandparent->left;
+			if (is_red (uncle)) {
+				parent->red = uncle->red = false;
+				grandparent->red = true;
+				e = grandparent;
+			} else {
+				if (e == parent->left) {
+					rotate_right (tree, parent);
+					e = parent;
+					parent = e->parent;
+				}
+				parent->red = false;
+				grandparent->red = true;
+				rotate_left (tree, grandparent);
+			}
+		}
+	}
+	tree->root->red = false;
+}
+
+/* Restores the invariants after a removal left the paths through
+   E, a possibly null child of PARENT, one black element short. */
+static void
+remove_fixup (struct rb_tree *tree, struct rb_elem *e,
+		struct rb_elem *parent) {
+	while (e != tree->root && !is_red (e)) {
+		if (e == parent->left) {
+			struct rb_elem *sibling = parent->right;
+			if (is_red (sibling)) {
+				sibling->red = false;
+				parent->red = true;
+				rotate_left (tree, parent);
+				sibling = parent->right;
+			}
+			if (!is_red (sibling->left) && !is_red (sibling->right)) {
+				sibling->red = true;
+				e = parent;
+				parent = e->parent;
+			} else {
+				if (!is_red (sibling->right)) {
+					sibling->left->red = false;
+					sibling->red = true;
+					rotate_right (tree, sibling);
+					sibling = parent->right;
+				}
+				sibling->red = parent->red;
+				parent->red = false;
+				sibling->right->red = false;
+				rotate_left (tree, parent);
+				e = tree->root;
+			}
+		} else {
+			struct rb_elem *sibling = parent->left;
+			if (is_red (sibling)) {
+				sibling->red = false;
+				parent->red = true;
+				rotate_right (tree, parent);
+				sibling = parent->left;
+			}
+			if (!is_red (sibling->left) && !is_red (sibling->right)) {
+				sibling->red = true;
+				e = parent;
+				parent = e->parent;
+			} else {
+				if (!is_red (sibling->left)) {
+					sibling->right->red = false;
+					sibling->red = true;
+					rotate_left (tree, sibling);
+					sibling = parent->left;
+				}
+				sibling->red = parent->red;
+				parent->red = false;
+				sibling->left->red = false;
+				rotate_right (tree, parent);
+				e = tree->root;
+			}
+		}
+	}
+	if (e != NULL)
+		e->red = false;
+}
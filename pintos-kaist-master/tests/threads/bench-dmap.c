@@ -0,0 +1,95 @@
+/* Measures how fast the kernel can get at all of the user pool
+   through the direct map, which is sensitive to how many TLB
+   entries the direct map needs.
+
+   Takes every page in the user pool and links them into a chain
+   in random order through their first words.  Then times
+   following the chain, a load from each page that depends on
+   the one before, and copying each page in the chain over the
+   next. */
+
+#include <random.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+static void *make_chain (size_t *page_cnt);
+
+void
+test_bench_dmap (void) 
+{
+  void *chain, *page, *next;
+  size_t page_cnt;
+  uint64_t start, chase_cycles, copy_cycles;
+
+  random_init (0);
+  chain = make_chain (&page_cnt);
+  if (page_cnt < 2)
+    fail ("only %zu pages in user pool", page_cnt);
+
+  start = rdtsc ();
+  for (page = chain; page != NULL; page = *(void *volatile *) page)
+    continue;
+  chase_cycles = rdtsc () - start;
+
+  /* Copy all but the first word, which holds the link. */
+  start = rdtsc ();
+  for (page = chain; (next = *(void **) page) != NULL; page = next)
+    memcpy ((void **) next + 1, (void **) page + 1,
+            PGSIZE - sizeof (void *));
+  copy_cycles = rdtsc () - start;
+
+  for (page = chain; page != NULL; page = next) 
+    {
+      next = *(void **) page;
+      palloc_free_page (page);
+    }
+
+  msg ("%zu pages: %llu cycles per page to chase, %llu to copy",
+       page_cnt, chase_cycles / page_cnt, copy_cycles / (page_cnt - 1));
+}
+
+/* Takes every page in the user pool, links them in random order
+   through their first words, stores the number of pages in
+   *PAGE_CNT, and returns the first. */
+static void *
+make_chain (size_t *page_cnt) 
+{
+  void **pages;
+  void *list = NULL, *page;
+  size_t cnt = 0, array_pages, i;
+
+  while ((page = palloc_get_page (PAL_USER)) != NULL) 
+    {
+      *(void **) page = list;
+      list = page;
+      cnt++;
+    }
+  *page_cnt = cnt;
+  if (cnt == 0)
+    return NULL;
+
+  array_pages = DIV_ROUND_UP (cnt * sizeof *pages, PGSIZE);
+  pages = palloc_get_multiple (PAL_ASSERT, array_pages);
+  for (i = 0, page = list; page != NULL; page = *(void **) page)
+    pages[i++] = page;
+
+  /* Shuffle, then link in the new order. */
+  for (i = cnt - 1; i > 0; i--) 
+    {
+      size_t j = random_ulong () % (i + 1);
+      void *t = pages[i];
+      pages[i] = pages[j];
+      pages[j] = t;
+    }
+  for (i = 0; i < cnt; i++)
+    *(void **) pages[i] = i + 1 < cnt ? pages[i + 1] : NULL;
+
+  list = pages[0];
+  palloc_free_multiple (pages, array_pages);
+  return list;
+}
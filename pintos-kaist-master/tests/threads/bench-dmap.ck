@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+fail "Expected a measurement.\n"
+  if !grep (/^\(bench-dmap\) \d+ pages: \d+ cycles per page to chase, \d+ to copy$/,
+            @output);
+
+pass;
@@ -0,0 +1,65 @@
+/* Measures what lazy FPU switching saves on a context switch.
+
+   Two "pinger" threads, neither of which uses the FPU, yield
+   back and forth to each other ITER_CNT times each, which gives
+   the cost of a switch as the scheduler now does it: the FPU is
+   left alone and CR0.TS is set.  Then, between
+   kernel_fpu_begin() and kernel_fpu_end(), a single FXSAVE and
+   FXRSTOR pair is timed over ITER_CNT rounds.  That pair is what
+   every switch would pay on top if the FPU were saved and
+   restored eagerly, as the integer registers are. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/fpu.h"
+#include "threads/init.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+#define ITER_CNT 1000
+
+static thread_func pinger_thread;
+
+void
+test_bench_fpu (void) 
+{
+  static uint8_t area[512] __attribute__ ((aligned (16)));
+  uint64_t start, switch_cycles, fpu_cycles;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* The pingers outrank us, so we get the CPU back only once
+     both of them have finished. */
+  thread_set_priority (PRI_MAX);
+  thread_create ("pinger 0", PRI_DEFAULT + 1, pinger_thread, NULL);
+  thread_create ("pinger 1", PRI_DEFAULT + 1, pinger_thread, NULL);
+  start = rdtsc ();
+  thread_set_priority (PRI_DEFAULT);
+  thread_yield ();
+  switch_cycles = (rdtsc () - start) / (2 * ITER_CNT);
+
+  kernel_fpu_begin ();
+  start = rdtsc ();
+  for (i = 0; i < ITER_CNT; i++)
+    asm volatile ("fxsave64 %0; fxrstor64 %0" : "+m" (area));
+  fpu_cycles = (rdtsc () - start) / ITER_CNT;
+  kernel_fpu_end ();
+
+  msg ("lazy switch: %llu cycles", switch_cycles);
+  msg ("FXSAVE+FXRSTOR: %llu cycles", fpu_cycles);
+  msg ("eager switch: %llu cycles (%llu%% more)",
+       switch_cycles + fpu_cycles,
+       switch_cycles > 0 ? fpu_cycles * 100 / switch_cycles : 0);
+}
+
+static void
+pinger_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    thread_yield ();
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+fail "missing cycle counts\n"
+  if grep (/^\(bench-fpu\) (lazy switch|FXSAVE\+FXRSTOR|eager switch): \d+ cycles/, @output) != 3;
+
+pass;
@@ -0,0 +1,135 @@
+/* Measures how long palloc_get_page() and palloc_get_multiple()
+   take as the user pool fills up and fragments.
+
+   For each occupancy, takes every page in the user pool, one at
+   a time, then gives back a random selection of them until only
+   the given fraction remains allocated, which leaves the free
+   pages scattered across the pool.  It then times ITER_CNT
+   allocations each of 1 page and of RUN_PAGES pages, freeing each
+   right away so that the occupancy stays the same.  Requests
+   that cannot be satisfied, because no free run is long enough,
+   are counted rather than timed. */
+
+#include <random.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "intrinsic.h"
+
+#define ITER_CNT 1000
+#define RUN_PAGES 8
+
+static size_t fill (void **list);
+static size_t thin (void **list, size_t page_cnt, int percent);
+static void drain (void *list);
+static void measure (int percent, size_t page_cnt);
+
+void
+test_bench_palloc (void) 
+{
+  static const int percents[] = {10, 50, 95};
+  size_t i;
+
+  random_init (0);
+  for (i = 0; i < sizeof percents / sizeof *percents; i++) 
+    {
+      measure (percents[i], 1);
+      measure (percents[i], RUN_PAGES);
+    }
+}
+
+/* Times ITER_CNT allocations of PAGE_CNT pages with PERCENT of
+   the user pool allocated. */
+static void
+measure (int percent, size_t page_cnt) 
+{
+  void *list;
+  size_t total, held, fail_cnt = 0;
+  uint64_t cycles = 0;
+  int i;
+
+  total = fill (&list);
+  held = thin (&list, total, percent);
+
+  for (i = 0; i < ITER_CNT; i++) 
+    {
+      uint64_t start = rdtsc ();
+      void *pages = palloc_get_multiple (PAL_USER, page_cnt);
+      uint64_t end = rdtsc ();
+
+      if (pages == NULL)
+        fail_cnt++;
+      else 
+        {
+          cycles += end - start;
+          palloc_free_multiple (pages, page_cnt);
+        }
+    }
+  drain (list);
+
+  msg ("%d%% occupancy (%zu of %zu pages), %zu-page runs: "
+       "%llu cycles per allocation, %zu failed",
+       percent, held, total, page_cnt,
+       fail_cnt < ITER_CNT ? cycles / (ITER_CNT - fail_cnt) : 0,
+       fail_cnt);
+}
+
+/* Allocates every page in the user pool, chaining each page to
+   the next through its first word, stores the head of the chain
+   in *LIST, and returns the number of pages. */
+static size_t
+fill (void **list) 
+{
+  size_t cnt = 0;
+  void *page;
+
+  *list = NULL;
+  while ((page = palloc_get_page (PAL_USER)) != NULL) 
+    {
+      *(void **) page = *list;
+      *list = page;
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Frees a random selection of the PAGE_CNT pages chained from
+   *LIST, keeping about PERCENT percent of them, and returns the
+   number kept. */
+static size_t
+thin (void **list, size_t page_cnt, int percent) 
+{
+  size_t keep = page_cnt * percent / 100;
+  void *kept = NULL;
+  void *page, *next;
+
+  for (page = *list; page != NULL; page = next, page_cnt--) 
+    {
+      next = *(void **) page;
+      if (random_ulong () % page_cnt < keep) 
+        {
+          *(void **) page = kept;
+          kept = page;
+          keep--;
+        }
+      else
+        palloc_free_page (page);
+    }
+  *list = kept;
+
+  for (page_cnt = 0; kept != NULL; kept = *(void **) kept)
+    page_cnt++;
+  return page_cnt;
+}
+
+/* Frees all the pages chained from LIST. */
+static void
+drain (void *list) 
+{
+  while (list != NULL) 
+    {
+      void *next = *(void **) list;
+      palloc_free_page (list);
+      list = next;
+    }
+}
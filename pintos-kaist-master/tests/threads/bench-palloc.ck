@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@runs) = grep (/^\(bench-palloc\) \d+% occupancy \(\d+ of \d+ pages\), \d+-page runs: \d+ cycles per allocation, \d+ failed$/,
+                   @output);
+fail "Expected 6 measurements but found " . scalar (@runs) . ".\n"
+  if @runs != 6;
+
+pass;
@@ -0,0 +1,81 @@
+/* Measures the cost of a semaphore ping-pong between two
+   threads, first with the fast switch path and then with every
+   switch going through a full intr_frame and iretq, as with
+   -iret-switch.
+
+   Each round trip takes two thread switches: the main thread
+   ups "ping" and blocks on "pong", and the other thread, which
+   was blocked on "ping", ups "pong" and blocks on "ping" again.
+   Run with a single CPU, or the two threads may not switch at
+   all. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+#define ITER_CNT 10000
+
+struct pingpong 
+  {
+    struct semaphore ping;
+    struct semaphore pong;
+  };
+
+static thread_func pong_thread;
+static uint64_t measure (struct pingpong *);
+
+void
+test_bench_pingpong (void) 
+{
+  struct pingpong pp;
+  bool saved = thread_iret_switch;
+  uint64_t fast, iret;
+
+  sema_init (&pp.ping, 0);
+  sema_init (&pp.pong, 0);
+  thread_create ("pong", PRI_DEFAULT, pong_thread, &pp);
+
+  thread_iret_switch = false;
+  fast = measure (&pp);
+  thread_iret_switch = true;
+  iret = measure (&pp);
+  thread_iret_switch = saved;
+
+  /* Let the other thread exit. */
+  sema_up (&pp.ping);
+  sema_down (&pp.pong);
+
+  msg ("fast switch: %llu cycles per switch", fast / (2 * ITER_CNT));
+  msg ("iret switch: %llu cycles per switch", iret / (2 * ITER_CNT));
+}
+
+/* Runs ITER_CNT round trips and returns the cycles taken. */
+static uint64_t
+measure (struct pingpong *pp) 
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++) 
+    {
+      sema_up (&pp->ping);
+      sema_down (&pp->pong);
+    }
+  return rdtsc () - start;
+}
+
+static void
+pong_thread (void *pp_) 
+{
+  struct pingpong *pp = pp_;
+  int i;
+
+  for (i = 0; i < 2 * ITER_CNT + 1; i++) 
+    {
+      sema_down (&pp->ping);
+      sema_up (&pp->pong);
+    }
+}
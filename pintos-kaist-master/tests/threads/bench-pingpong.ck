@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@paths) = grep (/^\(bench-pingpong\) (fast|iret) switch: \d+ cycles per switch$/,
+                    @output);
+fail "Expected 2 switch paths but found " . scalar (@paths) . ".\n"
+  if @paths != 2;
+
+pass;
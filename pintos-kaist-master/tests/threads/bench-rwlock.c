@@ -0,0 +1,110 @@
+/* Measures how well readers of a shared table scale with a lock
+   and with a readers-writer lock held for reading.
+
+   One thread, and then one thread per CPU, each look through the
+   table ITER_CNT times, each time under the lock.  With a lock,
+   the lookups are serialized, so the time per lookup should stay
+   about the same as threads are added.  With a readers-writer
+   lock, the lookups run in parallel, so it should go down about
+   in proportion to the number of CPUs.  Run with several CPUs,
+   e.g. with "--smp 4", or the two will do about the same. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+#define ITER_CNT 2000
+#define TABLE_SIZE 512
+
+static thread_func lock_reader;
+static thread_func rwlock_reader;
+static uint64_t measure (thread_func *, int thread_cnt);
+static int look_up (int key);
+
+static struct lock lock;
+static struct rwlock rwlock;
+static struct semaphore done;
+static int table[TABLE_SIZE];
+
+void
+test_bench_rwlock (void) 
+{
+  int i;
+
+  for (i = 0; i < TABLE_SIZE; i++)
+    table[i] = i;
+  lock_init (&lock);
+  rw_init (&rwlock, RWLOCK_FAIR);
+  sema_init (&done, 0);
+
+  msg ("lock, 1 thread: %llu cycles per lookup",
+       measure (lock_reader, 1));
+  msg ("lock, %d threads: %llu cycles per lookup",
+       cpu_cnt, measure (lock_reader, cpu_cnt));
+  msg ("rwlock, 1 thread: %llu cycles per lookup",
+       measure (rwlock_reader, 1));
+  msg ("rwlock, %d threads: %llu cycles per lookup",
+       cpu_cnt, measure (rwlock_reader, cpu_cnt));
+}
+
+/* Runs THREAD_CNT threads running READER and returns the cycles
+   taken per lookup, over all the threads. */
+static uint64_t
+measure (thread_func *reader, int thread_cnt) 
+{
+  uint64_t start = rdtsc ();
+  int i;
+
+  for (i = 0; i < thread_cnt; i++)
+    thread_create ("reader", PRI_DEFAULT, reader, NULL);
+  for (i = 0; i < thread_cnt; i++)
+    sema_down (&done);
+  return (rdtsc () - start) / ((uint64_t) thread_cnt * ITER_CNT);
+}
+
+static void
+lock_reader (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++) 
+    {
+      lock_acquire (&lock);
+      if (look_up (i % TABLE_SIZE) != i % TABLE_SIZE)
+        fail ("lookup of %d failed", i % TABLE_SIZE);
+      lock_release (&lock);
+    }
+  sema_up (&done);
+}
+
+static void
+rwlock_reader (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++) 
+    {
+      rw_read_acquire (&rwlock);
+      if (look_up (i % TABLE_SIZE) != i % TABLE_SIZE)
+        fail ("lookup of %d failed", i % TABLE_SIZE);
+      rw_read_release (&rwlock);
+    }
+  sema_up (&done);
+}
+
+/* Returns the index of KEY in the table, searching linearly, or
+   -1 if it is not there. */
+static int
+look_up (int key) 
+{
+  volatile int *t = table;
+  int i;
+
+  for (i = 0; i < TABLE_SIZE; i++)
+    if (t[i] == key)
+      return i;
+  return -1;
+}
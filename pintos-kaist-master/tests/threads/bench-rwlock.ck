@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@runs) = grep (/^\(bench-rwlock\) (rw)?lock, \d+ threads?: \d+ cycles per lookup$/,
+                   @output);
+fail "Expected 4 runs but found " . scalar (@runs) . ".\n"
+  if @runs != 4;
+
+pass;
@@ -0,0 +1,89 @@
+/* Measures the cost of a voluntary context switch as the number
+   of runnable threads grows.
+
+   For each load level N, creates N - 2 "filler" threads at
+   priorities below the main thread, so that they stay runnable
+   but never get to run, and then two "pinger" threads above it
+   that yield back and forth to each other ITER_CNT times each.
+   Every yield has to pick the next thread out of a run queue
+   holding all N threads, so a scheduler whose pick-next cost
+   depends on the number of ready threads shows up as a rising
+   cycles-per-switch figure. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+#define ITER_CNT 1000
+
+/* Numbers of runnable threads to measure with. */
+static const int load_levels[] = {2, 16, 64, 256};
+
+static thread_func filler_thread;
+static thread_func pinger_thread;
+
+void
+test_bench_switch (void) 
+{
+  struct semaphore fillers_done;
+  size_t i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&fillers_done, 0);
+  for (i = 0; i < sizeof load_levels / sizeof *load_levels; i++) 
+    {
+      int filler_cnt = load_levels[i] - 2;
+      uint64_t start, cycles;
+      int j;
+
+      /* Keep everything we create from running until it is all
+         in place. */
+      thread_set_priority (PRI_MAX);
+
+      for (j = 0; j < filler_cnt; j++) 
+        {
+          char name[16];
+          snprintf (name, sizeof name, "fill %d", j);
+          thread_create (name, PRI_MIN + 1 + j % (PRI_DEFAULT - PRI_MIN - 1),
+                         filler_thread, &fillers_done);
+        }
+      thread_create ("pinger 0", PRI_DEFAULT + 1, pinger_thread, NULL);
+      thread_create ("pinger 1", PRI_DEFAULT + 1, pinger_thread, NULL);
+
+      /* The pingers outrank us, so we get the CPU back only once
+         both of them have finished. */
+      start = rdtsc ();
+      thread_set_priority (PRI_DEFAULT);
+      thread_yield ();
+      cycles = rdtsc () - start;
+
+      msg ("%3d runnable threads: %llu cycles per switch",
+           load_levels[i], cycles / (2 * ITER_CNT));
+
+      /* Let the fillers run to completion. */
+      for (j = 0; j < filler_cnt; j++)
+        sema_down (&fillers_done);
+    }
+}
+
+static void
+filler_thread (void *fillers_done_) 
+{
+  struct semaphore *fillers_done = fillers_done_;
+
+  sema_up (fillers_done);
+}
+
+static void
+pinger_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++)
+    thread_yield ();
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@levels) = grep (/runnable threads: \d+ cycles per switch$/, @output);
+fail "Expected 4 load levels but found " . scalar (@levels) . ".\n"
+  if @levels != 4;
+
+pass;
@@ -0,0 +1,74 @@
+/* Checks that the completely fair scheduler divides the CPU
+   among CPU-bound threads in proportion to their weights.
+
+   Runs three threads at PRI_DEFAULT, PRI_DEFAULT - 5, and
+   PRI_DEFAULT - 10, which CFS treats as nice 0, 5, and 10, with
+   weights 1024, 335, and 110.  Over 10 seconds they should get
+   about 70%, 23%, and 7% of the 1,000 ticks, respectively.
+
+   Must be run with -cfs on a single CPU. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 3
+
+struct thread_info 
+  {
+    int64_t start_time;
+    int tick_count;
+  };
+
+static thread_func load_thread;
+
+void
+test_cfs_share (void) 
+{
+  struct thread_info info[THREAD_CNT];
+  int64_t start_time;
+  int i;
+
+  ASSERT (thread_cfs);
+
+  start_time = timer_ticks ();
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+
+      info[i].start_time = start_time;
+      info[i].tick_count = 0;
+      snprintf (name, sizeof name, "load %d", i);
+      thread_create (name, PRI_DEFAULT - 5 * i, load_thread, &info[i]);
+    }
+
+  msg ("Sleeping 12 seconds to let threads run, please wait...");
+  timer_sleep (12 * TIMER_FREQ);
+
+  for (i = 0; i < THREAD_CNT; i++)
+    msg ("Thread %d received %d ticks.", i, info[i].tick_count);
+}
+
+/* Waits one second for the others to be created, then spins for
+   10 seconds, counting the timer ticks it sees. */
+static void
+load_thread (void *ti_) 
+{
+  struct thread_info *ti = ti_;
+  int64_t sleep_time = 1 * TIMER_FREQ;
+  int64_t spin_time = sleep_time + 10 * TIMER_FREQ;
+  int64_t last_time = 0;
+
+  timer_sleep (sleep_time - timer_elapsed (ti->start_time));
+  while (timer_elapsed (ti->start_time) < spin_time) 
+    {
+      int64_t cur_time = timer_ticks ();
+      if (cur_time != last_time)
+        ti->tick_count++;
+      last_time = cur_time;
+    }
+}
@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@weights) = (1024, 335, 110);
+my ($weight_sum) = 0;
+$weight_sum += $_ foreach @weights;
+
+my (@ticks);
+foreach (@output) {
+    $ticks[$1] = $2 if /^\(cfs-share\) Thread (\d+) received (\d+) ticks\.$/;
+}
+fail "missing tick counts\n" if grep (!defined, @ticks[0...$#weights]);
+
+my ($tick_sum) = 0;
+$tick_sum += $_ foreach @ticks;
+fail "threads received only $tick_sum ticks in all\n" if $tick_sum < 500;
+
+for my $i (0...$#weights) {
+    my ($expected) = 100 * $weights[$i] / $weight_sum;
+    my ($actual) = 100 * $ticks[$i] / $tick_sum;
+    fail sprintf ("thread %d received %.1f%% of ticks, "
+                  . "expected %.1f%% +/- 5%%\n", $i, $actual, $expected)
+      if abs ($actual - $expected) > 5;
+}
+
+pass;
@@ -0,0 +1,171 @@
+/* Times the copy of an address space that fork() makes, for a
+   parent with nothing resident and for one with 64 MB resident,
+   and compares it with copying those 64 MB.  This is the part of
+   cow-bench-fork that does not need user programs: the parent
+   and child are kernel threads given a page table and a
+   supplemental page table of their own.
+
+   With copy-on-write, the child shares the parent's frames, so
+   the copy for the large parent should cost far less than
+   copying its memory.  The child checks that it maps the same
+   frames as the parent, read-only in both, and sees the
+   parent's data. */
+
+#ifdef VM
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "vm/vm.h"
+#include "intrinsic.h"
+
+#define BUF_SIZE (64 * 1024 * 1024)
+#define PAGE_CNT (BUF_SIZE / PGSIZE)
+
+/* Where the parent maps its buffer. */
+#define BUF ((uint8_t *) 0x10000000)
+
+/* A copy for child_thread() to make. */
+struct copy 
+  {
+    struct thread *parent;
+    bool touched;               /* Is BUF resident? */
+    uint64_t cycles;            /* Set by the child. */
+    struct semaphore done;
+  };
+
+static thread_func parent_thread;
+static thread_func child_thread;
+static void time_copy (const char *desc, bool touched);
+static void become_process (void);
+static void leave_process (void);
+
+void
+test_cow_copy (void) 
+{
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  thread_create ("parent", PRI_DEFAULT, parent_thread, &done);
+  sema_down (&done);
+}
+
+static void
+parent_thread (void *done_) 
+{
+  struct semaphore *done = done_;
+  uint64_t start, cycles;
+  uint8_t *scratch;
+  size_t i;
+
+  become_process ();
+  if (!vm_map_range (BUF, BUF_SIZE, VM_ANON, true, NULL, 0, 0))
+    fail ("vm_map_range failed");
+
+  time_copy ("small parent", false);
+
+  for (i = 0; i < PAGE_CNT; i++)
+    BUF[i * PGSIZE] = i | 1;
+  time_copy ("64 MB parent", true);
+
+  /* The least that copying the frames instead would cost. */
+  scratch = palloc_get_page (0);
+  if (scratch == NULL)
+    fail ("out of memory");
+  start = rdtsc ();
+  for (i = 0; i < PAGE_CNT; i++)
+    memcpy (scratch, pml4_get_page (thread_current ()->pml4,
+                                    BUF + i * PGSIZE), PGSIZE);
+  cycles = rdtsc () - start;
+  palloc_free_page (scratch);
+  msg ("copying 64 MB: %llu kcycles", cycles / 1000);
+
+  leave_process ();
+  sema_up (done);
+}
+
+/* Has a child copy the current thread's address space, and
+   reports how long the copy took, with DESC describing the
+   parent.  TOUCHED says whether BUF is resident. */
+static void
+time_copy (const char *desc, bool touched) 
+{
+  struct copy c;
+
+  c.parent = thread_current ();
+  c.touched = touched;
+  sema_init (&c.done, 0);
+  thread_create ("child", PRI_DEFAULT, child_thread, &c);
+  sema_down (&c.done);
+
+  msg ("copy of %s: %llu kcycles", desc, c.cycles / 1000);
+}
+
+static void
+child_thread (void *c_) 
+{
+  struct copy *c = c_;
+  struct thread *t = thread_current ();
+  uint64_t start;
+  size_t i;
+
+  become_process ();
+  start = rdtsc ();
+  if (!supplemental_page_table_copy (&t->spt, &c->parent->spt))
+    fail ("supplemental_page_table_copy failed");
+  c->cycles = rdtsc () - start;
+
+  for (i = 0; c->touched && i < PAGE_CNT; i++) 
+    {
+      uint8_t *va = BUF + i * PGSIZE;
+      uint64_t *pte = pml4e_walk (t->pml4, (uint64_t) va, 0);
+      uint64_t *parent_pte = pml4e_walk (c->parent->pml4, (uint64_t) va, 0);
+
+      if (pte == NULL || parent_pte == NULL
+          || pte_get_paddr (pte) != pte_get_paddr (parent_pte))
+        fail ("page %zu is not shared with the parent", i);
+      if (is_writable (pte) || is_writable (parent_pte))
+        fail ("shared page %zu is writable", i);
+      if (*va != (uint8_t) (i | 1))
+        fail ("page %zu differs from the parent's", i);
+    }
+
+  leave_process ();
+  sema_up (&c->done);
+}
+
+/* Gives the running thread an empty address space. */
+static void
+become_process (void) 
+{
+  struct thread *t = thread_current ();
+
+  t->pml4 = pml4_create ();
+  if (t->pml4 == NULL)
+    fail ("out of memory");
+  supplemental_page_table_init (&t->spt);
+  process_activate (t);
+}
+
+/* Takes the running thread's address space away again. */
+static void
+leave_process (void) 
+{
+  struct thread *t = thread_current ();
+  uint64_t *pml4 = t->pml4;
+
+  supplemental_page_table_kill (&t->spt);
+
+  /* process_exit() kills it again. */
+  supplemental_page_table_init (&t->spt);
+
+  t->pml4 = NULL;
+  pml4_activate (NULL);
+  pml4_destroy (pml4);
+}
+#endif /* VM */
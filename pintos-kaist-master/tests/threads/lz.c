@@ -0,0 +1,71 @@
+/* Checks that lz_compress() and lz_decompress() give back the
+   page they were given for pages of several kinds, that pages
+   like zeroed buffers and sparse arrays compress well, that
+   random data is reported as not fitting, and that truncated
+   compressed data is rejected. */
+
+#include <lz.h>
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+static void roundtrip (const char *name, const uint8_t *page,
+                       size_t max_size);
+
+static uint8_t work[LZ_WORK_SIZE];
+static uint8_t compressed[PGSIZE * 2];
+static uint8_t output[PGSIZE];
+
+void
+test_lz (void) 
+{
+  uint8_t *page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  size_t size;
+  size_t i;
+
+  roundtrip ("zeroed page", page, 64);
+
+  for (i = 0; i < PGSIZE / sizeof (long); i += 37)
+    ((long *) page)[i] = i * 2654435761u;
+  roundtrip ("sparse array", page, 1024);
+
+  for (i = 0; i < PGSIZE; i++)
+    page[i] = "the quick brown fox jumps over the lazy dog. "[i % 45];
+  roundtrip ("repeated text", page, 256);
+
+  random_init (0);
+  random_bytes (page, PGSIZE);
+  roundtrip ("random page", page, PGSIZE + PGSIZE / 64);
+  if (lz_compress (page, PGSIZE, compressed, PGSIZE / 2, work) != 0)
+    fail ("random page fit in half a page");
+  msg ("random page: does not fit in half a page");
+
+  size = lz_compress (page, PGSIZE, compressed, sizeof compressed, work);
+  if (lz_decompress (compressed, size - 1, output, PGSIZE) == PGSIZE)
+    fail ("truncated data decompressed to a whole page");
+  if (lz_decompress (compressed, size, output, PGSIZE - 1) != LZ_ERROR)
+    fail ("decompression overran its output");
+  msg ("truncated data and short output rejected");
+
+  palloc_free_page (page);
+}
+
+/* Compresses PAGE, checks that it takes no more than MAX_SIZE
+   bytes, and checks that it decompresses to what it was. */
+static void
+roundtrip (const char *name, const uint8_t *page, size_t max_size) 
+{
+  size_t size, out_size;
+
+  size = lz_compress (page, PGSIZE, compressed, sizeof compressed, work);
+  if (size == 0 || size > max_size)
+    fail ("%s: compressed to %zu bytes, expected 1 to %zu",
+          name, size, max_size);
+  out_size = lz_decompress (compressed, size, output, PGSIZE);
+  if (out_size != PGSIZE || memcmp (page, output, PGSIZE))
+    fail ("%s: did not decompress to the original", name);
+  msg ("%s: ok", name);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(lz) begin
+(lz) zeroed page: ok
+(lz) sparse array: ok
+(lz) repeated text: ok
+(lz) random page: ok
+(lz) random page: does not fit in half a page
+(lz) truncated data and short output rejected
+(lz) end
+EOF
+pass;
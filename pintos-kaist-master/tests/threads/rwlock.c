@@ -0,0 +1,83 @@
+/* Checks the order in which a readers-writer lock is handed to
+   waiting readers and writers under each policy.
+
+   The main thread holds the lock for reading while two writers
+   and two readers, all of higher priority, arrive in the order
+   writer 1, reader 1, writer 2, reader 2 and wait.  Once it
+   releases the lock, writer 1 must go first, since it arrived
+   first.  After that, with RWLOCK_FAIR, both readers go as one
+   batch before writer 2, and with RWLOCK_PREFER_WRITERS,
+   writer 2 goes before both readers. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func reader_thread;
+static thread_func writer_thread;
+static void run (enum rwlock_policy);
+
+static struct rwlock rwlock;
+static struct semaphore done;
+
+void
+test_rwlock (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  msg ("Fair policy:");
+  run (RWLOCK_FAIR);
+  msg ("Writer-preferring policy:");
+  run (RWLOCK_PREFER_WRITERS);
+}
+
+static void
+run (enum rwlock_policy policy) 
+{
+  int i;
+
+  rw_init (&rwlock, policy);
+  sema_init (&done, 0);
+
+  rw_read_acquire (&rwlock);
+  if (!rw_try_read_acquire (&rwlock))
+    fail ("rw_try_read_acquire() failed with only readers");
+  rw_read_release (&rwlock);
+  if (rw_try_write_acquire (&rwlock))
+    fail ("rw_try_write_acquire() succeeded with a reader");
+
+  thread_create ("writer 1", PRI_DEFAULT + 1, writer_thread, NULL);
+  if (rw_try_read_acquire (&rwlock))
+    fail ("rw_try_read_acquire() succeeded with a writer waiting");
+  thread_create ("reader 1", PRI_DEFAULT + 1, reader_thread, NULL);
+  thread_create ("writer 2", PRI_DEFAULT + 1, writer_thread, NULL);
+  thread_create ("reader 2", PRI_DEFAULT + 1, reader_thread, NULL);
+  rw_read_release (&rwlock);
+
+  for (i = 0; i < 4; i++)
+    sema_down (&done);
+  if (!rw_try_write_acquire (&rwlock))
+    fail ("rw_try_write_acquire() failed on a free lock");
+  rw_write_release (&rwlock);
+}
+
+static void
+reader_thread (void *aux UNUSED) 
+{
+  rw_read_acquire (&rwlock);
+  msg ("Thread %s reading.", thread_name ());
+  rw_read_release (&rwlock);
+  sema_up (&done);
+}
+
+static void
+writer_thread (void *aux UNUSED) 
+{
+  rw_write_acquire (&rwlock);
+  msg ("Thread %s writing.", thread_name ());
+  rw_write_release (&rwlock);
+  sema_up (&done);
+}
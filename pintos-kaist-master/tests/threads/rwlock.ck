@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock) begin
+(rwlock) Fair policy:
+(rwlock) Thread writer 1 writing.
+(rwlock) Thread reader 1 reading.
+(rwlock) Thread reader 2 reading.
+(rwlock) Thread writer 2 writing.
+(rwlock) Writer-preferring policy:
+(rwlock) Thread writer 1 writing.
+(rwlock) Thread writer 2 writing.
+(rwlock) Thread reader 1 reading.
+(rwlock) Thread reader 2 reading.
+(rwlock) end
+EOF
+pass;
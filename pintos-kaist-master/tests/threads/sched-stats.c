@@ -0,0 +1,93 @@
+/* Checks the scheduler accounting read by thread_sched_stat().
+
+   Sleeping should count as a voluntary switch each time and put
+   each wakeup in the latency histogram.  Spinning next to another
+   thread of the same priority should get the main thread
+   preempted at the end of its time slices, and charged for the
+   time it then spends waiting on the run queue. */
+
+#include <stdio.h>
+#include <syscall-nr.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func spin_thread;
+static long long count_wakeups (void);
+static void spin (int64_t ticks);
+
+static volatile bool done;
+
+void
+test_sched_stats (void) 
+{
+  struct semaphore exited;
+  long long voluntary, involuntary, wakeups, wait, run;
+  int i;
+
+  voluntary = thread_sched_stat (SCHED_STAT_VOLUNTARY);
+  wakeups = count_wakeups ();
+  msg ("Sleeping 10 times.");
+  for (i = 0; i < 10; i++)
+    timer_sleep (1);
+  if (thread_sched_stat (SCHED_STAT_VOLUNTARY) < voluntary + 10)
+    fail ("only %lld voluntary switches for 10 sleeps",
+          thread_sched_stat (SCHED_STAT_VOLUNTARY) - voluntary);
+  if (count_wakeups () < wakeups + 10)
+    fail ("only %lld wakeups recorded for 10 sleeps",
+          count_wakeups () - wakeups);
+  msg ("Voluntary switches and wakeups counted.");
+
+  involuntary = thread_sched_stat (SCHED_STAT_INVOLUNTARY);
+  wait = thread_sched_stat (SCHED_STAT_WAIT_CYCLES);
+  run = thread_sched_stat (SCHED_STAT_RUN_CYCLES);
+  sema_init (&exited, 0);
+  done = false;
+  thread_create ("spinner", PRI_DEFAULT, spin_thread, &exited);
+  msg ("Spinning alongside another thread.");
+  spin (20);
+  done = true;
+  sema_down (&exited);
+  if (thread_sched_stat (SCHED_STAT_INVOLUNTARY) <= involuntary)
+    fail ("no involuntary switches while spinning");
+  if (thread_sched_stat (SCHED_STAT_WAIT_CYCLES) <= wait)
+    fail ("no time spent waiting while spinning");
+  if (thread_sched_stat (SCHED_STAT_RUN_CYCLES) <= run)
+    fail ("no time spent running while spinning");
+  msg ("Involuntary switches and waiting counted.");
+}
+
+/* Spins until the main thread is done, then ups the semaphore
+   EXITED_. */
+static void
+spin_thread (void *exited_) 
+{
+  struct semaphore *exited = exited_;
+
+  while (!done)
+    continue;
+  sema_up (exited);
+}
+
+/* Returns the number of wakeups in the latency histogram. */
+static long long
+count_wakeups (void) 
+{
+  long long cnt = 0;
+  int i;
+
+  for (i = 0; i < SCHED_LATENCY_BUCKETS; i++)
+    cnt += thread_sched_stat (SCHED_STAT_LATENCY + i);
+  return cnt;
+}
+
+/* Busy-waits for TICKS timer ticks. */
+static void
+spin (int64_t ticks) 
+{
+  int64_t start = timer_ticks ();
+
+  while (timer_elapsed (start) < ticks)
+    continue;
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-stats) begin
+(sched-stats) Sleeping 10 times.
+(sched-stats) Voluntary switches and wakeups counted.
+(sched-stats) Spinning alongside another thread.
+(sched-stats) Involuntary switches and waiting counted.
+(sched-stats) end
+EOF
+pass;
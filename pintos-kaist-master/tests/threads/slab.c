@@ -0,0 +1,99 @@
+/* Checks that a kmem_cache aligns its objects, runs its
+   constructor once per object rather than once per allocation,
+   and takes its objects back through free() as well as
+   kmem_cache_free(). */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/slab.h"
+
+#define OBJ_CNT 200
+#define OBJ_MAGIC 0x0b7ec7ed
+
+struct obj 
+  {
+    unsigned magic;
+    char data[36];
+  };
+
+static kmem_ctor construct;
+static void alloc_all (struct kmem_cache *, struct obj **);
+
+static int ctor_cnt;
+
+void
+test_slab (void) 
+{
+  static struct kmem_cache cache;
+  static struct obj *objs[OBJ_CNT];
+  int first_ctor_cnt;
+  int i;
+
+  kmem_cache_init (&cache, "test", sizeof (struct obj), CACHE_LINE_SIZE,
+                   construct);
+
+  alloc_all (&cache, objs);
+  for (i = 0; i < OBJ_CNT; i++)
+    if ((uintptr_t) objs[i] % CACHE_LINE_SIZE != 0)
+      fail ("object %d at %p is not aligned", i, objs[i]);
+  if (ctor_cnt < OBJ_CNT)
+    fail ("constructor ran %d times for %d objects", ctor_cnt, OBJ_CNT);
+  msg ("Allocated %d aligned, constructed objects.", OBJ_CNT);
+
+  /* Give back every other object, half through each interface,
+     so that no slab empties and the objects' memory is reused. */
+  for (i = 0; i < OBJ_CNT; i += 2)
+    if (i % 4)
+      kmem_cache_free (&cache, objs[i]);
+    else
+      free (objs[i]);
+  if (cache.in_use != OBJ_CNT / 2)
+    fail ("%zu objects in use after freeing half", cache.in_use);
+  msg ("Freed half of the objects.");
+
+  first_ctor_cnt = ctor_cnt;
+  for (i = 0; i < OBJ_CNT; i += 2)
+    {
+      objs[i] = kmem_cache_alloc (&cache);
+      if (objs[i] == NULL || objs[i]->magic != OBJ_MAGIC)
+        fail ("reallocated object %d not in constructed state", i);
+    }
+  if (ctor_cnt != first_ctor_cnt)
+    fail ("constructor ran %d more times on reallocation",
+          ctor_cnt - first_ctor_cnt);
+  msg ("Reallocated them without running the constructor.");
+
+  for (i = 0; i < OBJ_CNT; i++)
+    kmem_cache_free (&cache, objs[i]);
+  if (cache.in_use != 0)
+    fail ("%zu objects still in use after freeing all", cache.in_use);
+  msg ("Freed all objects.");
+}
+
+/* Allocates OBJ_CNT objects from CACHE into OBJS and checks that
+   each is in its constructed state. */
+static void
+alloc_all (struct kmem_cache *cache, struct obj **objs) 
+{
+  int i;
+
+  for (i = 0; i < OBJ_CNT; i++) 
+    {
+      objs[i] = kmem_cache_alloc (cache);
+      if (objs[i] == NULL)
+        fail ("out of memory after %d objects", i);
+      if (objs[i]->magic != OBJ_MAGIC)
+        fail ("object %d not constructed", i);
+    }
+}
+
+static void
+construct (void *obj_) 
+{
+  struct obj *obj = obj_;
+
+  obj->magic = OBJ_MAGIC;
+  ctor_cnt++;
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(slab) begin
+(slab) Allocated 200 aligned, constructed objects.
+(slab) Freed half of the objects.
+(slab) Reallocated them without running the constructor.
+(slab) Freed all objects.
+(slab) end
+EOF
+pass;
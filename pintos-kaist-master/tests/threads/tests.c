@@ -38,6 +38,22 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"bench-switch", test_bench_switch},
+    {"bench-fpu", test_bench_fpu},
+    {"bench-pingpong", test_bench_pingpong},
+    {"cfs-share", test_cfs_share},
+    {"sched-stats", test_sched_stats},
+    {"rwlock", test_rwlock},
+    {"bench-rwlock", test_bench_rwlock},
+    {"workqueue", test_workqueue},
+    {"bench-palloc", test_bench_palloc},
+    {"slab", test_slab},
+    {"bench-dmap", test_bench_dmap},
+    {"lz", test_lz},
+#ifdef VM
+    {"swap-cluster", test_swap_cluster},
+    {"cow-copy", test_cow_copy},
+#endif
   };
 
 static const char *test_name;
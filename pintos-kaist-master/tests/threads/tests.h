@@ -32,6 +32,22 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_bench_switch;
+extern test_func test_bench_fpu;
+extern test_func test_bench_pingpong;
+extern test_func test_cfs_share;
+extern test_func test_sched_stats;
+extern test_func test_rwlock;
+extern test_func test_bench_rwlock;
+extern test_func test_workqueue;
+extern test_func test_bench_palloc;
+extern test_func test_slab;
+extern test_func test_bench_dmap;
+extern test_func test_lz;
+#ifdef VM
+extern test_func test_swap_cluster;
+extern test_func test_cow_copy;
+#endif
 
 void msg (const char *, ...);
 void fail (const char *, ...);
@@ -0,0 +1,52 @@
+/* Checks that workers run items from the highest-priority
+   workqueue first, that an item cannot be queued twice, and that
+   flush_work() waits for an item to run.
+
+   Two items each are queued on a low- and a high-priority
+   workqueue with interrupts off, so that no worker can start on
+   them until all four are queued. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+static work_func report;
+
+static struct workqueue low, high;
+static struct work items[4];
+static const char *names[4] = {"low 0", "low 1", "high 0", "high 1"};
+
+void
+test_workqueue (void) 
+{
+  enum intr_level old_level;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  workqueue_init (&low, "test-low", PRI_DEFAULT + 1);
+  workqueue_init (&high, "test-high", PRI_DEFAULT + 2);
+  for (i = 0; i < 4; i++)
+    work_init (&items[i], report, (void *) names[i]);
+
+  old_level = intr_disable ();
+  for (i = 0; i < 4; i++)
+    if (!queue_work (i < 2 ? &low : &high, &items[i]))
+      fail ("queue_work() of %s failed", names[i]);
+  if (queue_work (&low, &items[0]))
+    fail ("pending item queued twice");
+  intr_set_level (old_level);
+
+  flush_work (&items[1]);
+  msg ("Flushed.");
+}
+
+static void
+report (void *name) 
+{
+  msg ("Running %s.", (const char *) name);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) Running high 0.
+(workqueue) Running high 1.
+(workqueue) Running low 0.
+(workqueue) Running low 1.
+(workqueue) Flushed.
+(workqueue) end
+EOF
+pass;
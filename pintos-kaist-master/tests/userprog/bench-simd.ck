@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+fail "checksums differ--SSE state was not preserved\n"
+  if !grep ($_ eq '(bench-simd) checksums match', @output);
+fail "missing cycle counts\n"
+  if grep (/^\(bench-simd\) (scalar|SIMD): \d+ cycles per pass$/, @output) != 2;
+
+pass;
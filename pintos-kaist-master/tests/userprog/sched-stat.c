@@ -0,0 +1,44 @@
+/* Reads the scheduler statistics through get_sched_stat(), the
+   int 0x45 trap, and checks that they are sane: this process's
+   run time grows while it runs, the counters are not negative,
+   the wakeup latency histogram has counted at least this
+   process's own start, and bad selectors return -1. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  long long run, wakeups;
+  volatile int spin;
+  int i;
+
+  run = get_sched_stat (SCHED_STAT_RUN_CYCLES);
+  CHECK (run > 0, "run cycles are positive");
+  for (spin = 0; spin < 1000000; spin++)
+    continue;
+  CHECK (get_sched_stat (SCHED_STAT_RUN_CYCLES) > run,
+         "run cycles grow while running");
+
+  CHECK (get_sched_stat (SCHED_STAT_WAIT_CYCLES) >= 0
+         && get_sched_stat (SCHED_STAT_VOLUNTARY) >= 0
+         && get_sched_stat (SCHED_STAT_INVOLUNTARY) >= 0,
+         "wait cycles and switch counts are not negative");
+
+  wakeups = 0;
+  for (i = 0; i < SCHED_LATENCY_BUCKETS; i++)
+    {
+      long long cnt = get_sched_stat (SCHED_STAT_LATENCY + i);
+      if (cnt < 0)
+        fail ("latency bucket %d holds %lld", i, cnt);
+      wakeups += cnt;
+    }
+  CHECK (wakeups > 0, "latency histogram counts wakeups");
+
+  CHECK (get_sched_stat (-1) == -1
+         && get_sched_stat (SCHED_STAT_LATENCY + SCHED_LATENCY_BUCKETS) == -1,
+         "bad selectors return -1");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-stat) begin
+(sched-stat) run cycles are positive
+(sched-stat) run cycles grow while running
+(sched-stat) wait cycles and switch counts are not negative
+(sched-stat) latency histogram counts wakeups
+(sched-stat) bad selectors return -1
+(sched-stat) end
+sched-stat: exit(0)
+EOF
+pass;
@@ -0,0 +1,74 @@
+/* Forks a process with a 64 MB buffer twice, before and after
+   touching every page of it, and reports how many cycles each
+   fork takes.  With copy-on-write, the child shares the parent's
+   frames instead of copying them, so the second fork should cost
+   little more than the first.  Each child checks the buffer and
+   writes to one page of it, which must not change the parent's. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define BUF_SIZE (64 * 1024 * 1024)
+#define PAGE_CNT (BUF_SIZE / PAGE_SIZE)
+
+static char buf[BUF_SIZE];
+
+static uint64_t
+rdtsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* The byte at the start of page I of BUF, if TOUCHED is true, or
+   else 0. */
+static char
+expected (size_t i, bool touched)
+{
+  return touched ? (char) (i | 1) : 0;
+}
+
+/* Forks, with DESC describing the parent in the message, and
+   waits for the child.  The child checks that page I of BUF
+   starts with expected (I, TOUCHED) and writes to page 0. */
+static void
+time_fork (const char *desc, bool touched)
+{
+  uint64_t start, cycles;
+  pid_t child;
+  size_t i;
+
+  start = rdtsc ();
+  child = fork ("child");
+  if (child == 0)
+    {
+      for (i = 0; i < PAGE_CNT; i++)
+        if (buf[i * PAGE_SIZE] != expected (i, touched))
+          fail ("child: page %zu differs from parent's", i);
+      buf[0] = 'c';
+      exit (0);
+    }
+  cycles = rdtsc () - start;
+
+  msg ("fork of %s: %llu kcycles", desc,
+       (unsigned long long) (cycles / 1000));
+  CHECK (wait (child) == 0, "wait for child");
+  if (buf[0] != expected (0, touched))
+    fail ("child's write to page 0 changed parent's");
+}
+
+void
+test_main (void)
+{
+  size_t i;
+
+  time_fork ("small parent", false);
+
+  for (i = 0; i < PAGE_CNT; i++)
+    buf[i * PAGE_SIZE] = expected (i, true);
+  time_fork ("64 MB parent", true);
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The fork latencies vary from run to run.  Check that they are
+# there, then compare the rest.
+fail "missing fork latency\n"
+  if grep (/^\(cow-bench-fork\) fork of (small|64 MB) parent: \d+ kcycles$/,
+	   @output) != 2;
+@output = grep (!/^\(cow-bench-fork\) fork of /, @output);
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(cow-bench-fork) begin
+(cow-bench-fork) wait for child
+(cow-bench-fork) wait for child
+(cow-bench-fork) end
+EOF
+pass;
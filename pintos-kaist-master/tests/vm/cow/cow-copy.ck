@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The latencies vary from run to run.  Check that they are
+# there, then compare the rest.
+fail "missing copy latency\n"
+  if grep (/^\(cow-copy\) (copy of (small|64 MB) parent|copying 64 MB): \d+ kcycles$/,
+	   @output) != 3;
+@output = grep (!/^\(cow-copy\) copy/, @output);
+
+compare_output ("run", \@output, [<<'EOF']);
+(cow-copy) begin
+(cow-copy) end
+EOF
+pass;
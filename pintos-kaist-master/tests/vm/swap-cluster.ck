@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+fail "slots were not handed out in clusters\n"
+  if !grep ($_ eq '(swap-cluster) clusters are contiguous', @output);
+fail "pages did not read back intact\n"
+  if !grep ($_ eq '(swap-cluster) all pages read back intact', @output);
+fail "missing cycle counts\n"
+  if grep (/^\(swap-cluster\) (write|read): \d+ cycles per page$/, @output) != 2;
+
+# 64 pages go out as 4 runs of 16 adjacent slots, and come back
+# as 8 whole clusters, 7 pages of each from the read-ahead buffer.
+fail "pages were not written in runs\n"
+  if !grep (/^Swap: 64 pages out in 4 writes,/, @output);
+fail "pages were not read back a cluster at a time\n"
+  if !grep (/^Swap: 64 pages in, 56 read ahead, 64 read in 8 reads,/, @output);
+
+pass;
@@ -2,7 +2,20 @@
 use strict;
 use warnings;
 use tests::tests;
-check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+# The throughput lines vary from run to run.  Check that they are
+# there, then compare the rest.
+fail "missing swap throughput\n"
+  if grep (/^\(swap-iter\) (write|check) pass: \d+ cycles per page$/,
+	   @output) != 2;
+@output = grep (!/^\(swap-iter\) (write|check) pass: /, @output);
+
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
 (swap-iter) begin
 (swap-iter) write sparsely over page 0
 (swap-iter) write sparsely over page 512
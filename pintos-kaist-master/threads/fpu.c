@@ -0,0 +1,265 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+/* Lazy FPU context switching.
+
+   The FPU, MMX, and SSE registers (together, "the FPU") are not
+   saved and restored on every context switch, as the integer
+   registers are, because most threads never touch them.
+   Instead, each CPU remembers which thread's state its FPU
+   holds, its "owner", and the scheduler sets CR0.TS when it
+   switches to any other thread.  The first FPU instruction that
+   thread executes then raises #NM (Device Not Available), whose
+   handler saves the owner's state to memory, loads the new
+   thread's, and makes it the owner.  See [IA32-v3a] 13.4
+   "Designing OS Facilities for Saving x87 FPU, SSE, and
+   Extended States on Task or Context Switches".
+
+   A thread's state is kept in memory, in the FXSAVE format, in a
+   buffer allocated on its first FPU instruction.
+
+   On SMP, a thread may next run on a different CPU, which cannot
+   get at the registers of this one, so a thread gives up
+   ownership, saving its state, whenever it is switched out.
+   Restoring stays lazy.
+
+   The kernel itself is compiled without FPU instructions.  Code
+   that wants them anyway, e.g. for SIMD, must put them between
+   kernel_fpu_begin() and kernel_fpu_end(). */
+
+/* CR0 and CR4 bits.  See [IA32-v3a] 2.5 "Control Registers". */
+#define CR0_MP 0x00000002       /* Monitor coprocessor. */
+#define CR0_EM 0x00000004       /* Emulation. */
+#define CR0_TS 0x00000008       /* Task switched. */
+#define CR4_OSFXSR 0x00000200   /* OS supports FXSAVE and FXRSTOR. */
+#define CR4_OSXMMEXCPT 0x00000400 /* OS handles #XF. */
+
+/* Size and alignment of an FXSAVE area. */
+#define FPU_AREA_SIZE 512
+#define FPU_AREA_ALIGN 16
+
+/* The FPU's initial state, as set by FNINIT with all SSE
+   exceptions masked, in FXSAVE format. */
+static uint8_t fpu_init_area[FPU_AREA_SIZE]
+	__attribute__ ((aligned (FPU_AREA_ALIGN)));
+
+/* Statistics. */
+static long long fpu_trap_cnt;          /* #NM exceptions. */
+static long long fpu_save_cnt;          /* FXSAVEs. */
+static long long fpu_restore_cnt;       /* FXRSTORs. */
+
+static intr_handler_func fpu_trap;
+static void *fpu_area (const struct thread *);
+static bool fpu_alloc (struct thread *);
+static void fpu_flush (struct cpu *);
+
+/* Enables FPU instructions on the BSP and registers the #NM
+   handler. */
+void
+fpu_init (void) {
+	*(uint16_t *) (fpu_init_area + 0) = 0x037f;     /* FCW. */
+	*(uint32_t *) (fpu_init_area + 24) = 0x1f80;    /* MXCSR. */
+
+	fpu_init_ap ();
+	intr_register_int (7, 0, INTR_OFF, fpu_trap,
+			"#NM Device Not Available Exception");
+}
+
+/* Enables FPU and SSE instructions on the running CPU, which
+   does not yet hold any thread's FPU state.  TS is set, so the
+   first FPU instruction traps. */
+void
+fpu_init_ap (void) {
+	lcr4 (rcr4 () | CR4_OSFXSR | CR4_OSXMMEXCPT);
+	lcr0 ((rcr0 () & ~CR0_EM) | CR0_MP | CR0_TS);
+	cpu_current ()->fpu_owner = NULL;
+}
+
+/* Called by the scheduler, with interrupts off, when the running
+   CPU switches from PREV to NEXT. */
+void
+fpu_switch (struct thread *prev, struct thread *next) {
+	struct cpu *c = prev->cpu;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (cpu_cnt > 1 && c->fpu_owner == prev)
+		fpu_flush (c);
+
+	if (c->fpu_owner == next)
+		clts ();
+	else
+		lcr0 (rcr0 () | CR0_TS);
+}
+
+/* Makes sure that T's FPU state, if it has any, is in memory,
+   e.g. so that fpu_copy() can read it.  T must be the running
+   thread or not running at all. */
+void
+fpu_save (struct thread *t) {
+	enum intr_level old_level = intr_disable ();
+	struct cpu *c = cpu_current ();
+
+	if (c->fpu_owner == t) {
+		fpu_flush (c);
+		lcr0 (rcr0 () | CR0_TS);
+	}
+	intr_set_level (old_level);
+}
+
+/* Gives DST a copy of SRC's FPU state, which fpu_save() must
+   have put in memory.  DST must not have run yet.  Returns true
+   if successful, false if out of memory. */
+bool
+fpu_copy (struct thread *dst, struct thread *src) {
+	ASSERT (dst->fpu_buf == NULL);
+
+	if (src->fpu_buf == NULL)
+		return true;
+	if (!fpu_alloc (dst))
+		return false;
+	memcpy (fpu_area (dst), fpu_area (src), FPU_AREA_SIZE);
+	return true;
+}
+
+/* Discards T's FPU state and frees its buffer.  T will get a
+   freshly initialized FPU on its next FPU instruction.  Called
+   when T exits or execs a new program. */
+void
+fpu_release (struct thread *t) {
+	enum intr_level old_level;
+	void *buf;
+	int i;
+
+	old_level = intr_disable ();
+	for (i = 0; i < cpu_cnt; i++)
+		if (cpus[i].fpu_owner == t)
+			cpus[i].fpu_owner = NULL;
+	if (t == thread_current ())
+		lcr0 (rcr0 () | CR0_TS);
+	buf = t->fpu_buf;
+	t->fpu_buf = NULL;
+	intr_set_level (old_level);
+
+	free (buf);
+}
+
+/* Prints FPU statistics. */
+void
+fpu_print_stats (void) {
+	printf ("FPU: %lld traps, %lld saves, %lld restores\n",
+			fpu_trap_cnt, fpu_save_cnt, fpu_restore_cnt);
+}
+
+/* Prepares the running CPU's FPU for use by the kernel: saves
+   whatever thread state it holds, and turns off interrupts until
+   kernel_fpu_end(), so that no other thread can get at the FPU
+   in the meantime.  The FPU starts out in its initial state. */
+void
+kernel_fpu_begin (void) {
+	enum intr_level old_level = intr_disable ();
+	struct cpu *c = cpu_current ();
+
+	ASSERT (!c->fpu_kernel);
+
+	fpu_flush (c);
+	clts ();
+	asm volatile ("fxrstor64 %0" : : "m" (fpu_init_area));
+	c->fpu_kernel = true;
+	c->fpu_kernel_level = old_level;
+}
+
+/* Ends a kernel_fpu_begin() section.  The FPU's contents are
+   lost. */
+void
+kernel_fpu_end (void) {
+	struct cpu *c = cpu_current ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (c->fpu_kernel);
+
+	lcr0 (rcr0 () | CR0_TS);
+	c->fpu_kernel = false;
+	intr_set_level (c->fpu_kernel_level);
+}
+
+/* #NM handler: the running thread executed an FPU instruction
+   with CR0.TS set.  Gives it the FPU. */
+static void
+fpu_trap (struct intr_frame *f) {
+	struct thread *t = thread_current ();
+	struct cpu *c;
+
+	if (f->cs == SEL_KCSEG)
+		PANIC ("FPU instruction in kernel outside kernel_fpu_begin()");
+
+	/* First FPU instruction: set up a buffer with the FPU's
+	   initial state, which may sleep. */
+	if (t->fpu_buf == NULL) {
+		intr_enable ();
+		if (!fpu_alloc (t)) {
+			printf ("%s: out of memory for FPU state\n", thread_name ());
+			thread_exit ();
+		}
+		intr_disable ();
+	}
+
+	c = cpu_current ();
+	fpu_trap_cnt++;
+	clts ();
+	if (c->fpu_owner != t) {
+		fpu_flush (c);
+		asm volatile ("fxrstor64 %0" : : "m" (*(uint8_t (*)[FPU_AREA_SIZE])
+					fpu_area (t)));
+		fpu_restore_cnt++;
+		c->fpu_owner = t;
+	}
+}
+
+/* Returns T's FXSAVE area, within its buffer. */
+static void *
+fpu_area (const struct thread *t) {
+	ASSERT (t->fpu_buf != NULL);
+	return (void *) ROUND_UP ((uintptr_t) t->fpu_buf, FPU_AREA_ALIGN);
+}
+
+/* Allocates T's buffer and fills it with the FPU's initial
+   state.  Returns true if successful, false if out of memory. */
+static bool
+fpu_alloc (struct thread *t) {
+	ASSERT (t->fpu_buf == NULL);
+
+	t->fpu_buf = malloc (FPU_AREA_SIZE + FPU_AREA_ALIGN - 1);
+	if (t->fpu_buf == NULL)
+		return false;
+
+	memcpy (fpu_area (t), fpu_init_area, FPU_AREA_SIZE);
+	return true;
+}
+
+/* Saves the state of C's FPU owner, if any, to memory, so that C
+   no longer has an owner.  C must be the running CPU.  If there
+   was an owner, leaves CR0.TS clear. */
+static void
+fpu_flush (struct cpu *c) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (c == cpu_current ());
+
+	if (c->fpu_owner != NULL) {
+		clts ();
+		asm volatile ("fxsave64 %0" : "=m" (*(uint8_t (*)[FPU_AREA_SIZE])
+					fpu_area (c->fpu_owner)));
+		fpu_save_cnt++;
+		c->fpu_owner = NULL;
+	}
+}
@@ -13,6 +13,8 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/cpu.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
@@ -20,7 +22,10 @@
 #include "threads/mmu.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
@@ -53,6 +58,11 @@ bool thread_tests;
 
 static void bss_init (void);
 static void paging_init (uint64_t mem_end);
+static bool direct_map_fits (uint64_t va, uint64_t mem_end, uint64_t size,
+		uint64_t text_start, uint64_t text_end);
+static void map_large_page (uint64_t *pml4, uint64_t va, uint64_t entry,
+		uint64_t size);
+static uint64_t *next_table (uint64_t *table, unsigned idx);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
@@ -85,7 +95,9 @@ main (void) {
 	/* Initialize memory system. */
 	mem_end = palloc_init ();
 	malloc_init ();
+	kmem_init ();
 	paging_init (mem_end);
+	palloc_init_high ();
 
 #ifdef USERPROG
 	tss_init ();
@@ -94,6 +106,7 @@ main (void) {
 
 	/* Initialize interrupt handlers. */
 	intr_init ();
+	fpu_init ();
 	timer_init ();
 	kbd_init ();
 	input_init ();
@@ -106,6 +119,10 @@ main (void) {
 	serial_init_queue ();
 	timer_calibrate ();
 
+	/* Start the other CPUs. */
+	smp_init ();
+	workqueue_pool_init ();
+
 #ifdef FILESYS
 	/* Initialize file system. */
 	disk_init ();
@@ -142,31 +159,106 @@ bss_init (void) {
 
 /* Populates the page table with the kernel virtual mapping,
  * and then sets up the CPU to use the new page directory.
- * Points base_pml4 to the pml4 it creates. */
+ * Points base_pml4 to the pml4 it creates.
+ *
+ * Physical memory is mapped with the largest pages that fit: 1 GB
+ * pages if the CPU has them, otherwise 2 MB pages, and 4 kB pages
+ * only at the end of memory and around the edges of the
+ * read-only kernel text.  Since KERN_BASE is 2 MB but not 1 GB
+ * aligned, 1 GB pages can only be used if it is moved. */
 static void
 paging_init (uint64_t mem_end) {
 	uint64_t *pml4, *pte;
+	uint64_t size;
+	size_t cnt_4k = 0, cnt_2m = 0, cnt_1g = 0;
+	uint32_t regs[4];
+	bool huge_ok;
 	int perm;
 	pml4 = base_pml4 = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 
+	/* CPUID.80000001H:EDX[26] says whether 1 GB pages exist. */
+	cpuid (0x80000000, regs);
+	huge_ok = false;
+	if (regs[0] >= 0x80000001) {
+		cpuid (0x80000001, regs);
+		huge_ok = (regs[3] & (1 << 26)) != 0;
+	}
+
 	extern char start, _end_kernel_text;
 	// Maps physical address [0 ~ mem_end] to
 	//   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-	for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+	for (uint64_t pa = 0; pa < mem_end; pa += size) {
 		uint64_t va = (uint64_t) ptov(pa);
 
 		perm = PTE_P | PTE_W;
 		if ((uint64_t) &start <= va && va < (uint64_t) &_end_kernel_text)
 			perm &= ~PTE_W;
 
-		if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
-			*pte = pa | perm;
+		if (huge_ok
+				&& direct_map_fits (va, mem_end, HUGE_PGSIZE,
+					(uint64_t) &start, (uint64_t) &_end_kernel_text)) {
+			size = HUGE_PGSIZE;
+			map_large_page (pml4, va, pa | perm, size);
+			cnt_1g++;
+		} else if (direct_map_fits (va, mem_end, LARGE_PGSIZE,
+					(uint64_t) &start, (uint64_t) &_end_kernel_text)) {
+			size = LARGE_PGSIZE;
+			map_large_page (pml4, va, pa | perm, size);
+			cnt_2m++;
+		} else {
+			size = PGSIZE;
+			if ((pte = pml4e_walk (pml4, va, 1)) != NULL)
+				*pte = pa | perm;
+			cnt_4k++;
+		}
 	}
+	printf ("Direct map: %zu 1 GB, %zu 2 MB, %zu 4 kB pages\n",
+			cnt_1g, cnt_2m, cnt_4k);
 
 	// reload cr3
 	pml4_activate(0);
 }
 
+/* Returns true if the direct map can use a SIZE-byte page at
+ * kernel virtual address VA: VA is aligned to SIZE, the page
+ * ends at or below physical address MEM_END, and it lies either
+ * wholly inside or wholly outside the kernel text, which spans
+ * TEXT_START...TEXT_END. */
+static bool
+direct_map_fits (uint64_t va, uint64_t mem_end, uint64_t size,
+		uint64_t text_start, uint64_t text_end) {
+	uint64_t end = va + size;
+
+	if (va % size != 0 || vtop (va) % size != 0 || vtop (va) + size > mem_end)
+		return false;
+	return end <= text_start || va >= text_end
+		|| (va >= text_start && end <= text_end);
+}
+
+/* Maps the SIZE-byte page at VA, which must be LARGE_PGSIZE or
+ * HUGE_PGSIZE, in PML4 to the physical address and permissions
+ * in ENTRY, allocating page tables as needed. */
+static void
+map_large_page (uint64_t *pml4, uint64_t va, uint64_t entry, uint64_t size) {
+	uint64_t *pdpt = next_table (pml4, PML4 (va));
+
+	if (size == HUGE_PGSIZE)
+		pdpt[PDPE (va)] = entry | PTE_PS;
+	else
+		next_table (pdpt, PDPE (va))[PDX (va)] = entry | PTE_PS;
+}
+
+/* Returns the page table that entry IDX of TABLE points to,
+ * allocating one if the entry is not present. */
+static uint64_t *
+next_table (uint64_t *table, unsigned idx) {
+	if (!(table[idx] & PTE_P)) {
+		uint64_t *new_page = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+		table[idx] = vtop (new_page) | PTE_U | PTE_W | PTE_P;
+	}
+	return ptov (PTE_ADDR (table[idx]));
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -221,6 +313,16 @@ parse_options (char **argv) {
 			random_init (atoi (value));
 		else if (!strcmp (name, "-mlfqs"))
 			thread_mlfqs = true;
+		else if (!strcmp (name, "-cfs"))
+			thread_cfs = true;
+		else if (!strcmp (name, "-iret-switch"))
+			thread_iret_switch = true;
+		else if (!strcmp (name, "-sched-trace"))
+			thread_sched_trace = true;
+		else if (!strcmp (name, "-tickless"))
+			timer_tickless = true;
+		else if (!strcmp (name, "-cpus"))
+			cpu_limit = atoi (value);
 #ifdef USERPROG
 		else if (!strcmp (name, "-ul"))
 			user_page_limit = atoi (value);
@@ -230,6 +332,8 @@ parse_options (char **argv) {
 		else
 			PANIC ("unknown option `%s' (use -h for help)", name);
 	}
+	if (thread_mlfqs && thread_cfs)
+		PANIC ("-mlfqs and -cfs are mutually exclusive");
 
 	return argv;
 }
@@ -326,6 +430,11 @@ usage (void) {
 			"  -f                 Format file system disk during startup.\n"
 			"  -rs=SEED           Set random number seed to SEED.\n"
 			"  -mlfqs             Use multi-level feedback queue scheduler.\n"
+			"  -cfs               Use completely fair scheduler.\n"
+			"  -iret-switch       Always switch threads through iretq.\n"
+			"  -sched-trace       Log thread switches; print them at exit.\n"
+			"  -tickless          Stop the periodic timer tick while idle.\n"
+			"  -cpus=N            Use at most N CPUs.\n"
 #ifdef USERPROG
 			"  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -343,6 +452,7 @@ power_off (void) {
 #endif
 
 	print_stats ();
+	thread_sched_trace_dump ();
 
 	printf ("Powering off...\n");
 	outw (0x604, 0x2000);               /* Poweroff command for qemu */
@@ -354,6 +464,13 @@ static void
 print_stats (void) {
 	timer_print_stats ();
 	thread_print_stats ();
+	palloc_print_stats ();
+	workqueue_print_stats ();
+	kmem_print_stats ();
+	fpu_print_stats ();
+#ifdef VM
+	vm_print_stats ();
+#endif
 #ifdef FILESYS
 	disk_print_stats ();
 #endif
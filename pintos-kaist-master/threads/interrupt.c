@@ -3,12 +3,15 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
+#include "threads/spinlock.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
 #include "intrinsic.h"
 #ifdef USERPROG
@@ -99,9 +102,35 @@ static const char *intr_names[INTR_CNT];
    pre-empted.  Handlers for external interrupts also may not
    sleep, although they may invoke intr_yield_on_return() to
    request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   interrupt returns.  Inter-processor interrupts are handled the
+   same way.
+
+   Each CPU keeps track of whether it is processing an external
+   interrupt, and whether it should yield on return, in the
+   `in_external_intr' and `yield_on_return' members of its
+   struct cpu. */
+
+/* Interrupt lock.
+
+   On a uniprocessor, turning interrupts off is enough to make a
+   stretch of kernel code atomic, and much of the kernel relies
+   on that.  With several CPUs it is not, so a CPU also holds
+   this lock whenever it runs kernel code with interrupts off:
+   intr_disable() takes it and intr_enable() releases it, and
+   intr_handler() does the same on behalf of the code that an
+   interrupt gate interrupted.  This keeps all code that runs
+   with interrupts off, including the scheduler, mutually
+   exclusive across CPUs, while code that runs with interrupts
+   on, such as user programs and most kernel threads, still runs
+   in parallel.
+
+   The lock is handed along, still held, when the scheduler
+   switches threads, and only the thread switched to releases
+   it, once the previous thread's stack is no longer in use.
+
+   The BSP boots with interrupts off, so it starts out holding
+   the lock. */
+static struct spinlock intr_lock = { 1, &cpus[0], "interrupt" };
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
@@ -137,6 +166,9 @@ intr_enable (void) {
 	enum intr_level old_level = intr_get_level ();
 	ASSERT (!intr_context ());
 
+	if (old_level == INTR_OFF)
+		spin_release (&intr_lock);
+
 	/* Enable interrupts by setting the interrupt flag.
 
 	   See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -156,9 +188,33 @@ intr_disable (void) {
 	   Hardware Interrupts". */
 	asm volatile ("cli" : : : "memory");
 
+	if (old_level == INTR_ON)
+		spin_acquire (&intr_lock);
+
 	return old_level;
 }
 
+/* Enables interrupts and waits for the next one to arrive.
+   Interrupts must be off.
+
+   The `sti' instruction disables interrupts until the
+   completion of the next instruction, so `sti; hlt' is
+   atomic.  This atomicity is important; otherwise, an
+   interrupt could be handled between re-enabling interrupts
+   and waiting for the next one to occur, wasting as much as
+   one clock tick worth of time.
+
+   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
+   7.11.1 "HLT Instruction". */
+void
+intr_halt (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (!intr_context ());
+
+	spin_release (&intr_lock);
+	asm volatile ("sti; hlt" : : : "memory");
+}
+
 /* Initializes the interrupt system. */
 void
 intr_init (void) {
@@ -201,6 +257,18 @@ intr_init (void) {
 	intr_names[17] = "#AC Alignment Check Exception";
 	intr_names[18] = "#MC Machine-Check Exception";
 	intr_names[19] = "#XF SIMD Floating-Point Exception";
+	intr_names[LAPIC_SPURIOUS] = "Spurious APIC interrupt";
+}
+
+/* Initializes interrupt handling on an AP, which runs with
+   interrupts off and so must first take the interrupt lock.
+   Then loads the IDT that intr_init() set up. */
+void
+intr_init_ap (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	spin_acquire (&intr_lock);
+	lidt (&idt_desc);
 }
 
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
@@ -249,14 +317,31 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 		intr_handler_func *handler, const char *name)
 {
 	ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+	ASSERT (vec_no < LAPIC_IPI_FIRST);
 	register_handler (vec_no, dpl, level, handler, name);
 }
 
+/* Registers inter-processor interrupt VEC_NO to invoke HANDLER,
+   which is named NAME for debugging purposes.  Like an external
+   interrupt handler, the handler will execute with interrupts
+   disabled, and may not sleep. */
+void
+intr_register_ipi (uint8_t vec_no, intr_handler_func *handler,
+		const char *name) {
+	ASSERT (vec_no >= LAPIC_IPI_FIRST && vec_no <= LAPIC_IPI_LAST);
+	register_handler (vec_no, 0, INTR_OFF, handler, name);
+}
+
 /* Returns true during processing of an external interrupt
    and false at all other times. */
 bool
 intr_context (void) {
-	return in_external_intr;
+	/* External interrupts are handled with interrupts off, and
+	   with interrupts off we cannot migrate to another CPU
+	   between finding our struct cpu and looking inside. */
+	if (intr_get_level () == INTR_ON)
+		return false;
+	return cpu_current ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -266,7 +351,7 @@ intr_context (void) {
 void
 intr_yield_on_return (void) {
 	ASSERT (intr_context ());
-	yield_on_return = true;
+	cpu_current ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -330,27 +415,43 @@ pic_end_of_interrupt (int irq) {
    interrupted thread's registers. */
 void
 intr_handler (struct intr_frame *frame) {
-	bool external;
+	bool external, ipi;
 	intr_handler_func *handler;
+	struct cpu *c;
+
+	/* If we came through an interrupt gate from code that ran
+	   with interrupts on, then that code did not hold the
+	   interrupt lock, but we now run with interrupts off, so
+	   take it. */
+	if (intr_get_level () == INTR_OFF && (frame->eflags & FLAG_IF))
+		spin_acquire (&intr_lock);
 
 	/* External interrupts are special.
 	   We only handle one at a time (so interrupts must be off)
-	   and they need to be acknowledged on the PIC (see below).
+	   and they need to be acknowledged on the PIC, or on the
+	   local APIC for IPIs (see below).
 	   An external interrupt handler cannot sleep. */
-	external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+	ipi = frame->vec_no >= LAPIC_IPI_FIRST && frame->vec_no <= LAPIC_IPI_LAST;
+	external = (frame->vec_no >= 0x20 && frame->vec_no < 0x30) || ipi;
 	if (external) {
 		ASSERT (intr_get_level () == INTR_OFF);
 		ASSERT (!intr_context ());
 
-		in_external_intr = true;
-		yield_on_return = false;
+		c = cpu_current ();
+		c->in_external_intr = true;
+		c->yield_on_return = false;
+
+		/* If the idle thread stopped the periodic tick, catch up
+		   on the ticks that went by before anything else runs. */
+		timer_idle_exit (frame->vec_no == 0x20);
 	}
 
 	/* Invoke the interrupt's handler. */
 	handler = intr_handlers[frame->vec_no];
 	if (handler != NULL)
 		handler (frame);
-	else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f) {
+	else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+			|| frame->vec_no == LAPIC_SPURIOUS) {
 		/* There is no handler, but this interrupt can trigger
 		   spuriously due to a hardware fault or hardware race
 		   condition.  Ignore it. */
@@ -366,12 +467,22 @@ intr_handler (struct intr_frame *frame) {
 		ASSERT (intr_get_level () == INTR_OFF);
 		ASSERT (intr_context ());
 
-		in_external_intr = false;
-		pic_end_of_interrupt (frame->vec_no);
+		c = cpu_current ();
+		c->in_external_intr = false;
+		if (ipi)
+			lapic_eoi ();
+		else
+			pic_end_of_interrupt (frame->vec_no);
 
-		if (yield_on_return)
-			thread_yield ();
+		if (c->yield_on_return)
+			thread_preempt ();
 	}
+
+	/* Returning to code that runs with interrupts on: release the
+	   interrupt lock on its behalf.  (The handler may have
+	   released it already by turning interrupts back on.) */
+	if (intr_get_level () == INTR_OFF && (frame->eflags & FLAG_IF))
+		spin_release (&intr_lock);
 }
 
 /* Dumps interrupt frame F to the console, for debugging. */
@@ -6,16 +6,20 @@
 #include <stdio.h>
 #include <string.h>
 #include "threads/palloc.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
 
 /* A simple implementation of malloc().
 
-   The size of each request, in bytes, is rounded up to a power
-   of 2 and assigned to the "descriptor" that manages blocks of
-   that size.  The descriptor keeps a list of free blocks.  If
-   the free list is nonempty, one of its blocks is used to
-   satisfy the request.
+   The size of each request, in bytes, is rounded up to the
+   nearest of a set of size classes, about 1.25 times apart, and
+   assigned to the "descriptor" that manages blocks of that size.
+   A table indexed by the size in units of CLASS_GRAIN bytes
+   finds the descriptor in constant time.  The descriptor keeps a
+   list of free blocks.  If the free list is nonempty, one of its
+   blocks is used to satisfy the request.
 
    Otherwise, a new page of memory, called an "arena", is
    obtained from the page allocator (if none is available,
@@ -28,11 +32,24 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
+   Each thread also keeps a "magazine" of free blocks for each of
+   the smallest MALLOC_MAG_CLASSES size classes.  A block freed by
+   a thread goes into its magazine, and the thread's allocations
+   of that size come from the magazine, neither of which needs a
+   lock.  Only when a magazine is empty or full does the thread
+   take the descriptor's lock, to move a batch of MAG_BATCH blocks
+   between the magazine and the free list.  Blocks in magazines
+   count as in use for the purpose of freeing arenas, and a
+   thread gives its magazines back when it exits.
+
+   We can't handle blocks bigger than about 2 kB using this
+   scheme, because two of them don't fit in a single page with
+   an arena header.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   free() also accepts objects allocated from a kmem_cache (see
+   slab.c) and returns them to their cache. */
 
 /* Descriptor. */
 struct desc {
@@ -54,29 +71,80 @@ struct arena {
 
 /* Free block. */
 struct block {
-	struct list_elem free_elem; /* Free list element. */
+	union {
+		struct list_elem free_elem; /* Free list element. */
+		struct block *mag_next;     /* Next block in a magazine. */
+	};
 };
 
+/* Size classes are multiples of CLASS_GRAIN bytes, the largest
+   of which is MAX_CLASS_SIZE. */
+#define CLASS_GRAIN 16
+#define MAX_CLASS_SIZE \
+	((PGSIZE - sizeof (struct arena)) / 2 / CLASS_GRAIN * CLASS_GRAIN)
+
+/* Capacity of a magazine, and number of blocks moved between a
+   magazine and a free list at a time. */
+#define MAG_SIZE 16
+#define MAG_BATCH (MAG_SIZE / 2)
+
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[24];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Maps a size, divided by CLASS_GRAIN and rounded up, to the
+   index in descs[] of the smallest class that holds it. */
+static uint8_t size_class[MAX_CLASS_SIZE / CLASS_GRAIN + 1];
+
+static struct block *get_block (struct desc *);
+static void put_block (struct desc *, struct block *);
+static bool fill_magazine (struct desc *, struct malloc_magazine *);
+static void drain_magazine (struct desc *, struct malloc_magazine *,
+		size_t cnt);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) {
-	size_t block_size;
+	size_t block_size, size;
 
-	for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2) {
+	for (block_size = CLASS_GRAIN; block_size <= MAX_CLASS_SIZE; ) {
 		struct desc *d = &descs[desc_cnt++];
 		ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
 		d->block_size = block_size;
 		d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
 		list_init (&d->free_list);
 		lock_init (&d->lock);
+
+		/* Next class is 1.25 times as big, rounded up to the
+		   grain, and the last one is as big as possible. */
+		if (block_size == MAX_CLASS_SIZE)
+			break;
+		size = ROUND_UP (block_size * 5 / 4, CLASS_GRAIN);
+		if (size == block_size)
+			size += CLASS_GRAIN;
+		block_size = size <= MAX_CLASS_SIZE ? size : MAX_CLASS_SIZE;
 	}
+	ASSERT (desc_cnt > MALLOC_MAG_CLASSES);
+
+	for (size = 0; size <= MAX_CLASS_SIZE / CLASS_GRAIN; size++) {
+		uint8_t i = size > 0 ? size_class[size - 1] : 0;
+		while (descs[i].block_size < size * CLASS_GRAIN)
+			i++;
+		size_class[size] = i;
+	}
+}
+
+/* Gives the blocks in the current thread's magazines back to
+   their free lists.  Called when the thread exits. */
+void
+malloc_thread_exit (void) {
+	struct thread *t = thread_current ();
+	size_t i;
+
+	for (i = 0; i < MALLOC_MAG_CLASSES; i++)
+		drain_magazine (&descs[i], &t->magazines[i], t->magazines[i].cnt);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
@@ -91,12 +159,7 @@ malloc (size_t size) {
 	if (size == 0)
 		return NULL;
 
-	/* Find the smallest descriptor that satisfies a SIZE-byte
-	   request. */
-	for (d = descs; d < descs + desc_cnt; d++)
-		if (d->block_size >= size)
-			break;
-	if (d == descs + desc_cnt) {
+	if (size > MAX_CLASS_SIZE) {
 		/* SIZE is too big for any descriptor.
 		   Allocate enough pages to hold SIZE plus an arena. */
 		size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
@@ -112,33 +175,22 @@ malloc (size_t size) {
 		return a + 1;
 	}
 
-	lock_acquire (&d->lock);
-
-	/* If the free list is empty, create a new arena. */
-	if (list_empty (&d->free_list)) {
-		size_t i;
+	/* Find the smallest descriptor that satisfies a SIZE-byte
+	   request. */
+	d = &descs[size_class[DIV_ROUND_UP (size, CLASS_GRAIN)]];
+	if (d < descs + MALLOC_MAG_CLASSES) {
+		struct malloc_magazine *m = &thread_current ()->magazines[d - descs];
 
-		/* Allocate a page. */
-		a = palloc_get_page (0);
-		if (a == NULL) {
-			lock_release (&d->lock);
+		if (m->cnt == 0 && !fill_magazine (d, m))
 			return NULL;
-		}
-
-		/* Initialize arena and add its blocks to the free list. */
-		a->magic = ARENA_MAGIC;
-		a->desc = d;
-		a->free_cnt = d->blocks_per_arena;
-		for (i = 0; i < d->blocks_per_arena; i++) {
-			struct block *b = arena_to_block (a, i);
-			list_push_back (&d->free_list, &b->free_elem);
-		}
+		b = m->top;
+		m->top = b->mag_next;
+		m->cnt--;
+		return b;
 	}
 
-	/* Get a block from free list and return it. */
-	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-	a = block_to_arena (b);
-	a->free_cnt--;
+	lock_acquire (&d->lock);
+	b = get_block (d);
 	lock_release (&d->lock);
 	return b;
 }
@@ -167,9 +219,13 @@ calloc (size_t a, size_t b) {
 static size_t
 block_size (void *block) {
 	struct block *b = block;
-	struct arena *a = block_to_arena (b);
-	struct desc *d = a->desc;
+	struct arena *a;
+	struct desc *d;
 
+	if (kmem_owns (block))
+		return kmem_size (block);
+	a = block_to_arena (b);
+	d = a->desc;
 	return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
@@ -200,7 +256,9 @@ realloc (void *old_block, size_t new_size) {
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) {
-	if (p != NULL) {
+	if (p != NULL && kmem_owns (p))
+		kmem_free (p);
+	else if (p != NULL) {
 		struct block *b = p;
 		struct arena *a = block_to_arena (b);
 		struct desc *d = a->desc;
@@ -213,24 +271,20 @@ free (void *p) {
 			memset (b, 0xcc, d->block_size);
 #endif
 
-			lock_acquire (&d->lock);
-
-			/* Add block to free list. */
-			list_push_front (&d->free_list, &b->free_elem);
-
-			/* If the arena is now entirely unused, free it. */
-			if (++a->free_cnt >= d->blocks_per_arena) {
-				size_t i;
-
-				ASSERT (a->free_cnt == d->blocks_per_arena);
-				for (i = 0; i < d->blocks_per_arena; i++) {
-					struct block *b = arena_to_block (a, i);
-					list_remove (&b->free_elem);
-				}
-				palloc_free_page (a);
+			if (d < descs + MALLOC_MAG_CLASSES) {
+				struct malloc_magazine *m =
+					&thread_current ()->magazines[d - descs];
+
+				if (m->cnt == MAG_SIZE)
+					drain_magazine (d, m, MAG_BATCH);
+				b->mag_next = m->top;
+				m->top = b;
+				m->cnt++;
+			} else {
+				lock_acquire (&d->lock);
+				put_block (d, b);
+				lock_release (&d->lock);
 			}
-
-			lock_release (&d->lock);
 		} else {
 			/* It's a big block.  Free its pages. */
 			palloc_free_multiple (a, a->free_cnt);
@@ -239,6 +293,104 @@ free (void *p) {
 	}
 }
 
+/* Takes a block from D's free list, creating a new arena if the
+   list is empty, and returns it.  Returns a null pointer if
+   memory is not available.  D's lock must be held. */
+static struct block *
+get_block (struct desc *d) {
+	struct block *b;
+	struct arena *a;
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+
+	/* If the free list is empty, create a new arena. */
+	if (list_empty (&d->free_list)) {
+		size_t i;
+
+		/* Allocate a page. */
+		a = palloc_get_page (0);
+		if (a == NULL)
+			return NULL;
+
+		/* Initialize arena and add its blocks to the free list. */
+		a->magic = ARENA_MAGIC;
+		a->desc = d;
+		a->free_cnt = d->blocks_per_arena;
+		for (i = 0; i < d->blocks_per_arena; i++) {
+			struct block *b = arena_to_block (a, i);
+			list_push_back (&d->free_list, &b->free_elem);
+		}
+	}
+
+	/* Get a block from free list and return it. */
+	b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+	a = block_to_arena (b);
+	a->free_cnt--;
+	return b;
+}
+
+/* Puts block B back on D's free list, and gives its arena back
+   to the page allocator if that leaves the arena unused.  D's
+   lock must be held. */
+static void
+put_block (struct desc *d, struct block *b) {
+	struct arena *a = block_to_arena (b);
+
+	ASSERT (lock_held_by_current_thread (&d->lock));
+
+	/* Add block to free list. */
+	list_push_front (&d->free_list, &b->free_elem);
+
+	/* If the arena is now entirely unused, free it. */
+	if (++a->free_cnt >= d->blocks_per_arena) {
+		size_t i;
+
+		ASSERT (a->free_cnt == d->blocks_per_arena);
+		for (i = 0; i < d->blocks_per_arena; i++) {
+			struct block *b = arena_to_block (a, i);
+			list_remove (&b->free_elem);
+		}
+		palloc_free_page (a);
+	}
+}
+
+/* Moves up to MAG_BATCH blocks from D's free list into empty
+   magazine M.  Returns true if at least one was moved, false if
+   memory is not available. */
+static bool
+fill_magazine (struct desc *d, struct malloc_magazine *m) {
+	ASSERT (m->cnt == 0);
+
+	lock_acquire (&d->lock);
+	while (m->cnt < MAG_BATCH) {
+		struct block *b = get_block (d);
+		if (b == NULL)
+			break;
+		b->mag_next = m->top;
+		m->top = b;
+		m->cnt++;
+	}
+	lock_release (&d->lock);
+	return m->cnt > 0;
+}
+
+/* Moves CNT blocks from magazine M back to D's free list. */
+static void
+drain_magazine (struct desc *d, struct malloc_magazine *m, size_t cnt) {
+	ASSERT (cnt <= m->cnt);
+
+	if (cnt == 0)
+		return;
+	lock_acquire (&d->lock);
+	for (; cnt > 0; cnt--) {
+		struct block *b = m->top;
+		m->top = b->mag_next;
+		m->cnt--;
+		put_block (d, b);
+	}
+	lock_release (&d->lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b) {
@@ -0,0 +1,262 @@
+#include "threads/mlfqs.h"
+#include <debug.h>
+#include "threads/cpu.h"
+#include "threads/fixed-point.h"
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+/* 4.4BSD multi-level feedback queue scheduler, with -mlfqs.
+
+   Each thread's priority is computed from its nice value and
+   its recent_cpu, an exponentially decaying count of the timer
+   ticks it has run:
+
+       priority = PRI_MAX - recent_cpu / 4 - nice * 2
+
+   Every timer tick, the running thread's recent_cpu goes up by
+   1.  Once a second, the system load average is updated and
+   every thread's recent_cpu decays:
+
+       recent_cpu = (2*load_avg)/(2*load_avg + 1) * recent_cpu + nice
+
+   Priorities are recomputed every fourth tick.
+
+   Done literally, the once-a-second decay would visit every
+   thread in the system from the timer interrupt.  Instead, the
+   interrupt only updates the running thread and the load
+   average, and records the decay coefficient for that second in
+   decay_hist[].  Each thread remembers how many seconds of decay
+   it has had, in `mlfqs_epoch', and catches up on the rest when
+   it is next looked at: when it runs, when it goes on a run
+   queue, or, for a thread that is waiting on a run queue, on one
+   of the next few timer ticks on that run queue's CPU, each of
+   which catches up at most MLFQS_REFRESH_THREADS of them, oldest
+   first.  A blocked thread's priority does not matter until it
+   wakes up, and between seconds the priorities of ready threads
+   do not change, since only the running thread's recent_cpu
+   does, so the result is the same, except that a long run queue
+   takes a few ticks to be re-sorted after each second.
+
+   A thread that has missed more seconds than decay_hist[]
+   remembers takes the closed form of the recurrence for the
+   oldest of them, using the oldest coefficient remembered in
+   place of the forgotten ones.  Its recent_cpu has converged
+   toward nice / (1 - coefficient) by then anyhow. */
+
+/* Number of seconds of decay coefficients remembered. */
+#define MLFQS_HISTORY 64
+
+/* Number of timer ticks between priority updates. */
+#define MLFQS_PRIORITY_TICKS 4
+
+/* Most ready threads whose priorities are brought up to date per
+   timer tick. */
+#define MLFQS_REFRESH_THREADS 8
+
+/* Seconds of decay done so far, and the coefficient used for
+   each of the last MLFQS_HISTORY, indexed by second modulo
+   MLFQS_HISTORY.  Updated only by the BSP, with interrupts off. */
+static int64_t seconds;
+static fixed_t decay_hist[MLFQS_HISTORY];
+
+/* System load average. */
+static fixed_t load_avg;
+
+static void catch_up (struct thread *);
+static void update_priority (struct thread *);
+static void advance_second (void);
+static size_t ready_threads (void);
+static fixed_t fp_pow (fixed_t, int64_t);
+
+/* Initializes the scheduling state of new thread T, created by
+   PARENT, from which it inherits its nice value and recent_cpu. */
+void
+mlfqs_init_thread (struct thread *t, const struct thread *parent) {
+	enum intr_level old_level = intr_disable ();
+
+	t->nice = parent->nice;
+	t->recent_cpu = parent->recent_cpu;
+	t->mlfqs_epoch = parent->mlfqs_epoch;
+	mlfqs_update (t);
+	intr_set_level (old_level);
+}
+
+/* Accounts for a timer tick on the current CPU, and returns true
+   if its running thread should yield because a ready thread now
+   has a higher priority.  Called by the timer interrupt handler.
+   Takes constant time: the CPU's run queue is re-sorted at its
+   threads' new priorities a few threads at a time. */
+bool
+mlfqs_tick (void) {
+	struct cpu *c = cpu_current ();
+	struct thread *t = c->curr;
+	int64_t now = timer_ticks ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (t != c->idle_thread) {
+		catch_up (t);
+		t->recent_cpu += fp_from_int (1);
+	}
+
+	/* Normally once; more after the tick was stopped. */
+	if (c == &cpus[0])
+		while (seconds < now / TIMER_FREQ)
+			advance_second ();
+
+	runqueue_refresh (&c->rq, MLFQS_REFRESH_THREADS);
+
+	if (t == c->idle_thread)
+		return false;
+	if (now % MLFQS_PRIORITY_TICKS == 0)
+		mlfqs_update (t);
+	return runqueue_max_priority (&c->rq) > t->priority;
+}
+
+/* Brings T's recent_cpu up to date and recomputes its priority.
+   Must be called with interrupts off, and not on a thread in a
+   run queue, since that would change its level behind the run
+   queue's back. */
+void
+mlfqs_update (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	catch_up (t);
+	update_priority (t);
+}
+
+/* Returns the number of seconds of decay done so far.  A ready
+   thread whose `mlfqs_epoch' is older has a stale priority. */
+int64_t
+mlfqs_epoch (void) {
+	return seconds;
+}
+
+/* Sets T's nice value to NICE, clamped to NICE_MIN...NICE_MAX,
+   and recomputes its priority.  T must not be in a run queue. */
+void
+mlfqs_set_nice (struct thread *t, int nice) {
+	enum intr_level old_level = intr_disable ();
+
+	if (nice < NICE_MIN)
+		nice = NICE_MIN;
+	else if (nice > NICE_MAX)
+		nice = NICE_MAX;
+
+	catch_up (t);
+	t->nice = nice;
+	update_priority (t);
+	intr_set_level (old_level);
+}
+
+/* Returns 100 times T's recent_cpu, rounded to the nearest
+   integer. */
+int
+mlfqs_get_recent_cpu (struct thread *t) {
+	enum intr_level old_level = intr_disable ();
+	int recent_cpu;
+
+	catch_up (t);
+	recent_cpu = fp_round (t->recent_cpu * 100);
+	intr_set_level (old_level);
+	return recent_cpu;
+}
+
+/* Returns 100 times the system load average, rounded to the
+   nearest integer. */
+int
+mlfqs_get_load_avg (void) {
+	enum intr_level old_level = intr_disable ();
+	int avg = fp_round (load_avg * 100);
+
+	intr_set_level (old_level);
+	return avg;
+}
+
+/* Applies to T's recent_cpu the decay of the seconds that went
+   by since it was last brought up to date. */
+static void
+catch_up (struct thread *t) {
+	fixed_t nice = fp_from_int (t->nice);
+	fixed_t recent_cpu = t->recent_cpu;
+
+	if (t->mlfqs_epoch == seconds)
+		return;
+
+	if (seconds - t->mlfqs_epoch > MLFQS_HISTORY) {
+		/* x[k] = a^k x[0] + nice (1 - a^k) / (1 - a). */
+		int64_t k = seconds - MLFQS_HISTORY - t->mlfqs_epoch;
+		fixed_t a = decay_hist[seconds % MLFQS_HISTORY];
+		fixed_t a_k = fp_pow (a, k);
+
+		recent_cpu = fp_mul (a_k, recent_cpu);
+		if (a < fp_from_int (1))
+			recent_cpu += fp_mul (nice, fp_div (fp_from_int (1) - a_k,
+						fp_from_int (1) - a));
+		else
+			recent_cpu += nice * k;
+		t->mlfqs_epoch = seconds - MLFQS_HISTORY;
+	}
+
+	for (; t->mlfqs_epoch < seconds; t->mlfqs_epoch++)
+		recent_cpu = fp_mul (decay_hist[t->mlfqs_epoch % MLFQS_HISTORY],
+				recent_cpu) + nice;
+	t->recent_cpu = recent_cpu;
+}
+
+/* Recomputes T's priority from its nice value and recent_cpu,
+   which must be up to date. */
+static void
+update_priority (struct thread *t) {
+	int priority = fp_to_int (fp_from_int (PRI_MAX) - t->recent_cpu / 4
+			- fp_from_int (t->nice * 2));
+
+	if (priority < PRI_MIN)
+		priority = PRI_MIN;
+	else if (priority > PRI_MAX)
+		priority = PRI_MAX;
+	t->priority = priority;
+}
+
+/* Updates the load average and records the decay coefficient
+   for the second that just ended. */
+static void
+advance_second (void) {
+	fixed_t twice_load;
+
+	load_avg = (59 * load_avg + fp_from_int (ready_threads ())) / 60;
+	twice_load = 2 * load_avg;
+	decay_hist[seconds % MLFQS_HISTORY] =
+		fp_div (twice_load, twice_load + fp_from_int (1));
+	seconds++;
+}
+
+/* Returns the number of threads running or ready to run, not
+   counting idle threads. */
+static size_t
+ready_threads (void) {
+	size_t cnt = 0;
+	int i;
+
+	for (i = 0; i < cpu_cnt; i++)
+		cnt += runqueue_size (&cpus[i].rq)
+			+ (cpus[i].curr != cpus[i].idle_thread);
+	return cnt;
+}
+
+/* Returns X to the power of N, for N >= 0, by repeated
+   squaring. */
+static fixed_t
+fp_pow (fixed_t x, int64_t n) {
+	fixed_t result = fp_from_int (1);
+
+	ASSERT (n >= 0);
+
+	for (; n > 0; n >>= 1) {
+		if (n & 1)
+			result = fp_mul (result, x);
+		x = fp_mul (x, x);
+	}
+	return result;
+}
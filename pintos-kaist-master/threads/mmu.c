@@ -8,12 +8,37 @@
 #include "threads/mmu.h"
 #include "intrinsic.h"
 
+/* Replaces *ENTRY, a PTE_PS entry that maps a SIZE-byte page,
+ * by a pointer to a new table whose entries map the same memory
+ * with the same permissions in pages 1/512 as big.  Returns
+ * false if memory is not available. */
+static bool
+split_large_page (uint64_t *entry, uint64_t size) {
+	uint64_t *table = palloc_get_page (0);
+	uint64_t sub_size = size / (PGSIZE / sizeof *table);
+	uint64_t flags = *entry & PTE_FLAGS;
+	unsigned i;
+
+	if (table == NULL)
+		return false;
+	if (sub_size == PGSIZE)
+		flags &= ~PTE_PS;
+	for (i = 0; i < PGSIZE / sizeof *table; i++)
+		table[i] = (PTE_ADDR (*entry) + i * sub_size) | flags;
+	*entry = vtop (table) | PTE_U | PTE_W | PTE_P;
+	return true;
+}
+
 static uint64_t *
 pgdir_walk (uint64_t *pdp, const uint64_t va, int create) {
 	int idx = PDX (va);
 	if (pdp) {
 		uint64_t *pte = (uint64_t *) pdp[idx];
-		if (!((uint64_t) pte & PTE_P)) {
+		if ((uint64_t) pte & PTE_PS) {
+			/* A 2 MB page has no 4 kB PTE until it is split. */
+			if (!create || !split_large_page (&pdp[idx], LARGE_PGSIZE))
+				return NULL;
+		} else if (!((uint64_t) pte & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
 				if (new_page)
@@ -35,7 +60,11 @@ pdpe_walk (uint64_t *pdpe, const uint64_t va, int create) {
 	int allocated = 0;
 	if (pdpe) {
 		uint64_t *pde = (uint64_t *) pdpe[idx];
-		if (!((uint64_t) pde & PTE_P)) {
+		if ((uint64_t) pde & PTE_PS) {
+			/* Likewise for a 1 GB page. */
+			if (!create || !split_large_page (&pdpe[idx], HUGE_PGSIZE))
+				return NULL;
+		} else if (!((uint64_t) pde & PTE_P)) {
 			if (create) {
 				uint64_t *new_page = palloc_get_page (PAL_ZERO);
 				if (new_page) {
@@ -122,7 +151,7 @@ pgdir_for_each (uint64_t *pdp, pte_for_each_func *func, void *aux,
 		unsigned pml4_index, unsigned pdp_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pte = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pte) & PTE_P)
+		if ((((uint64_t) pte) & (PTE_P | PTE_PS)) == PTE_P)
 			if (!pt_for_each ((uint64_t *) PTE_ADDR (pte), func, aux,
 					pml4_index, pdp_index, i))
 				return false;
@@ -135,7 +164,7 @@ pdp_for_each (uint64_t *pdp,
 		pte_for_each_func *func, void *aux, unsigned pml4_index) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
 		uint64_t *pde = ptov((uint64_t *) pdp[i]);
-		if (((uint64_t) pde) & PTE_P)
+		if ((((uint64_t) pde) & (PTE_P | PTE_PS)) == PTE_P)
 			if (!pgdir_for_each ((uint64_t *) PTE_ADDR (pde), func,
 					 aux, pml4_index, i))
 				return false;
@@ -143,7 +172,9 @@ pdp_for_each (uint64_t *pdp,
 	return true;
 }
 
-/* Apply FUNC to each available pte entries including kernel's. */
+/* Apply FUNC to each available pte entries including kernel's.
+ * Pages mapped by large-page PDEs or PDPEs, which have no 4 kB
+ * PTE, are skipped. */
 bool
 pml4_for_each (uint64_t *pml4, pte_for_each_func *func, void *aux) {
 	for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
@@ -262,6 +293,27 @@ pml4_clear_page (uint64_t *pml4, void *upage) {
 	}
 }
 
+/* Makes the mapping of user virtual page UPAGE in PML4 writable
+ * if RW is true, or read-only otherwise.  Other bits in the page
+ * table entry are preserved.  UPAGE need not be mapped. */
+void
+pml4_set_writable (uint64_t *pml4, void *upage, bool rw) {
+	uint64_t *pte;
+	ASSERT (pg_ofs (upage) == 0);
+	ASSERT (is_user_vaddr (upage));
+
+	pte = pml4e_walk (pml4, (uint64_t) upage, false);
+	if (pte != NULL) {
+		if (rw)
+			*pte |= PTE_W;
+		else
+			*pte &= ~(uint64_t) PTE_W;
+
+		if (rcr3 () == vtop (pml4))
+			invlpg ((uint64_t) upage);
+	}
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
  * installed.
@@ -1,15 +1,15 @@
 #include "threads/palloc.h"
-#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,13 +24,76 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is a binary buddy allocator.  Its free pages are
+   kept in blocks of 2**ORDER pages, for ORDER from 0 to
+   MAX_ORDER, each block aligned on a multiple of its size
+   relative to the pool's base, on one free list per order.  A
+   block's "buddy" is the other half of the block twice its size
+   that contains it.  An allocation of N pages takes a block of
+   the smallest order that fits N from the lowest non-empty free
+   list that has one, splitting off and freeing halves until it
+   is that size, and then frees the pages beyond the N it needs.
+   Freeing merges a block with its buddy, if that is free too,
+   over and over.  Both take O(log n) time in the size of the
+   pool.
+
+   Each pool has two arrays with an entry per page, kept below
+   the start of free memory: the free list element of the free
+   block that starts at the page, and a byte that gives the
+   block's order, or NOT_FREE.  Keeping the list elements out of
+   the free pages themselves means that freeing a page never
+   touches it, which matters at boot: until paging_init() builds
+   the real page tables, only the first BOOT_MAP_END bytes of
+   physical memory are mapped.  palloc_init() therefore frees
+   only the memory below that, and palloc_init_high() the rest,
+   once all of memory is mapped, so that the pages that
+   paging_init() allocates are mapped too.
+
+   Each pool also keeps a short list of free pages that are
+   already filled with zeros.  Idle threads fill it with pages
+   taken from the buddy allocator, and single-page PAL_ZERO
+   allocations take from it first, which saves them clearing the
+   page themselves.  Other allocations leave these pages alone
+   unless the pool is otherwise out of memory, in which case the
+   list, and the page being zeroed if any, are given back to the
+   buddy allocator first.  An idle thread zeroes a page a chunk at
+   a time, each with interrupts off, so that the page is always
+   accounted for by its pool and never touched by the idle thread
+   once it has been given back.
+
+   The pools are protected by turning off interrupts, not by a
+   lock, because the scheduler frees the pages of dead threads
+   with interrupts off. */
+
+/* Largest block order: blocks of up to 4 GB. */
+#define MAX_ORDER 20
+
+/* Page is not the first page of a free block. */
+#define NOT_FREE 0xff
+
+/* Physical memory mapped by the page tables that threads/start.S
+   builds: 128 pages of 2 MB. */
+#define BOOT_MAP_END ((uint64_t) 128 * 0x200000)
+
+/* Most pre-zeroed pages kept in each pool. */
+#define ZEROED_MAX 64
+
+/* Bytes that palloc_zero_idle() zeroes per call. */
+#define ZERO_CHUNK 512
 
 /* A memory pool. */
 struct pool {
-	struct lock lock;               /* Mutual exclusion. */
-	struct bitmap *used_map;        /* Bitmap of free pages. */
 	uint8_t *base;                  /* Base of pool. */
+	size_t page_cnt;                /* Number of pages in pool. */
+	struct list_elem *links;        /* Free list element at each page. */
+	uint8_t *free_order;            /* Order of free block at each page. */
+	struct list free[MAX_ORDER + 1];/* Free blocks of each order. */
+	struct list zeroed;             /* Free pages filled with zeros. */
+	size_t zeroed_cnt;              /* Number of pages in `zeroed'. */
+	uint8_t *zeroing;               /* Page being zeroed, or null. */
+	size_t zeroing_ofs;             /* Bytes of `zeroing' done so far. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -38,10 +101,28 @@ static struct pool kernel_pool, user_pool;
 
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
+
+/* Start of free memory, past the pools' arrays. */
+static uint64_t usable_bound;
+
+/* Statistics. */
+static long long zero_cnt;      /* Single-page PAL_ZERO allocations. */
+static long long prezeroed_cnt; /* ...of which were pre-zeroed. */
+
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end);
 
 static bool page_from_pool (const struct pool *, void *page);
+static void *alloc_pages (struct pool *, size_t page_cnt);
+static void *alloc_zeroed (struct pool *);
+static void release_zeroed (struct pool *);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void free_block (struct pool *, size_t page_idx, unsigned order);
+static struct list_elem *block_elem (const struct pool *, size_t page_idx);
+static size_t block_idx (const struct pool *, const struct list_elem *);
+static bool pages_allocated (const struct pool *, size_t page_idx,
+		size_t page_cnt);
+static void free_usable (uint64_t lo, uint64_t hi);
 
 /* multiboot info */
 struct multiboot_info {
@@ -190,11 +271,21 @@ populate_pools (struct area *base_mem, struct area *ext_mem) {
 	// generate the user pool
 	init_pool(&user_pool, &free_start, region_start, end);
 
-	// Iterate over the e820_entry. Setup the usable.
-	uint64_t usable_bound = (uint64_t) free_start;
+	// Free the usable memory that the boot page tables map.
+	usable_bound = (uint64_t) free_start;
+	free_usable (usable_bound, (uint64_t) ptov (BOOT_MAP_END));
+}
+
+/* Frees the usable pages, according to the e820 map, whose
+   kernel virtual addresses are in LO...HI - 1. */
+static void
+free_usable (uint64_t lo, uint64_t hi) {
+	struct multiboot_info *mb_info = ptov (MULTIBOOT_INFO);
+	struct e820_entry *entries = ptov (mb_info->mmap_base);
 	struct pool *pool;
 	void *pool_end;
 	size_t page_idx, page_cnt;
+	uint32_t i;
 
 	for (i = 0; i < mb_info->mmap_len / sizeof (struct e820_entry); i++) {
 		struct e820_entry *entry = &entries[i];
@@ -206,11 +297,14 @@ populate_pools (struct area *base_mem, struct area *ext_mem) {
 
 			// TODO: add 0x1000 ~ 0x200000, This is not a matter for now.
 			// All the pages are unuable
-			if (end < usable_bound)
+			if (end > hi)
+				end = hi;
+			if (end < lo)
 				continue;
 
-			start = (uint64_t)
-				pg_round_up (start >= usable_bound ? start : usable_bound);
+			start = (uint64_t) pg_round_up (start >= lo ? start : lo);
+			if (start >= end)
+				continue;
 split:
 			if (page_from_pool (&kernel_pool, (void *) start))
 				pool = &kernel_pool;
@@ -219,16 +313,16 @@ split:
 			else
 				NOT_REACHED ();
 
-			pool_end = pool->base + bitmap_size (pool->used_map) * PGSIZE;
+			pool_end = pool->base + pool->page_cnt * PGSIZE;
 			page_idx = pg_no (start) - pg_no (pool->base);
 			if ((uint64_t) pool_end < end) {
 				page_cnt = ((uint64_t) pool_end - start) / PGSIZE;
-				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				free_pages (pool, page_idx, page_cnt);
 				start = (uint64_t) pool_end;
 				goto split;
 			} else {
 				page_cnt = ((uint64_t) end - start) / PGSIZE;
-				bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+				free_pages (pool, page_idx, page_cnt);
 			}
 		}
 	}
@@ -253,6 +347,18 @@ palloc_init (void) {
 	return ext_mem.end;
 }
 
+/* Frees the memory that palloc_init() left out because the boot
+   page tables do not map it.  Called once paging_init() has
+   mapped all of memory. */
+void
+palloc_init_high (void) {
+	enum intr_level old_level = intr_disable ();
+	uint64_t lo = (uint64_t) ptov (BOOT_MAP_END);
+
+	free_usable (lo > usable_bound ? lo : usable_bound, UINT64_MAX);
+	intr_set_level (old_level);
+}
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
@@ -262,19 +368,34 @@ palloc_init (void) {
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt) {
 	struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-
-	lock_acquire (&pool->lock);
-	size_t page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-	lock_release (&pool->lock);
+	enum intr_level old_level;
+	bool zeroed = false;
 	void *pages;
 
-	if (page_idx != BITMAP_ERROR)
-		pages = pool->base + PGSIZE * page_idx;
-	else
+	old_level = intr_disable ();
+	if ((flags & PAL_ZERO) && page_cnt == 1) {
+		zero_cnt++;
+		pages = alloc_zeroed (pool);
+		if (pages != NULL) {
+			prezeroed_cnt++;
+			zeroed = true;
+		}
+	} else
 		pages = NULL;
+	if (pages == NULL) {
+		pages = alloc_pages (pool, page_cnt);
+		if (pages == NULL
+				&& (pool->zeroed_cnt > 0 || pool->zeroing != NULL)) {
+			release_zeroed (pool);
+			pages = alloc_pages (pool, page_cnt);
+		}
+	}
+	intr_set_level (old_level);
 
 	if (pages) {
-		if (flags & PAL_ZERO)
+		if (zeroed)
+			memset (pages, 0, sizeof (struct list_elem));
+		else if (flags & PAL_ZERO)
 			memset (pages, 0, PGSIZE * page_cnt);
 	} else {
 		if (flags & PAL_ASSERT)
@@ -300,6 +421,7 @@ palloc_get_page (enum palloc_flags flags) {
 void
 palloc_free_multiple (void *pages, size_t page_cnt) {
 	struct pool *pool;
+	enum intr_level old_level;
 	size_t page_idx;
 
 	ASSERT (pg_ofs (pages) == 0);
@@ -318,8 +440,9 @@ palloc_free_multiple (void *pages, size_t page_cnt) {
 #ifndef NDEBUG
 	memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
-	ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
-	bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+	old_level = intr_disable ();
+	free_pages (pool, page_idx, page_cnt);
+	intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -328,23 +451,77 @@ palloc_free_page (void *page) {
 	palloc_free_multiple (page, 1);
 }
 
+/* If a pool's list of pre-zeroed pages is not full, zeroes the
+   next ZERO_CHUNK bytes of the page that the pool is zeroing,
+   first taking a free page from the pool if it is not zeroing
+   one, and adds the page to the list once it is all zeros.
+   Returns true if it zeroed anything, false if there was nothing
+   to do.
+
+   Called by idle threads with interrupts off, which stay off, so
+   the caller should let pending interrupts in before calling
+   again. */
+bool
+palloc_zero_idle (void) {
+	struct pool *pools[] = { &kernel_pool, &user_pool };
+	size_t i;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (i = 0; i < sizeof pools / sizeof *pools; i++) {
+		struct pool *pool = pools[i];
+
+		if (pool->zeroing == NULL) {
+			if (pool->zeroed_cnt >= ZEROED_MAX)
+				continue;
+			pool->zeroing = alloc_pages (pool, 1);
+			if (pool->zeroing == NULL)
+				continue;
+			pool->zeroing_ofs = 0;
+		}
+
+		memset (pool->zeroing + pool->zeroing_ofs, 0, ZERO_CHUNK);
+		pool->zeroing_ofs += ZERO_CHUNK;
+		if (pool->zeroing_ofs == PGSIZE) {
+			list_push_front (&pool->zeroed, (void *) pool->zeroing);
+			pool->zeroed_cnt++;
+			pool->zeroing = NULL;
+		}
+		return true;
+	}
+	return false;
+}
+
+/* Prints page allocator statistics. */
+void
+palloc_print_stats (void) {
+	printf ("Page allocator: %lld of %lld zeroed pages pre-zeroed\n",
+			prezeroed_cnt, zero_cnt);
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool (struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
+  /* We'll put the pool's links and free_order arrays at *BM_BASE,
+     which is below the start of free memory. */
 	uint64_t pgcnt = (end - start) / PGSIZE;
-	size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (pgcnt), PGSIZE) * PGSIZE;
+	size_t map_bytes = ROUND_UP (pgcnt * (sizeof *p->links + 1), PGSIZE);
+	unsigned order;
 
-	lock_init(&p->lock);
-	p->used_map = bitmap_create_in_buf (pgcnt, *bm_base, bm_pages);
 	p->base = (void *) start;
+	p->page_cnt = pgcnt;
+	p->links = *bm_base;
+	p->free_order = (uint8_t *) (p->links + pgcnt);
+	for (order = 0; order <= MAX_ORDER; order++)
+		list_init (&p->free[order]);
+	list_init (&p->zeroed);
+	p->zeroed_cnt = 0;
+	p->zeroing = NULL;
 
 	// Mark all to unusable.
-	bitmap_set_all(p->used_map, true);
+	memset (p->free_order, NOT_FREE, pgcnt);
 
-	*bm_base += bm_pages;
+	*bm_base += map_bytes;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -353,6 +530,160 @@ static bool
 page_from_pool (const struct pool *pool, void *page) {
 	size_t page_no = pg_no (page);
 	size_t start_page = pg_no (pool->base);
-	size_t end_page = start_page + bitmap_size (pool->used_map);
+	size_t end_page = start_page + pool->page_cnt;
 	return page_no >= start_page && page_no < end_page;
 }
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   first, or a null pointer if POOL has no free block big enough.
+   Must be called with interrupts off. */
+static void *
+alloc_pages (struct pool *pool, size_t page_cnt) {
+	unsigned want, order;
+	size_t page_idx;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (page_cnt == 0)
+		return NULL;
+	for (want = 0; want <= MAX_ORDER && ((size_t) 1 << want) < page_cnt;
+			want++)
+		continue;
+
+	for (order = want; order <= MAX_ORDER; order++)
+		if (!list_empty (&pool->free[order]))
+			break;
+	if (order > MAX_ORDER)
+		return NULL;
+
+	page_idx = block_idx (pool, list_pop_front (&pool->free[order]));
+	pool->free_order[page_idx] = NOT_FREE;
+
+	/* Split off the upper halves we do not need. */
+	while (order > want) {
+		size_t buddy;
+
+		order--;
+		buddy = page_idx + ((size_t) 1 << order);
+		pool->free_order[buddy] = order;
+		list_push_front (&pool->free[order], block_elem (pool, buddy));
+	}
+
+	/* Give back the pages beyond PAGE_CNT. */
+	free_pages (pool, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+
+	return pool->base + PGSIZE * page_idx;
+}
+
+/* Takes a page off POOL's list of pre-zeroed pages and returns
+   it, or a null pointer if the list is empty.  All of the page
+   is zeros except for its first sizeof (struct list_elem) bytes.
+   Must be called with interrupts off. */
+static void *
+alloc_zeroed (struct pool *pool) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (list_empty (&pool->zeroed))
+		return NULL;
+	pool->zeroed_cnt--;
+	return list_pop_front (&pool->zeroed);
+}
+
+/* Gives all of POOL's pre-zeroed pages, and the page it is
+   zeroing if any, back to its buddy allocator.  Must be called
+   with interrupts off. */
+static void
+release_zeroed (struct pool *pool) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	while (!list_empty (&pool->zeroed)) {
+		void *page = list_pop_front (&pool->zeroed);
+		free_pages (pool, pg_no (page) - pg_no (pool->base), 1);
+	}
+	pool->zeroed_cnt = 0;
+
+	if (pool->zeroing != NULL) {
+		free_pages (pool, pg_no (pool->zeroing) - pg_no (pool->base), 1);
+		pool->zeroing = NULL;
+	}
+}
+
+/* Frees the PAGE_CNT pages in POOL starting at page PAGE_IDX, as
+   the largest aligned blocks that they divide into.  Must be
+   called with interrupts off. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (page_idx + page_cnt <= pool->page_cnt);
+	ASSERT (pages_allocated (pool, page_idx, page_cnt));
+
+	while (page_cnt > 0) {
+		unsigned order = 0;
+
+		while (order < MAX_ORDER
+				&& page_idx % ((size_t) 2 << order) == 0
+				&& ((size_t) 2 << order) <= page_cnt)
+			order++;
+		free_block (pool, page_idx, order);
+		page_idx += (size_t) 1 << order;
+		page_cnt -= (size_t) 1 << order;
+	}
+}
+
+/* Frees the block of 2**ORDER pages in POOL starting at page
+   PAGE_IDX, merging it with its buddy for as long as that is
+   free. */
+static void
+free_block (struct pool *pool, size_t page_idx, unsigned order) {
+	ASSERT (pool->free_order[page_idx] == NOT_FREE);
+
+	for (; order < MAX_ORDER; order++) {
+		size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+		if (buddy + ((size_t) 1 << order) > pool->page_cnt
+				|| pool->free_order[buddy] != order)
+			break;
+		list_remove (block_elem (pool, buddy));
+		pool->free_order[buddy] = NOT_FREE;
+		if (buddy < page_idx)
+			page_idx = buddy;
+	}
+
+	pool->free_order[page_idx] = order;
+	list_push_front (&pool->free[order], block_elem (pool, page_idx));
+}
+
+/* Returns the free list element of the block that starts at page
+   PAGE_IDX in POOL. */
+static struct list_elem *
+block_elem (const struct pool *pool, size_t page_idx) {
+	return &pool->links[page_idx];
+}
+
+/* Returns the index of the page in POOL at which starts the block
+   whose free list element is ELEM. */
+static size_t
+block_idx (const struct pool *pool, const struct list_elem *elem) {
+	return elem - pool->links;
+}
+
+/* Returns true if none of the PAGE_CNT pages in POOL starting at
+   page PAGE_IDX is in a free block.  A page is in a free block of
+   order ORDER only if the block starts at the page's index rounded
+   down to a multiple of 2**ORDER, so each page takes a look at
+   one block start per order. */
+static bool
+pages_allocated (const struct pool *pool, size_t page_idx,
+		size_t page_cnt) {
+	size_t i;
+	unsigned order;
+
+	for (i = page_idx; i < page_idx + page_cnt; i++)
+		for (order = 0; order <= MAX_ORDER; order++) {
+			size_t start = i & ~(((size_t) 1 << order) - 1);
+
+			if (pool->free_order[start] == order)
+				return false;
+		}
+	return true;
+}
@@ -0,0 +1,265 @@
+#include "threads/runqueue.h"
+#include <debug.h>
+#include "threads/cpu.h"
+#include "threads/mlfqs.h"
+#include "threads/thread.h"
+
+/* The bitmap must have a bit for every priority level. */
+#if PRI_MAX - PRI_MIN + 1 != RQ_LEVELS
+#error runqueue bitmap does not cover all priorities
+#endif
+
+/* Completely fair scheduler.
+
+   A thread's weight depends on its priority, with PRI_DEFAULT
+   as "nice 0", each priority level above it as one nice level
+   less, and each level below as one more, clamped to the range
+   of cfs_weights[].  Each timer tick a thread runs adds
+   CFS_TICK * CFS_WEIGHT_0 / weight to its vruntime, so a
+   PRI_DEFAULT thread's vruntime counts CFS_TICK per tick.
+
+   A thread that wakes up, or is new, starts no further behind
+   than CFS_SLEEPER_CREDIT below the run queue's min_vruntime,
+   so that a thread that slept for a long time gets ahead of the
+   others for a little while but cannot monopolize the CPU.
+
+   The running thread is preempted when the leftmost ready thread
+   is behind it, but only after it has run for at least
+   CFS_MIN_GRANULARITY ticks, to keep switches from becoming too
+   frequent. */
+#define CFS_TICK 1024                   /* vruntime per tick at nice 0. */
+#define CFS_WEIGHT_0 1024               /* Weight at nice 0. */
+#define CFS_SLEEPER_CREDIT (3 * CFS_TICK)
+#define CFS_MIN_GRANULARITY 1           /* In timer ticks. */
+
+/* Weights for nice -20...19.  Each nice level is worth about
+   10% of CPU time relative to its neighbors, as in Linux. */
+static const int cfs_weights[40] = {
+	/* -20 */ 88761, 71755, 56483, 46273, 36291,
+	/* -15 */ 29154, 23254, 18705, 14949, 11916,
+	/* -10 */ 9548, 7620, 6100, 4904, 3906,
+	/*  -5 */ 3121, 2501, 1991, 1586, 1277,
+	/*   0 */ 1024, 820, 655, 526, 423,
+	/*   5 */ 335, 272, 215, 172, 137,
+	/*  10 */ 110, 87, 70, 56, 45,
+	/*  15 */ 36, 29, 23, 18, 15,
+};
+
+static rb_less_func vruntime_less;
+static int cfs_weight (const struct thread *);
+static void update_min_vruntime (struct runqueue *, int64_t vruntime);
+
+/* Returns the index of the most significant set bit of BITMAP,
+   which must be nonzero.  Compiles down to a single `bsr'. */
+static inline int
+highest_level (uint64_t bitmap) {
+	ASSERT (bitmap != 0);
+	return 63 - __builtin_clzll (bitmap);
+}
+
+/* Initializes RQ as an empty run queue. */
+void
+runqueue_init (struct runqueue *rq) {
+	int i;
+
+	ASSERT (rq != NULL);
+
+	for (i = 0; i < RQ_LEVELS; i++)
+		list_init (&rq->levels[i]);
+	rq->bitmap = 0;
+	rq->size = 0;
+	list_init (&rq->mlfqs_order);
+	rb_init (&rq->fair, vruntime_less, NULL);
+	rq->min_vruntime = 0;
+}
+
+/* Appends T to the tail of the level for its current priority.
+   T's level is remembered so that it can be found again by
+   runqueue_remove() even if T's priority changes meanwhile.
+   With -mlfqs, T's priority is first brought up to date.
+
+   With -cfs, inserts T into the tree instead, first moving its
+   vruntime from the scale of the CPU it last ran on to RQ's and
+   giving it at most CFS_SLEEPER_CREDIT of lag. */
+void
+runqueue_push (struct runqueue *rq, struct thread *t) {
+	int level;
+
+	if (thread_mlfqs)
+		mlfqs_update (t);
+	level = t->priority - PRI_MIN;
+	ASSERT (0 <= level && level < RQ_LEVELS);
+
+	if (thread_cfs) {
+		int64_t floor = rq->min_vruntime - CFS_SLEEPER_CREDIT;
+
+		if (t->cpu != NULL && &t->cpu->rq != rq)
+			t->vruntime += rq->min_vruntime - t->cpu->rq.min_vruntime;
+		if (t->vruntime < floor)
+			t->vruntime = floor;
+		rb_insert (&rq->fair, &t->fair_elem);
+		t->rq = rq;
+		rq->size++;
+		return;
+	}
+
+	if (thread_mlfqs)
+		list_push_back (&rq->mlfqs_order, &t->mlfqs_elem);
+
+	t->rq = rq;
+	t->rq_level = level;
+	list_push_back (&rq->levels[level], &t->elem);
+	rq->bitmap |= 1ULL << level;
+	rq->size++;
+}
+
+/* Removes T, which must be queued in RQ. */
+void
+runqueue_remove (struct runqueue *rq, struct thread *t) {
+	int level = t->rq_level;
+
+	ASSERT (rq->size > 0);
+
+	if (thread_cfs) {
+		rb_remove (&rq->fair, &t->fair_elem);
+		rq->size--;
+		return;
+	}
+
+	ASSERT (rq->bitmap & (1ULL << level));
+
+	list_remove (&t->elem);
+	if (thread_mlfqs)
+		list_remove (&t->mlfqs_elem);
+	if (list_empty (&rq->levels[level]))
+		rq->bitmap &= ~(1ULL << level);
+	rq->size--;
+}
+
+/* Removes and returns the first thread at the highest non-empty
+   priority level, or a null pointer if RQ is empty.  With -cfs,
+   returns the thread with the least vruntime instead. */
+struct thread *
+runqueue_pop (struct runqueue *rq) {
+	struct thread *t;
+	int level;
+
+	if (runqueue_empty (rq))
+		return NULL;
+
+	if (thread_cfs) {
+		t = rb_entry (rb_min (&rq->fair), struct thread, fair_elem);
+		rb_remove (&rq->fair, &t->fair_elem);
+		rq->size--;
+		update_min_vruntime (rq, t->vruntime);
+		return t;
+	}
+
+	level = highest_level (rq->bitmap);
+	t = list_entry (list_pop_front (&rq->levels[level]), struct thread, elem);
+	if (thread_mlfqs)
+		list_remove (&t->mlfqs_elem);
+	if (list_empty (&rq->levels[level]))
+		rq->bitmap &= ~(1ULL << level);
+	rq->size--;
+	return t;
+}
+
+/* Removes and returns the thread that FROM would run next, for
+   the CPU that owns run queue TO to run instead, or a null
+   pointer if FROM is empty. */
+struct thread *
+runqueue_steal (struct runqueue *from, struct runqueue *to) {
+	struct thread *t = runqueue_pop (from);
+
+	if (t != NULL && thread_cfs)
+		t->vruntime += to->min_vruntime - from->min_vruntime;
+	return t;
+}
+
+/* Returns the highest priority among threads in RQ, or
+   PRI_MIN - 1 if RQ is empty or -cfs is in use. */
+int
+runqueue_max_priority (const struct runqueue *rq) {
+	if (rq->bitmap == 0)
+		return PRI_MIN - 1;
+	return highest_level (rq->bitmap) + PRI_MIN;
+}
+
+/* With -cfs, charges T, which is running on the CPU that owns
+   RQ, for one timer tick, and returns true if T has now run for
+   TICKS ticks, at least its minimum granularity, and should give
+   way to a thread in RQ that has had less.  Returns false
+   without -cfs. */
+bool
+runqueue_charge (struct runqueue *rq, struct thread *t, unsigned ticks) {
+	struct rb_elem *min;
+
+	if (!thread_cfs)
+		return false;
+
+	t->vruntime += (int64_t) CFS_TICK * CFS_WEIGHT_0 / cfs_weight (t);
+
+	min = rb_min (&rq->fair);
+	if (min == NULL) {
+		update_min_vruntime (rq, t->vruntime);
+		return false;
+	} else {
+		const struct thread *next = rb_entry (min, struct thread, fair_elem);
+		update_min_vruntime (rq, next->vruntime < t->vruntime
+				? next->vruntime : t->vruntime);
+		return ticks >= CFS_MIN_GRANULARITY && next->vruntime < t->vruntime;
+	}
+}
+
+/* With -mlfqs, brings up to date the priorities of up to MAX
+   threads in RQ that have missed a second of recent_cpu decay,
+   the longest queued first, and moves each to the back of its
+   new level. */
+void
+runqueue_refresh (struct runqueue *rq, size_t max) {
+	int64_t epoch = mlfqs_epoch ();
+
+	ASSERT (!thread_cfs);
+
+	while (max-- > 0 && !list_empty (&rq->mlfqs_order)) {
+		struct thread *t = list_entry (list_front (&rq->mlfqs_order),
+				struct thread, mlfqs_elem);
+
+		if (t->mlfqs_epoch == epoch)
+			break;
+		runqueue_remove (rq, t);
+		runqueue_push (rq, t);
+	}
+}
+
+/* Orders threads by vruntime. */
+static bool
+vruntime_less (const struct rb_elem *a_, const struct rb_elem *b_,
+		void *aux UNUSED) {
+	const struct thread *a = rb_entry (a_, struct thread, fair_elem);
+	const struct thread *b = rb_entry (b_, struct thread, fair_elem);
+
+	return a->vruntime < b->vruntime;
+}
+
+/* Returns T's CFS weight. */
+static int
+cfs_weight (const struct thread *t) {
+	int nice = PRI_DEFAULT - t->priority;
+
+	if (nice < -20)
+		nice = -20;
+	else if (nice > 19)
+		nice = 19;
+	return cfs_weights[nice + 20];
+}
+
+/* Advances RQ's min_vruntime to VRUNTIME, the least vruntime of
+   any thread running on or queued for RQ's CPU, unless that would
+   move it backward. */
+static void
+update_min_vruntime (struct runqueue *rq, int64_t vruntime) {
+	if (vruntime > rq->min_vruntime)
+		rq->min_vruntime = vruntime;
+}
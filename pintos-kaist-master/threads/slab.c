@@ -0,0 +1,282 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Slab allocator.
+
+   A kmem_cache hands out objects of a single size, so that
+   structures that are allocated and freed often, such as inodes
+   and open files, take exactly the space they need instead of
+   the next power of 2 that malloc() would round them up to.
+   Each cache has its own lock, so allocations of different kinds
+   of objects do not contend with each other.
+
+   A cache gets its memory a page at a time.  Each page, a
+   "slab", starts with a header, followed by an array of indexes
+   that chains its free objects together, followed by the objects
+   themselves.  Keeping the chain out of the objects means that an
+   object keeps whatever state its constructor gave it, or that
+   its last user left it in, while it is free, so the constructor
+   runs only once per object, when its slab is created.
+
+   A slab's header starts with a magic number that differs from
+   malloc()'s arenas', so free() can tell an object that came from
+   a cache and hand it back to the cache.
+
+   A cache keeps its slabs on three lists: slabs with free
+   objects, which allocations take from; slabs with none; and at
+   most one slab with no objects in use, kept so that a cache
+   whose use hovers around a multiple of a slab does not get and
+   free a page over and over.  Other empty slabs go back to the
+   page allocator. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* A slab. */
+struct slab {
+	unsigned magic;             /* Always set to SLAB_MAGIC. */
+	struct kmem_cache *cache;   /* Owning cache. */
+	struct list_elem elem;      /* Element in one of the cache's lists. */
+	size_t in_use;              /* Number of objects allocated. */
+	uint16_t free_head;         /* First free object, or FREE_END. */
+	uint16_t free_next[];       /* Next free object after each. */
+};
+
+/* End of a slab's chain of free objects. */
+#define FREE_END UINT16_MAX
+
+/* All the caches, for statistics. */
+static struct list caches;
+static struct lock caches_lock;
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (const void *);
+static void *slab_obj (const struct slab *, size_t idx);
+
+/* Initializes the slab allocator. */
+void
+kmem_init (void) {
+	list_init (&caches);
+	lock_init (&caches_lock);
+}
+
+/* Initializes CACHE to hand out objects of SIZE bytes, aligned
+   on ALIGN bytes, which must be a power of 2, or 0 for the
+   alignment of a pointer.  Pass CACHE_LINE_SIZE for objects that
+   should not share cache lines.  CTOR, if nonnull, is called on
+   each new object.  NAME is used in statistics and must remain
+   valid while CACHE exists. */
+void
+kmem_cache_init (struct kmem_cache *cache, const char *name, size_t size,
+		size_t align, kmem_ctor *ctor) {
+	size_t n;
+
+	ASSERT (cache != NULL);
+	ASSERT (size > 0);
+	ASSERT ((align & (align - 1)) == 0);
+
+	if (align < sizeof (void *))
+		align = sizeof (void *);
+
+	cache->name = name;
+	cache->obj_size = ROUND_UP (size, align);
+	cache->align = align;
+	cache->ctor = ctor;
+
+	/* Fit as many objects in a slab as will go after the header
+	   and their entries in `free_next'. */
+	for (n = PGSIZE / cache->obj_size; n > 0; n--) {
+		size_t ofs = ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+				align);
+		if (ofs + n * cache->obj_size <= PGSIZE) {
+			cache->first_ofs = ofs;
+			break;
+		}
+	}
+	ASSERT (n > 0);
+	cache->objs_per_slab = n;
+
+	lock_init (&cache->lock);
+	list_init (&cache->partial);
+	list_init (&cache->full);
+	list_init (&cache->empty);
+	cache->alloc_cnt = 0;
+	cache->slab_cnt = cache->in_use = cache->max_in_use = 0;
+
+	lock_acquire (&caches_lock);
+	list_push_back (&caches, &cache->elem);
+	lock_release (&caches_lock);
+}
+
+/* Allocates and returns an object from CACHE, or returns a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *cache) {
+	struct slab *s;
+	size_t idx;
+
+	ASSERT (cache != NULL);
+
+	lock_acquire (&cache->lock);
+	if (list_empty (&cache->partial)) {
+		if (!list_empty (&cache->empty))
+			list_push_back (&cache->partial, list_pop_front (&cache->empty));
+		else {
+			s = slab_create (cache);
+			if (s == NULL) {
+				lock_release (&cache->lock);
+				return NULL;
+			}
+			list_push_back (&cache->partial, &s->elem);
+		}
+	}
+
+	s = list_entry (list_front (&cache->partial), struct slab, elem);
+	idx = s->free_head;
+	ASSERT (idx != FREE_END);
+	s->free_head = s->free_next[idx];
+	if (++s->in_use == cache->objs_per_slab) {
+		list_remove (&s->elem);
+		list_push_back (&cache->full, &s->elem);
+	}
+
+	cache->alloc_cnt++;
+	if (++cache->in_use > cache->max_in_use)
+		cache->max_in_use = cache->in_use;
+	lock_release (&cache->lock);
+
+	return slab_obj (s, idx);
+}
+
+/* Returns OBJ, which must have been allocated from CACHE, to
+   CACHE.  Does nothing if OBJ is a null pointer. */
+void
+kmem_cache_free (struct kmem_cache *cache, void *obj) {
+	struct slab *s;
+	size_t idx;
+
+	if (obj == NULL)
+		return;
+
+	s = obj_to_slab (obj);
+	ASSERT (s->cache == cache);
+	idx = ((uint8_t *) obj - (uint8_t *) s - cache->first_ofs)
+		/ cache->obj_size;
+
+#ifndef NDEBUG
+	/* Clear the object to help detect use-after-free bugs, unless
+	   that would undo its constructor. */
+	if (cache->ctor == NULL)
+		memset (obj, 0xcc, cache->obj_size);
+#endif
+
+	lock_acquire (&cache->lock);
+	ASSERT (s->in_use > 0);
+	s->free_next[idx] = s->free_head;
+	s->free_head = idx;
+	if (s->in_use-- == cache->objs_per_slab) {
+		list_remove (&s->elem);
+		list_push_back (&cache->partial, &s->elem);
+	}
+	if (s->in_use == 0) {
+		list_remove (&s->elem);
+		if (list_empty (&cache->empty))
+			list_push_back (&cache->empty, &s->elem);
+		else {
+			s->magic = 0;
+			cache->slab_cnt--;
+			palloc_free_page (s);
+		}
+	}
+	cache->in_use--;
+	lock_release (&cache->lock);
+}
+
+/* Prints statistics for each cache. */
+void
+kmem_print_stats (void) {
+	struct list_elem *e;
+
+	for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e)) {
+		struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+
+		printf ("Slab %s: %zu-byte objects, %zu per slab, %zu slabs, "
+				"%zu in use (max %zu), %lld allocations\n",
+				c->name, c->obj_size, c->objs_per_slab, c->slab_cnt,
+				c->in_use, c->max_in_use, c->alloc_cnt);
+	}
+}
+
+/* Returns true if BLOCK, which must have been allocated by
+   malloc() or a kmem_cache, came from a kmem_cache. */
+bool
+kmem_owns (const void *block) {
+	const struct slab *s = pg_round_down (block);
+	return s->magic == SLAB_MAGIC;
+}
+
+/* Returns OBJ, which must have been allocated from a kmem_cache,
+   to its cache. */
+void
+kmem_free (void *obj) {
+	kmem_cache_free (obj_to_slab (obj)->cache, obj);
+}
+
+/* Returns the size of OBJ, which must have been allocated from a
+   kmem_cache. */
+size_t
+kmem_size (const void *obj) {
+	return obj_to_slab (obj)->cache->obj_size;
+}
+
+/* Gets a page for a new slab for CACHE and constructs its
+   objects.  Returns the new slab, or a null pointer if memory is
+   not available. */
+static struct slab *
+slab_create (struct kmem_cache *cache) {
+	struct slab *s = palloc_get_page (0);
+	size_t i;
+
+	if (s == NULL)
+		return NULL;
+
+	s->magic = SLAB_MAGIC;
+	s->cache = cache;
+	s->in_use = 0;
+	s->free_head = 0;
+	for (i = 0; i < cache->objs_per_slab; i++) {
+		s->free_next[i] = i + 1 < cache->objs_per_slab ? i + 1 : FREE_END;
+		if (cache->ctor != NULL)
+			cache->ctor (slab_obj (s, i));
+	}
+	cache->slab_cnt++;
+	return s;
+}
+
+/* Returns the slab that OBJ is inside. */
+static struct slab *
+obj_to_slab (const void *obj) {
+	struct slab *s = pg_round_down (obj);
+
+	/* Check that the slab is valid. */
+	ASSERT (s->magic == SLAB_MAGIC);
+
+	/* Check that the object is properly aligned for the slab. */
+	ASSERT (pg_ofs (obj) >= s->cache->first_ofs);
+	ASSERT ((pg_ofs (obj) - s->cache->first_ofs) % s->cache->obj_size == 0);
+
+	return s;
+}
+
+/* Returns the IDX'th object in slab S. */
+static void *
+slab_obj (const struct slab *s, size_t idx) {
+	ASSERT (idx < s->cache->objs_per_slab);
+	return (uint8_t *) s + s->cache->first_ofs + idx * s->cache->obj_size;
+}
@@ -0,0 +1,287 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/fpu.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/syscall.h"
+#include "userprog/tss.h"
+#include "intrinsic.h"
+#endif
+
+/* Multiprocessor support.
+
+   The BSP finds the other CPUs in the BIOS's MultiProcessor
+   Specification tables [MP], then starts them one at a time
+   through their local APICs.  Each AP comes up in ap-start.S,
+   on the page of an idle thread that the BSP prepared for it,
+   and ends up in ap_main(), which finishes setting up the CPU
+   and enters the scheduler's idle loop.  From then on the AP
+   runs whatever threads the scheduler gives it. */
+
+/* All the CPUs, of which the first CPU_CNT are online. */
+struct cpu cpus[CPU_MAX];
+int cpu_cnt = 1;
+
+/* -cpus=N: Maximum number of CPUs to use. */
+int cpu_limit = CPU_MAX;
+
+/* MP floating pointer structure.  See [MP] 4.1. */
+struct mp_fps {
+	char signature[4];          /* "_MP_". */
+	uint32_t config;            /* Physical address of configuration table. */
+	uint8_t length;             /* In 16-byte units. */
+	uint8_t spec_rev;           /* MP specification revision. */
+	uint8_t checksum;           /* All bytes must add up to 0. */
+	uint8_t type;               /* Default configuration type, or 0. */
+	uint8_t features;           /* IMCR present, etc. */
+	uint8_t reserved[3];
+} __attribute__ ((packed));
+
+/* MP configuration table header.  See [MP] 4.2. */
+struct mp_config {
+	char signature[4];          /* "PCMP". */
+	uint16_t length;            /* Length of base table, with header. */
+	uint8_t spec_rev;           /* MP specification revision. */
+	uint8_t checksum;           /* All bytes must add up to 0. */
+	char oem_id[8];
+	char product_id[12];
+	uint32_t oem_table;
+	uint16_t oem_table_size;
+	uint16_t entry_cnt;         /* Number of entries that follow. */
+	uint32_t lapic_addr;        /* Physical address of local APICs. */
+	uint16_t ext_length;
+	uint8_t ext_checksum;
+	uint8_t reserved;
+} __attribute__ ((packed));
+
+/* MP configuration table processor entry.  See [MP] 4.3.1.
+   Entries of all other types are 8 bytes long. */
+struct mp_proc {
+	uint8_t type;               /* MP_PROC. */
+	uint8_t apic_id;            /* Local APIC ID. */
+	uint8_t apic_version;
+	uint8_t flags;              /* MP_PROC_* flags. */
+	uint32_t signature;
+	uint32_t features;
+	uint32_t reserved[2];
+} __attribute__ ((packed));
+
+#define MP_PROC 0               /* Processor entry type. */
+#define MP_PROC_ENABLED 0x01    /* Usable processor. */
+#define MP_PROC_BSP 0x02        /* Bootstrap processor. */
+
+/* Startup code in ap-start.S. */
+extern char ap_start[], ap_start_end[];
+extern char ap_start_cr3[], ap_start_pml4[], ap_start_stack[];
+
+/* Loader's page table, from start.S. */
+extern uint64_t boot_pml4e[];
+
+/* Where the AP being started finds its stack. */
+static uint64_t *ap_stack;
+
+void ap_main (void) NO_RETURN;
+static int mp_detect (uint8_t apic_ids[], uint64_t *lapic_addr);
+static struct mp_fps *mp_search (void);
+static struct mp_fps *mp_search_range (uint64_t paddr, size_t size);
+static uint8_t checksum (const void *, size_t);
+static void install_trampoline (void);
+static bool cpu_start (struct cpu *, uint8_t apic_id);
+
+/* Finds the other CPUs and starts up to cpu_limit of them in
+   total.  Must be called by the BSP with interrupts on, after
+   everything that an AP's ap_main() relies upon is set up. */
+void
+smp_init (void) {
+	uint8_t apic_ids[CPU_MAX];
+	uint64_t lapic_addr;
+	int found, i;
+
+	ASSERT (intr_get_level () == INTR_ON);
+	ASSERT (cpu_cnt == 1);
+
+	found = mp_detect (apic_ids, &lapic_addr);
+	if (found < 2 || cpu_limit < 2)
+		return;
+
+	lapic_map (lapic_addr);
+	lapic_init (true);
+	cpus[0].apic_id = lapic_id ();
+	install_trampoline ();
+
+	for (i = 0; i < found && i < CPU_MAX; i++) {
+		if (cpu_cnt >= cpu_limit)
+			break;
+		if (apic_ids[i] == cpus[0].apic_id)
+			continue;
+		if (!cpu_start (&cpus[cpu_cnt], apic_ids[i]))
+			break;
+		cpu_cnt++;
+	}
+	printf ("SMP: %d of %d CPUs online.\n", cpu_cnt, found);
+}
+
+/* Brings up CPU C, whose local APIC ID is APIC_ID, and waits
+   for it to finish booting.  Returns true if successful, false
+   on failure. */
+static bool
+cpu_start (struct cpu *c, uint8_t apic_id) {
+	int i;
+
+	c->id = c - cpus;
+	c->apic_id = apic_id;
+	if (!thread_prepare_ap (c))
+		return false;
+#ifdef USERPROG
+	tss_init_ap (c);
+#endif
+
+	*ap_stack = (uint64_t) c->idle_thread + PGSIZE;
+	lapic_start_ap (apic_id, LOADER_AP_START);
+
+	/* Give it a second. */
+	for (i = 0; i < 1000 && !c->started; i++)
+		timer_msleep (1);
+	if (!c->started) {
+		printf ("SMP: CPU with APIC ID %d did not start.\n", apic_id);
+		return false;
+	}
+	return true;
+}
+
+/* Copies the AP startup code to LOADER_AP_START and fills in the
+   page tables it is to use. */
+static void
+install_trampoline (void) {
+	uint8_t *code = ptov (LOADER_AP_START);
+
+	ASSERT (ap_start_end - ap_start <= PGSIZE);
+
+	memcpy (code, ap_start, ap_start_end - ap_start);
+	*(uint32_t *) (code + (ap_start_cr3 - ap_start)) = vtop (boot_pml4e);
+	*(uint64_t *) (code + (ap_start_pml4 - ap_start)) = vtop (base_pml4);
+	ap_stack = (uint64_t *) (code + (ap_start_stack - ap_start));
+}
+
+/* C entry point of an AP, called by ap-start.S on the page of
+   the idle thread that thread_prepare_ap() set up for it, with
+   interrupts off.  Finishes initializing the CPU, then becomes
+   its idle thread. */
+void
+ap_main (void) {
+	struct cpu *c = cpu_current ();
+
+	thread_init_ap ();
+	intr_init_ap ();
+	fpu_init_ap ();
+#ifdef USERPROG
+	gdt_init ();
+	ltr (SEL_TSS);
+	syscall_init ();
+#endif
+	lapic_init (false);
+
+	ASSERT (lapic_id () == c->apic_id);
+	c->started = true;
+
+	thread_start_ap ();
+}
+
+/* Looks for the MP configuration table, and stores the local
+   APIC IDs of up to CPU_MAX usable processors in APIC_IDS[] and
+   the physical address of the local APICs in *LAPIC_ADDR.
+   Returns the number of usable processors, which may be greater
+   than CPU_MAX, or 0 if there is no usable table. */
+static int
+mp_detect (uint8_t apic_ids[], uint64_t *lapic_addr) {
+	struct mp_fps *fps;
+	struct mp_config *conf;
+	uint8_t *p, *end;
+	int cnt = 0;
+	int i;
+
+	fps = mp_search ();
+	if (fps == NULL || fps->config == 0 || fps->type != 0)
+		return 0;
+	/* BIOSes put the table in low memory, which is all we can be
+	   sure is mapped. */
+	if (fps->config >= 0x100000)
+		return 0;
+
+	conf = ptov (fps->config);
+	if (memcmp (conf->signature, "PCMP", 4)
+			|| (conf->spec_rev != 1 && conf->spec_rev != 4)
+			|| checksum (conf, conf->length) != 0)
+		return 0;
+	*lapic_addr = conf->lapic_addr;
+
+	p = (uint8_t *) (conf + 1);
+	end = (uint8_t *) conf + conf->length;
+	for (i = 0; i < conf->entry_cnt && p < end; i++) {
+		if (*p == MP_PROC) {
+			struct mp_proc *proc = (struct mp_proc *) p;
+			if (proc->flags & MP_PROC_ENABLED) {
+				if (cnt < CPU_MAX)
+					apic_ids[cnt] = proc->apic_id;
+				cnt++;
+			}
+			p += sizeof *proc;
+		} else
+			p += 8;
+	}
+	return cnt;
+}
+
+/* Searches for the MP floating pointer structure where [MP] 4
+   says it may be: in the first kilobyte of the extended BIOS
+   data area, or else in the last kilobyte of base memory, or
+   else in the BIOS ROM between 0xf0000 and 0xfffff. */
+static struct mp_fps *
+mp_search (void) {
+	const uint8_t *bda = ptov (0x400);
+	struct mp_fps *fps;
+	uint64_t paddr;
+
+	paddr = (uint64_t) ((bda[0x0f] << 8) | bda[0x0e]) << 4;
+	if (paddr != 0)
+		fps = mp_search_range (paddr, 1024);
+	else {
+		paddr = (uint64_t) ((bda[0x14] << 8) | bda[0x13]) * 1024;
+		fps = mp_search_range (paddr - 1024, 1024);
+	}
+	return fps != NULL ? fps : mp_search_range (0xf0000, 0x10000);
+}
+
+/* Searches for the MP floating pointer structure in the SIZE
+   bytes of physical memory starting at PADDR. */
+static struct mp_fps *
+mp_search_range (uint64_t paddr, size_t size) {
+	uint8_t *p = ptov (paddr);
+	uint8_t *end = p + size;
+
+	for (; p + sizeof (struct mp_fps) <= end; p += 16)
+		if (!memcmp (p, "_MP_", 4)
+				&& checksum (p, sizeof (struct mp_fps)) == 0)
+			return (struct mp_fps *) p;
+	return NULL;
+}
+
+/* Returns the sum of the SIZE bytes starting at P. */
+static uint8_t
+checksum (const void *p_, size_t size) {
+	const uint8_t *p = p_;
+	uint8_t sum = 0;
+
+	while (size-- > 0)
+		sum += *p++;
+	return sum;
+}
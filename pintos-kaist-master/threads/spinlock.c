@@ -0,0 +1,72 @@
+#include "threads/spinlock.h"
+#include <debug.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+
+/* Initializes L as a free spin lock named NAME. */
+void
+spin_init (struct spinlock *l, const char *name) {
+	ASSERT (l != NULL);
+
+	l->locked = 0;
+	l->cpu = NULL;
+	l->name = name;
+}
+
+/* Acquires L, busy-waiting until it becomes available.  L must
+   not already be held by the running CPU.
+
+   Interrupts must be off, so that we cannot be preempted or
+   interrupted while holding L. */
+void
+spin_acquire (struct spinlock *l) {
+	ASSERT (l != NULL);
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (!spin_held (l));
+
+	/* `xchg' with a memory operand is implicitly locked, and
+	   serves as a full memory barrier.  Spin on plain reads while
+	   the lock is held, so that waiting CPUs do not keep pulling
+	   the cache line away from the holder, and use `pause' to let
+	   the processor know that this is a spin-wait loop.  See
+	   [IA32-v2b] "XCHG" and "PAUSE". */
+	while (__atomic_exchange_n (&l->locked, 1, __ATOMIC_ACQUIRE) != 0)
+		while (l->locked)
+			asm volatile ("pause" : : : "memory");
+	l->cpu = cpu_current ();
+}
+
+/* Tries to acquire L and returns true if successful or false on
+   failure.  L must not already be held by the running CPU, and
+   interrupts must be off. */
+bool
+spin_try_acquire (struct spinlock *l) {
+	ASSERT (l != NULL);
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (!spin_held (l));
+
+	if (__atomic_exchange_n (&l->locked, 1, __ATOMIC_ACQUIRE) != 0)
+		return false;
+	l->cpu = cpu_current ();
+	return true;
+}
+
+/* Releases L, which must be held by the running CPU. */
+void
+spin_release (struct spinlock *l) {
+	ASSERT (l != NULL);
+	ASSERT (spin_held (l));
+
+	l->cpu = NULL;
+	__atomic_store_n (&l->locked, 0, __ATOMIC_RELEASE);
+}
+
+/* Returns true if the running CPU holds L, false otherwise.
+   (Note that testing whether some other CPU holds a lock would
+   be racy.) */
+bool
+spin_held (const struct spinlock *l) {
+	ASSERT (l != NULL);
+
+	return l->locked && l->cpu == cpu_current ();
+}
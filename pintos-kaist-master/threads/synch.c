@@ -32,6 +32,36 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Waiters on semaphores and condition variables are kept in a
+   heap ordered by priority, so that the highest-priority waiter
+   is the one woken up, and is found in constant time.  Waiters
+   of equal priority are woken in the order they arrived, by
+   `wait_seq'.  A waiter whose priority changes while it waits,
+   through priority donation, is moved to its new place by
+   thread_reprioritize().
+
+   With priority donation, a thread that waits for a lock lends
+   its priority to the lock's holder, and if that thread is in
+   turn waiting for a lock, to its holder too, and so on, up to
+   DONATION_DEPTH threads.  A thread keeps the locks it holds in
+   `held_locks', so that when it releases one, its priority can
+   be recomputed from the top waiters of the others, and a thread
+   that acquires a lock takes on the donations of the threads
+   still waiting for it. */
+
+/* Maximum length of a chain of donations. */
+#define DONATION_DEPTH 8
+
+/* Next `wait_seq' to hand out. */
+static uint64_t wait_seq;
+
+static bool waiter_less (const struct heap_elem *, const struct heap_elem *,
+		void *aux);
+static void waiter_push (struct heap *, struct thread *);
+static struct thread *waiter_pop (struct heap *);
+static void donate_priority (struct thread *);
+static void rw_wake (struct rwlock *, bool readers_first);
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -46,7 +76,7 @@ sema_init (struct semaphore *sema, unsigned value) {
 	ASSERT (sema != NULL);
 
 	sema->value = value;
-	list_init (&sema->waiters);
+	heap_init (&sema->waiters, waiter_less, NULL);
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -66,7 +96,7 @@ sema_down (struct semaphore *sema) {
 
 	old_level = intr_disable ();
 	while (sema->value == 0) {
-		list_push_back (&sema->waiters, &thread_current ()->elem);
+		waiter_push (&sema->waiters, thread_current ());
 		thread_block ();
 	}
 	sema->value--;
@@ -99,7 +129,8 @@ sema_try_down (struct semaphore *sema) {
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, yielding to it if it outranks the running thread.
 
    This function may be called from an interrupt handler. */
 void
@@ -109,11 +140,12 @@ sema_up (struct semaphore *sema) {
 	ASSERT (sema != NULL);
 
 	old_level = intr_disable ();
-	if (!list_empty (&sema->waiters))
-		thread_unblock (list_entry (list_pop_front (&sema->waiters),
-					struct thread, elem));
+	if (!heap_empty (&sema->waiters))
+		thread_unblock (waiter_pop (&sema->waiters));
 	sema->value++;
 	intr_set_level (old_level);
+
+	thread_yield_if_outranked ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -165,7 +197,11 @@ sema_test_helper (void *sema_) {
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   Unlike a semaphore, a lock donates the priority of the threads
+   waiting for it to its holder (except with -mlfqs, where
+   priorities are computed by the scheduler). */
 void
 lock_init (struct lock *lock) {
 	ASSERT (lock != NULL);
@@ -184,12 +220,34 @@ lock_init (struct lock *lock) {
    we need to sleep. */
 void
 lock_acquire (struct lock *lock) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (!lock_held_by_current_thread (lock));
 
-	sema_down (&lock->semaphore);
-	lock->holder = thread_current ();
+	/* Not sema_down(), because each time the lock turns out to be
+	   taken, possibly by a thread that got to it ahead of the
+	   waiter lock_release() woke up, this thread must donate to
+	   whoever holds it then. */
+	old_level = intr_disable ();
+	while (lock->semaphore.value == 0) {
+		curr->wait_lock = lock;
+		waiter_push (&lock->semaphore.waiters, curr);
+		if (!thread_mlfqs)
+			donate_priority (curr);
+		thread_block ();
+	}
+	lock->semaphore.value--;
+	curr->wait_lock = NULL;
+	lock->holder = curr;
+	list_push_back (&curr->held_locks, &lock->elem);
+
+	/* Take on the donations of the threads still waiting. */
+	if (!thread_mlfqs)
+		thread_refresh_priority (curr);
+	intr_set_level (old_level);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -200,14 +258,19 @@ lock_acquire (struct lock *lock) {
    interrupt handler. */
 bool
 lock_try_acquire (struct lock *lock) {
+	enum intr_level old_level;
 	bool success;
 
 	ASSERT (lock != NULL);
 	ASSERT (!lock_held_by_current_thread (lock));
 
+	old_level = intr_disable ();
 	success = sema_try_down (&lock->semaphore);
-	if (success)
+	if (success) {
 		lock->holder = thread_current ();
+		list_push_back (&lock->holder->held_locks, &lock->elem);
+	}
+	intr_set_level (old_level);
 	return success;
 }
 
@@ -219,11 +282,23 @@ lock_try_acquire (struct lock *lock) {
    handler. */
 void
 lock_release (struct lock *lock) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+
 	ASSERT (lock != NULL);
 	ASSERT (lock_held_by_current_thread (lock));
 
+	/* Give back the donations of the threads waiting for LOCK. */
+	old_level = intr_disable ();
+	list_remove (&lock->elem);
+	if (!thread_mlfqs)
+		thread_refresh_priority (curr);
+
 	lock->holder = NULL;
 	sema_up (&lock->semaphore);
+	intr_set_level (old_level);
+
+	thread_yield_if_outranked ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -236,12 +311,6 @@ lock_held_by_current_thread (const struct lock *lock) {
 	return lock->holder == thread_current ();
 }
 
-/* One semaphore in a list. */
-struct semaphore_elem {
-	struct list_elem elem;              /* List element. */
-	struct semaphore semaphore;         /* This semaphore. */
-};
-
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -249,7 +318,7 @@ void
 cond_init (struct condition *cond) {
 	ASSERT (cond != NULL);
 
-	list_init (&cond->waiters);
+	heap_init (&cond->waiters, waiter_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -274,23 +343,26 @@ cond_init (struct condition *cond) {
    we need to sleep. */
 void
 cond_wait (struct condition *cond, struct lock *lock) {
-	struct semaphore_elem waiter;
+	enum intr_level old_level;
 
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
 
-	sema_init (&waiter.semaphore, 0);
-	list_push_back (&cond->waiters, &waiter.elem);
+	/* Interrupts stay off from joining the waiters until
+	   blocking, so that a signal in between is not lost. */
+	old_level = intr_disable ();
+	waiter_push (&cond->waiters, thread_current ());
 	lock_release (lock);
-	sema_down (&waiter.semaphore);
+	thread_block ();
+	intr_set_level (old_level);
 	lock_acquire (lock);
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the highest-priority one to wake up from
+   its wait.  LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -302,9 +374,11 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED) {
 	ASSERT (!intr_context ());
 	ASSERT (lock_held_by_current_thread (lock));
 
-	if (!list_empty (&cond->waiters))
-		sema_up (&list_entry (list_pop_front (&cond->waiters),
-					struct semaphore_elem, elem)->semaphore);
+	if (!heap_empty (&cond->waiters)) {
+		enum intr_level old_level = intr_disable ();
+		thread_unblock (waiter_pop (&cond->waiters));
+		intr_set_level (old_level);
+	}
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -318,6 +392,249 @@ cond_broadcast (struct condition *cond, struct lock *lock) {
 	ASSERT (cond != NULL);
 	ASSERT (lock != NULL);
 
-	while (!list_empty (&cond->waiters))
+	while (!heap_empty (&cond->waiters))
 		cond_signal (cond, lock);
 }
+
+/* Initializes readers-writer lock RW, with POLICY.  Any number
+   of threads may hold RW for reading at once, or a single thread
+   for writing.
+
+   A thread that wants to read waits if RW is held for writing,
+   and also if any thread is waiting to write, so that a steady
+   stream of readers cannot starve writers.  When a writer
+   releases RW, either the next writer or every thread then
+   waiting to read gets RW, depending on POLICY:
+
+   - RWLOCK_FAIR: the readers go first, as one batch, and the
+     writer gets RW once the last of them releases it.  Readers
+     and writers thus take turns, and neither can starve.
+
+   - RWLOCK_PREFER_WRITERS: the writer goes first.  Readers wait
+     until no thread is waiting to write, so they may starve if
+     writes are frequent.
+
+   Waiting threads are woken in priority order, and the lock is
+   handed to them directly, so that they need not compete for it
+   again when they run.  Unlike a lock, a readers-writer lock
+   does not donate priority. */
+void
+rw_init (struct rwlock *rw, enum rwlock_policy policy) {
+	ASSERT (rw != NULL);
+
+	rw->writer = NULL;
+	rw->readers = 0;
+	rw->policy = policy;
+	heap_init (&rw->read_waiters, waiter_less, NULL);
+	heap_init (&rw->write_waiters, waiter_less, NULL);
+}
+
+/* Acquires RW for reading, sleeping until it becomes available
+   if necessary.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rw_read_acquire (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rw_write_held_by_current_thread (rw));
+
+	old_level = intr_disable ();
+	if (rw->writer == NULL && heap_empty (&rw->write_waiters))
+		rw->readers++;
+	else {
+		/* rw_wake() counts us as a reader before waking us. */
+		waiter_push (&rw->read_waiters, thread_current ());
+		thread_block ();
+	}
+	intr_set_level (old_level);
+}
+
+/* Tries to acquire RW for reading, without sleeping.  Returns
+   true if successful, false if RW is held for writing or a
+   thread is waiting to write.
+
+   This function may be called from an interrupt handler. */
+bool
+rw_try_read_acquire (struct rwlock *rw) {
+	enum intr_level old_level;
+	bool success;
+
+	ASSERT (rw != NULL);
+
+	old_level = intr_disable ();
+	success = rw->writer == NULL && heap_empty (&rw->write_waiters);
+	if (success)
+		rw->readers++;
+	intr_set_level (old_level);
+
+	return success;
+}
+
+/* Releases RW, which the current thread must hold for
+   reading. */
+void
+rw_read_release (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+
+	old_level = intr_disable ();
+	ASSERT (rw->readers > 0);
+	if (--rw->readers == 0)
+		rw_wake (rw, false);
+	intr_set_level (old_level);
+
+	thread_yield_if_outranked ();
+}
+
+/* Acquires RW for writing, sleeping until it becomes available
+   if necessary.  RW must not already be held by the current
+   thread.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rw_write_acquire (struct rwlock *rw) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (!intr_context ());
+	ASSERT (!rw_write_held_by_current_thread (rw));
+
+	old_level = intr_disable ();
+	if (rw->writer == NULL && rw->readers == 0)
+		rw->writer = curr;
+	else {
+		/* rw_wake() makes us the writer before waking us. */
+		waiter_push (&rw->write_waiters, curr);
+		thread_block ();
+	}
+	ASSERT (rw->writer == curr);
+	intr_set_level (old_level);
+}
+
+/* Tries to acquire RW for writing, without sleeping.  Returns
+   true if successful, false if RW is held by any thread. */
+bool
+rw_try_write_acquire (struct rwlock *rw) {
+	enum intr_level old_level;
+	bool success;
+
+	ASSERT (rw != NULL);
+	ASSERT (!rw_write_held_by_current_thread (rw));
+
+	old_level = intr_disable ();
+	success = rw->writer == NULL && rw->readers == 0;
+	if (success)
+		rw->writer = thread_current ();
+	intr_set_level (old_level);
+
+	return success;
+}
+
+/* Releases RW, which the current thread must hold for
+   writing. */
+void
+rw_write_release (struct rwlock *rw) {
+	enum intr_level old_level;
+
+	ASSERT (rw != NULL);
+	ASSERT (rw_write_held_by_current_thread (rw));
+
+	old_level = intr_disable ();
+	rw->writer = NULL;
+	rw_wake (rw, rw->policy == RWLOCK_FAIR);
+	intr_set_level (old_level);
+
+	thread_yield_if_outranked ();
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rw_write_held_by_current_thread (const struct rwlock *rw) {
+	ASSERT (rw != NULL);
+
+	return rw->writer == thread_current ();
+}
+
+/* Hands free readers-writer lock RW to the threads waiting for
+   it, if any: to all of the waiting readers at once if
+   READERS_FIRST is true or no thread is waiting to write,
+   otherwise to the next writer. */
+static void
+rw_wake (struct rwlock *rw, bool readers_first) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (rw->writer == NULL && rw->readers == 0);
+
+	if ((readers_first || heap_empty (&rw->write_waiters))
+			&& !heap_empty (&rw->read_waiters)) {
+		while (!heap_empty (&rw->read_waiters)) {
+			rw->readers++;
+			thread_unblock (waiter_pop (&rw->read_waiters));
+		}
+	} else if (!heap_empty (&rw->write_waiters)) {
+		rw->writer = waiter_pop (&rw->write_waiters);
+		thread_unblock (rw->writer);
+	}
+}
+
+/* Orders waiters by descending priority, then by order of
+   arrival. */
+static bool
+waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+		void *aux UNUSED) {
+	const struct thread *a = heap_entry (a_, struct thread, wait_elem);
+	const struct thread *b = heap_entry (b_, struct thread, wait_elem);
+
+	if (a->priority != b->priority)
+		return a->priority > b->priority;
+	return a->wait_seq < b->wait_seq;
+}
+
+/* Adds T to WAITERS.  Must be called with interrupts off. */
+static void
+waiter_push (struct heap *waiters, struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	t->wait_seq = wait_seq++;
+	t->wait_heap = waiters;
+	heap_push (waiters, &t->wait_elem);
+}
+
+/* Removes and returns the highest-priority thread in non-empty
+   WAITERS.  Must be called with interrupts off. */
+static struct thread *
+waiter_pop (struct heap *waiters) {
+	struct thread *t;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	t = heap_entry (heap_pop (waiters), struct thread, wait_elem);
+	t->wait_heap = NULL;
+	return t;
+}
+
+/* Lends T's priority to the holder of the lock T is waiting for,
+   and on down the chain of holders that are themselves waiting
+   for locks.  Must be called with interrupts off. */
+static void
+donate_priority (struct thread *t) {
+	int depth;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (depth = 0; depth < DONATION_DEPTH && t->wait_lock != NULL; depth++) {
+		struct thread *holder = t->wait_lock->holder;
+
+		if (holder == NULL || holder->priority >= t->priority)
+			break;
+		thread_reprioritize (holder, t->priority);
+		t = holder;
+	}
+}
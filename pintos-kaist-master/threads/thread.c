@@ -4,12 +4,20 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include <syscall-nr.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
+#include "threads/malloc.h"
+#include "threads/mlfqs.h"
 #include "threads/palloc.h"
+#include "threads/runqueue.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
+#include "devices/timer.h"
 #include "intrinsic.h"
 #ifdef USERPROG
 #include "userprog/process.h"
@@ -24,12 +32,11 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* Idle thread. */
-static struct thread *idle_thread;
+/* Processes in THREAD_READY state, that is, processes that are
+   ready to run but not actually running, are kept in the `rq'
+   run queue of some CPU, indexed by priority.  Each CPU also has
+   its own idle thread, and its own time slice and statistics;
+   see struct cpu. */
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -40,27 +47,105 @@ static struct lock tid_lock;
 /* Thread destruction requests */
 static struct list destruction_req;
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
+/* Pages of dead threads, kept for reuse by thread_create() so
+   that spawning a thread need not go through the page allocator
+   or zero a whole page.  Only init_thread()'s part of a recycled
+   page, plus the top of the stack, has to be reset.  Accessed
+   with interrupts off. */
+#define THREAD_CACHE_MAX 8      /* Maximum number of cached pages. */
+static void *thread_cache[THREAD_CACHE_MAX];
+static size_t thread_cache_cnt;
+static long long thread_cache_hits;     /* Pages reused from the cache. */
+static long long thread_cache_misses;   /* Pages from palloc_get_page(). */
 
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+
+/* Scheduler trace.  With -sched-trace, schedule() logs each
+   decision it makes, and thread_unblock() each wakeup, in a ring
+   buffer that keeps the last
+   SCHED_TRACE_SIZE, which thread_sched_trace_dump() prints at
+   power off or on panic.  Only touched with interrupts off. */
+#define SCHED_TRACE_SIZE 1024   /* Number of events kept. */
+
+/* Why a thread gave up the CPU, or SCHED_WAKEUP for a thread
+   that became ready. */
+enum sched_reason {
+	SCHED_BLOCK,                /* thread_block(). */
+	SCHED_YIELD,                /* thread_yield(). */
+	SCHED_PREEMPT,              /* thread_preempt(). */
+	SCHED_EXIT,                 /* thread_exit(). */
+	SCHED_WAKEUP                /* thread_unblock(). */
+};
+
+/* A scheduling decision or a wakeup. */
+struct sched_event {
+	uint64_t tsc;               /* Time stamp counter. */
+	tid_t prev;                 /* Thread that gave up the CPU, or
+	                               that was running at a wakeup. */
+	tid_t next;                 /* Thread chosen, possibly PREV, or
+	                               thread woken up. */
+	uint16_t rq_len;            /* Threads left in the run queue. */
+	uint8_t cpu;                /* CPU that made the decision. */
+	uint8_t reason;             /* An `enum sched_reason'. */
+};
+
+static struct sched_event sched_trace[SCHED_TRACE_SIZE];
+static uint64_t sched_trace_cnt;        /* Events ever logged. */
+
+/* CPU accounting.  Each thread's run and ready-wait times, in
+   TSC cycles, are charged by schedule() as the thread changes
+   state.  Wakeup latency, from thread_unblock() until the thread
+   runs, is kept in a histogram whose bucket N counts latencies
+   of 2**N to 2**(N+1) - 1 cycles.  Only touched with interrupts
+   off. */
+static long long voluntary_switches;    /* All threads, blocked or yielded. */
+static long long involuntary_switches;  /* All threads, preempted. */
+static long long latency_hist[SCHED_LATENCY_BUCKETS];
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If true, use the completely fair scheduler; see runqueue.c.
+   Controlled by kernel command-line option "-cfs". */
+bool thread_cfs;
+
+/* If false (default), use switch_fast() for thread switches.
+   If true, switch through a full intr_frame and iretq.
+   Controlled by kernel command-line option "-iret-switch". */
+bool thread_iret_switch;
+
+/* If true, log scheduling decisions for thread_sched_trace_dump().
+   Controlled by kernel command-line option "-sched-trace". */
+bool thread_sched_trace;
+
+/* Thread switch routines, in switch.S. */
+void switch_fast (uint64_t *prev_rsp, uint64_t next_rsp,
+		struct intr_frame *tf);
+void switch_resume (uint64_t next_rsp, struct intr_frame *tf) NO_RETURN;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
+static intr_handler_func reschedule_ipi;
+static struct cpu *select_cpu (struct thread *);
+static size_t cpu_load (const struct cpu *);
+static struct thread *steal_thread (struct cpu *);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
+static struct thread *thread_page_alloc (void);
+static void thread_page_free (struct thread *);
 static void do_schedule(int status);
 static void schedule (void);
+static void sched_trace_log (struct cpu *, struct thread *prev,
+		struct thread *next);
+static void sched_trace_wakeup (struct cpu *, struct thread *);
+static void sched_account (struct cpu *, struct thread *prev,
+		struct thread *next);
+static intr_handler_func sched_stat_intr;
 static tid_t allocate_tid (void);
 
 /* Returns true if T appears to point to a valid thread. */
@@ -107,16 +192,57 @@ thread_init (void) {
 
 	/* Init the globla thread context */
 	lock_init (&tid_lock);
-	list_init (&ready_list);
 	list_init (&destruction_req);
+	runqueue_init (&cpus[0].rq);
+	cpus[0].started = true;
 
 	/* Set up a thread structure for the running thread. */
 	initial_thread = running_thread ();
 	init_thread (initial_thread, "main", PRI_DEFAULT);
 	initial_thread->status = THREAD_RUNNING;
+	initial_thread->cpu = &cpus[0];
+	cpus[0].curr = initial_thread;
 	initial_thread->tid = allocate_tid ();
 }
 
+/* Sets up the idle thread of AP C in a new page, whose top also
+   serves as the AP's boot stack, and initializes C's run queue.
+   Returns true if successful, false if out of memory.  Called
+   by the BSP before starting C. */
+bool
+thread_prepare_ap (struct cpu *c) {
+	struct thread *t;
+	char name[16];
+
+	t = palloc_get_page (PAL_ZERO);
+	if (t == NULL)
+		return false;
+
+	snprintf (name, sizeof name, "idle%d", c->id);
+	init_thread (t, name, PRI_MIN);
+	t->tid = allocate_tid ();
+	t->status = THREAD_RUNNING;
+	t->cpu = c;
+
+	runqueue_init (&c->rq);
+	c->idle_thread = c->curr = t;
+	return true;
+}
+
+/* Like thread_init(), for an AP, which is already running as
+   the idle thread that thread_prepare_ap() set up. */
+void
+thread_init_ap (void) {
+	struct desc_ptr gdt_ds = {
+		.size = sizeof (gdt) - 1,
+		.address = (uint64_t) gdt
+	};
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	lgdt (&gdt_ds);
+}
+
 /* Starts preemptive thread scheduling by enabling interrupts.
    Also creates the idle thread. */
 void
@@ -126,6 +252,10 @@ thread_start (void) {
 	sema_init (&idle_started, 0);
 	thread_create ("idle", PRI_MIN, idle, &idle_started);
 
+	intr_register_ipi (LAPIC_IPI_RESCHED, reschedule_ipi, "Reschedule IPI");
+	intr_register_int (0x45, 3, INTR_OFF, sched_stat_intr,
+			"Inspect Scheduler Statistics");
+
 	/* Start preemptive thread scheduling. */
 	intr_enable ();
 
@@ -133,32 +263,150 @@ thread_start (void) {
 	sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+/* Makes an AP that has finished booting start running threads.
+   Interrupts must be off. */
+void
+thread_start_ap (void) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	idle_loop ();
+}
+
+/* Called by the timer interrupt handler at each timer tick,
+   on every CPU.  Thus, this function runs in an external
+   interrupt context. */
 void
 thread_tick (void) {
 	struct thread *t = thread_current ();
+	struct cpu *c = cpu_current ();
 
 	/* Update statistics. */
-	if (t == idle_thread)
-		idle_ticks++;
+	if (t == c->idle_thread)
+		c->idle_ticks++;
 #ifdef USERPROG
 	else if (t->pml4 != NULL)
-		user_ticks++;
+		c->user_ticks++;
 #endif
 	else
-		kernel_ticks++;
+		c->kernel_ticks++;
 
 	/* Enforce preemption. */
-	if (++thread_ticks >= TIME_SLICE)
+	c->thread_ticks++;
+	if (thread_cfs) {
+		if (t != c->idle_thread
+				&& runqueue_charge (&c->rq, t, c->thread_ticks))
+			intr_yield_on_return ();
+	} else if (thread_mlfqs) {
+		if (mlfqs_tick () || c->thread_ticks >= TIME_SLICE)
+			intr_yield_on_return ();
+	} else if (c->thread_ticks >= TIME_SLICE)
 		intr_yield_on_return ();
 }
 
+/* Accounts for SKIPPED timer ticks that went by, without timer
+   interrupts, while the idle thread had the periodic tick
+   stopped.  Called from the timer interrupt handler. */
+void
+thread_tick_skipped (int64_t skipped) {
+	cpu_current ()->idle_ticks += skipped;
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) {
+	long long idle_ticks = 0, kernel_ticks = 0, user_ticks = 0;
+	int i;
+
+	for (i = 0; i < cpu_cnt; i++) {
+		idle_ticks += cpus[i].idle_ticks;
+		kernel_ticks += cpus[i].kernel_ticks;
+		user_ticks += cpus[i].user_ticks;
+	}
 	printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
 			idle_ticks, kernel_ticks, user_ticks);
+
+	if (cpu_cnt > 1)
+		for (i = 0; i < cpu_cnt; i++)
+			printf ("CPU %d: %lld idle ticks, %lld kernel ticks, "
+					"%lld user ticks\n", i, cpus[i].idle_ticks,
+					cpus[i].kernel_ticks, cpus[i].user_ticks);
+	printf ("Thread: %lld page cache hits, %lld misses\n",
+			thread_cache_hits, thread_cache_misses);
+	printf ("Thread: %lld voluntary switches, %lld involuntary\n",
+			voluntary_switches, involuntary_switches);
+	for (i = 0; i < SCHED_LATENCY_BUCKETS; i++)
+		if (latency_hist[i] != 0)
+			printf ("Thread: %lld wakeups ran after 2^%d cycles%s\n",
+					latency_hist[i], i,
+					i == SCHED_LATENCY_BUCKETS - 1 ? " or more" : "");
+}
+
+/* Returns the scheduler statistic WHICH, one of the SCHED_STAT_*
+   selectors in syscall-nr.h, for the running thread, or for
+   SCHED_STAT_LATENCY + N, system-wide.  Returns -1 if WHICH is
+   not a valid selector. */
+long long
+thread_sched_stat (int which) {
+	struct thread *curr = thread_current ();
+	long long value;
+
+	/* Only a switch away from CURR changes its counters. */
+	preempt_disable ();
+	if (which == SCHED_STAT_RUN_CYCLES)
+		value = curr->run_cycles + (rdtsc () - curr->acct_tsc);
+	else if (which == SCHED_STAT_WAIT_CYCLES)
+		value = curr->wait_cycles;
+	else if (which == SCHED_STAT_VOLUNTARY)
+		value = curr->voluntary_switches;
+	else if (which == SCHED_STAT_INVOLUNTARY)
+		value = curr->involuntary_switches;
+	else if (which >= SCHED_STAT_LATENCY
+			&& which < SCHED_STAT_LATENCY + SCHED_LATENCY_BUCKETS)
+		value = latency_hist[which - SCHED_STAT_LATENCY];
+	else
+		value = -1;
+	preempt_enable ();
+
+	return value;
+}
+
+/* Scheduler statistics interrupt, for user programs.
+   Input:
+     @RDX - Statistic to read, a SCHED_STAT_* selector.
+   Output:
+     @RAX - Its value, or -1 if RDX is not a selector. */
+static void
+sched_stat_intr (struct intr_frame *f) {
+	f->R.rax = thread_sched_stat (f->R.rdx);
+}
+
+/* With -sched-trace, prints the logged scheduling decisions and
+   wakeups, oldest first, in CSV form between two marker lines, for
+   utils/sched-timeline to turn into a per-thread timeline, and
+   stops logging.  Otherwise does nothing. */
+void
+thread_sched_trace_dump (void) {
+	static const char *reasons[] = {
+		"block", "yield", "preempt", "exit", "wakeup"
+	};
+	uint64_t first, i;
+
+	if (!thread_sched_trace)
+		return;
+	thread_sched_trace = false;
+
+	first = sched_trace_cnt > SCHED_TRACE_SIZE
+		? sched_trace_cnt - SCHED_TRACE_SIZE : 0;
+	printf ("sched-trace: %llu events, %llu lost\n",
+			(unsigned long long) (sched_trace_cnt - first),
+			(unsigned long long) first);
+	printf ("tsc,cpu,prev,next,reason,rq\n");
+	for (i = first; i < sched_trace_cnt; i++) {
+		const struct sched_event *e = &sched_trace[i % SCHED_TRACE_SIZE];
+		printf ("%llu,%d,%d,%d,%s,%d\n", (unsigned long long) e->tsc,
+				e->cpu, e->prev, e->next, reasons[e->reason], e->rq_len);
+	}
+	printf ("sched-trace: end\n");
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -173,9 +421,11 @@ thread_print_stats (void) {
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   The new thread goes on the run queue at the level for
+   PRIORITY.  The scheduler always runs the highest-priority
+   ready thread, which it finds in constant time through the run
+   queue's bitmap of non-empty levels, and threads of equal
+   priority take turns in round-robin order. */
 tid_t
 thread_create (const char *name, int priority,
 		thread_func *function, void *aux) {
@@ -185,12 +435,14 @@ thread_create (const char *name, int priority,
 	ASSERT (function != NULL);
 
 	/* Allocate thread. */
-	t = palloc_get_page (PAL_ZERO);
+	t = thread_page_alloc ();
 	if (t == NULL)
 		return TID_ERROR;
 
 	/* Initialize thread. */
 	init_thread (t, name, priority);
+	if (thread_mlfqs)
+		mlfqs_init_thread (t, thread_current ());
 	tid = t->tid = allocate_tid ();
 
 	/* Call the kernel_thread if it scheduled.
@@ -202,10 +454,13 @@ thread_create (const char *name, int priority,
 	t->tf.es = SEL_KDSEG;
 	t->tf.ss = SEL_KDSEG;
 	t->tf.cs = SEL_KCSEG;
-	t->tf.eflags = FLAG_IF;
+	/* Start with interrupts off, as the scheduler runs, so that
+	   kernel_thread() releases the interrupt lock. */
+	t->tf.eflags = 0;
 
-	/* Add to run queue. */
+	/* Add to run queue, and run it now if it outranks us. */
 	thread_unblock (t);
+	thread_yield_if_outranked ();
 
 	return tid;
 }
@@ -228,6 +483,13 @@ thread_block (void) {
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
+   With -mlfqs, T's priority is first brought up to date.
+
+   T goes on the run queue of the least loaded CPU, preferring
+   the one it last ran on.  If that is another CPU, and it is
+   idle or running a lower-priority thread, it is told to
+   reschedule.
+
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
@@ -235,13 +497,24 @@ thread_block (void) {
 void
 thread_unblock (struct thread *t) {
 	enum intr_level old_level;
+	struct cpu *c;
 
 	ASSERT (is_thread (t));
 
 	old_level = intr_disable ();
 	ASSERT (t->status == THREAD_BLOCKED);
-	list_push_back (&ready_list, &t->elem);
+	t->acct_tsc = rdtsc ();
+	t->woken = true;
+	if (thread_mlfqs)
+		mlfqs_update (t);
+	c = select_cpu (t);
+	runqueue_push (&c->rq, t);
 	t->status = THREAD_READY;
+	sched_trace_wakeup (c, t);
+	if (c != cpu_current ()
+			&& (c->curr == c->idle_thread
+				|| (!thread_cfs && c->curr->priority < t->priority)))
+		lapic_send_ipi (c->apic_id, LAPIC_IPI_RESCHED);
 	intr_set_level (old_level);
 }
 
@@ -269,6 +542,19 @@ thread_current (void) {
 	return t;
 }
 
+/* Returns the CPU we are running on.  Unless interrupts are
+   off, the running thread may migrate to another CPU at any
+   time, so the answer may be stale by the time it is used.
+
+   Until thread_init() turns the boot stack into a thread, only
+   the BSP is running. */
+struct cpu *
+cpu_current (void) {
+	struct thread *t = running_thread ();
+
+	return is_thread (t) && t->cpu != NULL ? t->cpu : &cpus[0];
+}
+
 /* Returns the running thread's tid. */
 tid_t
 thread_tid (void) {
@@ -284,6 +570,8 @@ thread_exit (void) {
 #ifdef USERPROG
 	process_exit ();
 #endif
+	fpu_release (thread_current ());
+	malloc_thread_exit ();
 
 	/* Just set our status to dying and schedule another process.
 	   We will be destroyed during the call to schedule_tail(). */
@@ -302,16 +590,166 @@ thread_yield (void) {
 	ASSERT (!intr_context ());
 
 	old_level = intr_disable ();
-	if (curr != idle_thread)
-		list_push_back (&ready_list, &curr->elem);
+	if (curr != cpu_current ()->idle_thread)
+		runqueue_push (&cpu_current ()->rq, curr);
 	do_schedule (THREAD_READY);
 	intr_set_level (old_level);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Yields the CPU on return from an interrupt whose handler
+   called intr_yield_on_return().  The same as thread_yield(),
+   except in the scheduler trace.  If the running thread has
+   called preempt_disable(), only notes that it should yield in
+   preempt_enable(). */
+void
+thread_preempt (void) {
+	struct thread *curr = thread_current ();
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (curr->preempt_count > 0) {
+		curr->preempt_pending = true;
+		return;
+	}
+	curr->preempt_pending = false;
+	cpu_current ()->preempting = true;
+	thread_yield ();
+}
+
+/* Yields the CPU if a thread in the run queue has a higher
+   priority than the running thread.  In an interrupt handler,
+   yields on return from the interrupt instead.  Does nothing
+   with interrupts off, so that callers may count on not being
+   preempted in a critical section, and waits for
+   preempt_enable() if preemption is disabled. */
+void
+thread_yield_if_outranked (void) {
+	struct thread *curr = thread_current ();
+	bool outranked;
+
+	if (intr_context ()) {
+		if (runqueue_max_priority (&cpu_current ()->rq) > curr->priority)
+			intr_yield_on_return ();
+	} else if (intr_get_level () == INTR_ON) {
+		/* Another CPU may be changing our run queue, but it sends
+		   us a reschedule IPI if that matters, so a stale look is
+		   good enough. */
+		preempt_disable ();
+		outranked = runqueue_max_priority (&cpu_current ()->rq)
+			> curr->priority;
+		preempt_enable ();
+
+		if (!outranked)
+			return;
+		if (curr->preempt_count > 0)
+			curr->preempt_pending = true;
+		else
+			thread_yield ();
+	}
+}
+
+/* Keeps the running thread from being preempted, that is, from
+   being switched out in favor of another thread at an interrupt,
+   until the matching call to preempt_enable().  Calls nest.
+
+   Unlike intr_disable(), this does not keep interrupt handlers
+   from running, nor other CPUs from running the same code, so it
+   protects only data that belongs to the running thread or CPU
+   and that interrupt handlers leave alone.  The running thread
+   also stays on its CPU, so cpu_current() stays valid.  The
+   thread must not sleep or yield before preempt_enable(). */
+void
+preempt_disable (void) {
+	thread_current ()->preempt_count++;
+	barrier ();
+}
+
+/* Ends a preempt_disable() section.  If it was the outermost and
+   an interrupt wanted to preempt the running thread meanwhile,
+   yields now, unless interrupts are off, in which case the next
+   timer interrupt will try again. */
+void
+preempt_enable (void) {
+	struct thread *curr = thread_current ();
+
+	ASSERT (curr->preempt_count > 0);
+
+	barrier ();
+	if (--curr->preempt_count == 0 && curr->preempt_pending
+			&& !intr_context () && intr_get_level () == INTR_ON) {
+		enum intr_level old_level = intr_disable ();
+		thread_preempt ();
+		intr_set_level (old_level);
+	}
+}
+
+/* Sets the current thread's base priority to NEW_PRIORITY.  Its
+   priority stays higher while higher-priority threads donate
+   theirs.  Yields if the thread no longer has the highest
+   priority.  Ignored with -mlfqs, which computes priorities
+   itself. */
 void
 thread_set_priority (int new_priority) {
-	thread_current ()->priority = new_priority;
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+
+	if (thread_mlfqs)
+		return;
+
+	old_level = intr_disable ();
+	curr->base_priority = new_priority;
+	thread_refresh_priority (curr);
+	intr_set_level (old_level);
+
+	thread_yield_if_outranked ();
+}
+
+/* Changes T's priority to PRIORITY, moving T to its new place in
+   the run queue or the semaphore or condition variable waiters
+   it is queued in, if any.  Must be called with interrupts off. */
+void
+thread_reprioritize (struct thread *t, int priority) {
+	ASSERT (intr_get_level () == INTR_OFF);
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	if (t->priority == priority)
+		return;
+
+	/* CFS does not order its run queue by priority. */
+	if (t->status == THREAD_READY && !thread_cfs) {
+		runqueue_remove (t->rq, t);
+		t->priority = priority;
+		runqueue_push (t->rq, t);
+	} else {
+		t->priority = priority;
+		if (t->status == THREAD_BLOCKED && t->wait_heap != NULL)
+			heap_update (t->wait_heap, &t->wait_elem);
+	}
+}
+
+/* Recomputes T's priority as the greater of its base priority and
+   the priorities of the threads waiting for the locks it holds.
+   Must be called with interrupts off. */
+void
+thread_refresh_priority (struct thread *t) {
+	int priority = t->base_priority;
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+			e = list_next (e)) {
+		struct lock *lock = list_entry (e, struct lock, elem);
+		struct heap *waiters = &lock->semaphore.waiters;
+
+		if (!heap_empty (waiters)) {
+			struct thread *top = heap_entry (heap_min (waiters),
+					struct thread, wait_elem);
+			if (top->priority > priority)
+				priority = top->priority;
+		}
+	}
+	thread_reprioritize (t, priority);
 }
 
 /* Returns the current thread's priority. */
@@ -320,70 +758,96 @@ thread_get_priority (void) {
 	return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest. */
 void
-thread_set_nice (int nice UNUSED) {
-	/* TODO: Your implementation goes here */
+thread_set_nice (int nice) {
+	struct thread *curr = thread_current ();
+	enum intr_level old_level;
+	bool preempt;
+
+	old_level = intr_disable ();
+	mlfqs_set_nice (curr, nice);
+	preempt = runqueue_max_priority (&cpu_current ()->rq) > curr->priority;
+	intr_set_level (old_level);
+
+	if (preempt)
+		thread_yield ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	return mlfqs_get_load_avg ();
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) {
-	/* TODO: Your implementation goes here */
-	return 0;
+	return mlfqs_get_recent_cpu (thread_current ());
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
+   The BSP's idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   point it initializes the CPU's idle_thread, "up"s the
+   semaphore passed to it to enable thread_start() to continue,
+   and immediately blocks.  After that, the idle thread never
+   appears in the ready list.  It is returned by
+   next_thread_to_run() as a special case when the ready list is
+   empty.  An AP's idle thread is the one it boots on, and enters
+   idle_loop() directly. */
 static void
 idle (void *idle_started_ UNUSED) {
 	struct semaphore *idle_started = idle_started_;
 
-	idle_thread = thread_current ();
+	cpu_current ()->idle_thread = thread_current ();
 	sema_up (idle_started);
 
+	idle_loop ();
+}
+
+/* Body of each CPU's idle thread. */
+static void
+idle_loop (void) {
 	for (;;) {
 		/* Let someone else run. */
 		intr_disable ();
 		thread_block ();
 
-		/* Re-enable interrupts and wait for the next one.
+		/* Nothing else is ready to run.  Zero part of a free page
+		   for later PAL_ZERO allocations, if any are wanted, take
+		   any interrupt that came in meanwhile, and then look
+		   again. */
+		if (palloc_zero_idle ()) {
+			intr_enable ();
+			continue;
+		}
 
-		   The `sti' instruction disables interrupts until the
-		   completion of the next instruction, so these two
-		   instructions are executed atomically.  This atomicity is
-		   important; otherwise, an interrupt could be handled
-		   between re-enabling interrupts and waiting for the next
-		   one to occur, wasting as much as one clock tick worth of
-		   time.
+		/* Still nothing to do.  In tickless mode, stop
+		   the periodic timer interrupt until the next kernel
+		   timer is due. */
+		timer_idle_enter ();
 
-		   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-		   7.11.1 "HLT Instruction". */
-		asm volatile ("sti; hlt" : : : "memory");
+		/* Re-enable interrupts and wait for the next one. */
+		intr_halt ();
 	}
 }
 
+/* Reschedule IPI handler.  Another CPU put a thread on our run
+   queue that should run now. */
+static void
+reschedule_ipi (struct intr_frame *args UNUSED) {
+	intr_yield_on_return ();
+}
+
 /* Function used as the basis for a kernel thread. */
 static void
 kernel_thread (thread_func *function, void *aux) {
@@ -407,21 +871,116 @@ init_thread (struct thread *t, const char *name, int priority) {
 	t->status = THREAD_BLOCKED;
 	strlcpy (t->name, name, sizeof t->name);
 	t->tf.rsp = (uint64_t) t + PGSIZE - sizeof (void *);
-	t->priority = priority;
+	t->priority = t->base_priority = priority;
+	list_init (&t->held_locks);
+#ifdef USERPROG
+	t->exit_status = -1;
+	list_init (&t->children);
+	t->fds = NULL;
+	t->exec_file = NULL;
+#endif
+	t->acct_tsc = rdtsc ();
 	t->magic = THREAD_MAGIC;
 }
 
+/* Returns a page for a new thread, recycled if possible, or a
+   null pointer if out of memory.  The struct thread at the
+   bottom of the page is left for init_thread() to initialize;
+   the rest of the page is zero where a new thread could notice,
+   namely the fake return address at the top of its stack. */
+static struct thread *
+thread_page_alloc (void) {
+	enum intr_level old_level;
+	uint8_t *page = NULL;
+
+	old_level = intr_disable ();
+	if (thread_cache_cnt > 0) {
+		page = thread_cache[--thread_cache_cnt];
+		thread_cache_hits++;
+	} else
+		thread_cache_misses++;
+	intr_set_level (old_level);
+
+	if (page == NULL)
+		return palloc_get_page (PAL_ZERO);
+
+	memset (page + PGSIZE - sizeof (void *), 0, sizeof (void *));
+	return (struct thread *) page;
+}
+
+/* Frees T's page, which must no longer be in use, keeping it in
+   the cache for the next thread_create() if there is room.  Must
+   be called with interrupts off. */
+static void
+thread_page_free (struct thread *t) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	t->magic = 0;
+	if (thread_cache_cnt < THREAD_CACHE_MAX)
+		thread_cache[thread_cache_cnt++] = t;
+	else
+		palloc_free_page (t);
+}
+
+/* Returns the CPU whose run queue T should join: the CPU with
+   the fewest runnable threads, preferring the one T last ran on,
+   whose caches may still hold T's working set. */
+static struct cpu *
+select_cpu (struct thread *t) {
+	struct cpu *best = t->cpu != NULL ? t->cpu : cpu_current ();
+	size_t best_load = cpu_load (best);
+	int i;
+
+	for (i = 0; i < cpu_cnt; i++) {
+		size_t load = cpu_load (&cpus[i]);
+		if (load < best_load) {
+			best = &cpus[i];
+			best_load = load;
+		}
+	}
+	return best;
+}
+
+/* Returns the number of threads running or ready to run on C,
+   not counting its idle thread. */
+static size_t
+cpu_load (const struct cpu *c) {
+	return runqueue_size (&c->rq) + (c->curr != c->idle_thread);
+}
+
+/* Takes a thread for C to run from the CPU with the longest run
+   queue, or returns a null pointer if all the other run queues
+   are empty. */
+static struct thread *
+steal_thread (struct cpu *c) {
+	struct cpu *busiest = NULL;
+	int i;
+
+	for (i = 0; i < cpu_cnt; i++)
+		if (&cpus[i] != c && !runqueue_empty (&cpus[i].rq)
+				&& (busiest == NULL
+					|| runqueue_size (&cpus[i].rq) > runqueue_size (&busiest->rq)))
+			busiest = &cpus[i];
+	return busiest != NULL ? runqueue_steal (&busiest->rq, &c->rq) : NULL;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
    return a thread from the run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   will be in the run queue.)  If the run queue is empty, take a
+   thread from another CPU, and failing that, return the CPU's
+   idle thread.
+
+   The highest-priority ready thread is chosen; threads of equal
+   priority run in round-robin order. */
 static struct thread *
 next_thread_to_run (void) {
-	if (list_empty (&ready_list))
-		return idle_thread;
-	else
-		return list_entry (list_pop_front (&ready_list), struct thread, elem);
+	struct cpu *c = cpu_current ();
+	struct thread *next = runqueue_pop (&c->rq);
+
+	if (next == NULL)
+		next = steal_thread (c);
+	return next != NULL ? next : c->idle_thread;
 }
 
 /* Use iretq to launch the thread */
@@ -459,15 +1018,31 @@ do_iret (struct intr_frame *tf) {
    PREV, the new thread is already running, and interrupts are
    still disabled.
 
+   Normally only the callee-saved registers of the running thread
+   are saved, by switch_fast() in switch.S.  With -iret-switch,
+   the whole execution context is saved into its intr_frame, as
+   for a thread that has never run.  Either way, TH is resumed
+   the way it was switched out.
+
    It's not safe to call printf() until the thread switch is
    complete.  In practice that means that printf()s should be
    added at the end of the function. */
 static void
 thread_launch (struct thread *th) {
-	uint64_t tf_cur = (uint64_t) &running_thread ()->tf;
+	struct thread *curr = running_thread ();
+	uint64_t tf_cur = (uint64_t) &curr->tf;
 	uint64_t tf = (uint64_t) &th->tf;
+	uint64_t next_rsp = th->switch_rsp;
 	ASSERT (intr_get_level () == INTR_OFF);
 
+	/* TH's saved stack pointer is good for one resumption. */
+	th->switch_rsp = 0;
+
+	if (!thread_iret_switch) {
+		switch_fast (&curr->switch_rsp, next_rsp, &th->tf);
+		return;
+	}
+
 	/* The main switching logic.
 	 * We first restore the whole execution context into the intr_frame
 	 * and then switching to the next thread by calling do_iret.
@@ -514,10 +1089,11 @@ thread_launch (struct thread *th) {
 			"mov %%rbx, 16(%%rax)\n" // eflags
 			"mov %%rsp, 24(%%rax)\n" // rsp
 			"movw %%ss, 32(%%rax)\n"
-			"mov %%rcx, %%rdi\n"
-			"call do_iret\n"
+			"mov %%rcx, %%rsi\n"
+			"movq %2, %%rdi\n"
+			"call switch_resume\n"
 			"out_iret:\n"
-			: : "g"(tf_cur), "g" (tf) : "memory"
+			: : "g"(tf_cur), "g" (tf), "m" (next_rsp) : "memory"
 			);
 }
 
@@ -529,10 +1105,11 @@ static void
 do_schedule(int status) {
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (thread_current()->status == THREAD_RUNNING);
+	ASSERT (thread_current ()->preempt_count == 0);
 	while (!list_empty (&destruction_req)) {
 		struct thread *victim =
 			list_entry (list_pop_front (&destruction_req), struct thread, elem);
-		palloc_free_page(victim);
+		thread_page_free (victim);
 	}
 	thread_current ()->status = status;
 	schedule ();
@@ -542,15 +1119,22 @@ static void
 schedule (void) {
 	struct thread *curr = running_thread ();
 	struct thread *next = next_thread_to_run ();
+	struct cpu *c = curr->cpu;
 
 	ASSERT (intr_get_level () == INTR_OFF);
 	ASSERT (curr->status != THREAD_RUNNING);
 	ASSERT (is_thread (next));
 	/* Mark us as running. */
 	next->status = THREAD_RUNNING;
+	next->cpu = c;
+	c->curr = next;
 
 	/* Start new time slice. */
-	thread_ticks = 0;
+	c->thread_ticks = 0;
+
+	sched_trace_log (c, curr, next);
+	sched_account (c, curr, next);
+	c->preempting = false;
 
 #ifdef USERPROG
 	/* Activate the new address space. */
@@ -570,12 +1154,92 @@ schedule (void) {
 			list_push_back (&destruction_req, &curr->elem);
 		}
 
+		fpu_switch (curr, next);
+
 		/* Before switching the thread, we first save the information
 		 * of current running. */
 		thread_launch (next);
 	}
 }
 
+/* With -sched-trace, logs that CPU C switched from PREV to
+   NEXT, which may be the same thread. */
+static void
+sched_trace_log (struct cpu *c, struct thread *prev, struct thread *next) {
+	struct sched_event *e;
+
+	if (!thread_sched_trace)
+		return;
+
+	e = &sched_trace[sched_trace_cnt++ % SCHED_TRACE_SIZE];
+	e->tsc = rdtsc ();
+	e->prev = prev->tid;
+	e->next = next->tid;
+	e->rq_len = runqueue_size (&c->rq);
+	e->cpu = c->id;
+	if (prev->status == THREAD_BLOCKED)
+		e->reason = SCHED_BLOCK;
+	else if (prev->status == THREAD_DYING)
+		e->reason = SCHED_EXIT;
+	else
+		e->reason = c->preempting ? SCHED_PREEMPT : SCHED_YIELD;
+}
+
+/* With -sched-trace, logs that T was woken up and put on CPU C's
+   run queue, so that the time it then waits to run can be told
+   apart from the time it was blocked. */
+static void
+sched_trace_wakeup (struct cpu *c, struct thread *t) {
+	struct sched_event *e;
+
+	if (!thread_sched_trace)
+		return;
+
+	e = &sched_trace[sched_trace_cnt++ % SCHED_TRACE_SIZE];
+	e->tsc = rdtsc ();
+	e->prev = thread_current ()->tid;
+	e->next = t->tid;
+	e->rq_len = runqueue_size (&c->rq);
+	e->cpu = c->id;
+	e->reason = SCHED_WAKEUP;
+}
+
+/* Charges PREV, which is giving up CPU C, for the time it ran,
+   and NEXT, which may be PREV, for the time it waited to run.
+   C's idle thread, which is never really ready, is left out of
+   the waiting and the system-wide counts. */
+static void
+sched_account (struct cpu *c, struct thread *prev, struct thread *next) {
+	uint64_t now = rdtsc ();
+	bool idle = prev == c->idle_thread;
+
+	prev->run_cycles += now - prev->acct_tsc;
+	prev->acct_tsc = now;
+	if (prev->status == THREAD_READY && c->preempting) {
+		prev->involuntary_switches++;
+		involuntary_switches += !idle;
+	} else if (prev->status != THREAD_DYING) {
+		prev->voluntary_switches++;
+		voluntary_switches += !idle;
+	}
+
+	if (next == c->idle_thread)
+		next->acct_tsc = now;
+	else if (next != prev) {
+		uint64_t wait = now - next->acct_tsc;
+
+		next->wait_cycles += wait;
+		next->acct_tsc = now;
+		if (next->woken) {
+			int bucket = wait != 0 ? 63 - __builtin_clzll (wait) : 0;
+			if (bucket >= SCHED_LATENCY_BUCKETS)
+				bucket = SCHED_LATENCY_BUCKETS - 1;
+			latency_hist[bucket]++;
+			next->woken = false;
+		}
+	}
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) {
@@ -0,0 +1,330 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "intrinsic.h"
+
+/* Workqueues.
+
+   Code that cannot sleep, such as an interrupt handler, or that
+   should not be slowed down, can hand work off to be done later
+   in a kernel thread by queuing a struct work on a workqueue.
+
+   All workqueues share one small pool of worker threads.  An
+   idle worker takes up to WORK_BATCH items at a time from the
+   highest-priority workqueue that has any, so that a burst of
+   items costs one wakeup rather than one each, and runs them at
+   that workqueue's priority.  Items from one workqueue start in
+   the order they were queued, but with more than one worker they
+   may run at the same time and finish in any order.
+
+   flush_work() waits until a given item is neither pending nor
+   running.  Workers remember which items of their batch they
+   have yet to finish, rather than marking the items themselves,
+   because an item's function may free it. */
+
+/* Maximum number of items a worker takes at once. */
+#define WORK_BATCH 8
+
+/* Number of worker threads: one per CPU, but at least
+   WORKER_MIN and at most WORKER_MAX. */
+#define WORKER_MIN 2
+#define WORKER_MAX 8
+
+/* A worker thread. */
+struct worker {
+	struct thread *thread;      /* The thread. */
+	struct list_elem elem;      /* Element in `idle_workers'. */
+	struct work *batch[WORK_BATCH]; /* Items taken off a workqueue. */
+	int batch_cnt;              /* Number of items in `batch'. */
+	int batch_done;             /* Number of them finished. */
+};
+
+/* A thread waiting in flush_work(). */
+struct flusher {
+	struct list_elem elem;      /* Element in `flushers'. */
+	struct work *work;          /* Item being waited for. */
+	struct semaphore done;      /* Upped when `work' is idle. */
+};
+
+/* Everything below is protected by disabling interrupts. */
+static struct worker workers[WORKER_MAX];
+static int worker_cnt;
+static struct list idle_workers;    /* Workers waiting for work. */
+static struct list workqueues;      /* By descending priority. */
+static struct list flushers;        /* Threads in flush_work(). */
+
+static thread_func worker_thread;
+static struct workqueue *next_workqueue (void);
+static bool is_running (const struct work *);
+static void finish_work (struct work *);
+static void set_worker_priority (struct thread *, int priority);
+static bool workqueue_higher (const struct list_elem *,
+		const struct list_elem *, void *aux);
+
+/* Creates the worker threads.  Must be called once the other
+   CPUs are running, and before any workqueue is initialized. */
+void
+workqueue_pool_init (void) {
+	int i;
+
+	list_init (&idle_workers);
+	list_init (&workqueues);
+	list_init (&flushers);
+
+	worker_cnt = cpu_cnt < WORKER_MIN ? WORKER_MIN
+		: cpu_cnt > WORKER_MAX ? WORKER_MAX : cpu_cnt;
+	for (i = 0; i < worker_cnt; i++) {
+		char name[24];
+
+		snprintf (name, sizeof name, "kworker%d", i);
+		if (thread_create (name, PRI_DEFAULT, worker_thread, &workers[i])
+				== TID_ERROR)
+			PANIC ("cannot create worker thread");
+	}
+}
+
+/* Initializes WQ, whose items are run at PRIORITY.  NAME is used
+   in statistics and must remain valid while WQ exists. */
+void
+workqueue_init (struct workqueue *wq, const char *name, int priority) {
+	enum intr_level old_level;
+
+	ASSERT (wq != NULL);
+	ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+	wq->name = name;
+	wq->priority = priority;
+	list_init (&wq->items);
+	wq->depth = wq->max_depth = 0;
+	wq->run_cnt = wq->batch_cnt = 0;
+	wq->latency_sum = wq->latency_max = 0;
+
+	old_level = intr_disable ();
+	list_insert_ordered (&workqueues, &wq->elem, workqueue_higher, NULL);
+	intr_set_level (old_level);
+}
+
+/* Initializes WORK to call FUNC, passing AUX, when run. */
+void
+work_init (struct work *work, work_func *func, void *aux) {
+	ASSERT (work != NULL);
+	ASSERT (func != NULL);
+
+	work->func = func;
+	work->aux = aux;
+	work->pending = false;
+}
+
+/* Queues WORK on WQ, to be run by a worker thread, and returns
+   true, or returns false if WORK is already pending.  WORK may
+   be queued again once it starts running.
+
+   This function may be called from an interrupt handler. */
+bool
+queue_work (struct workqueue *wq, struct work *work) {
+	enum intr_level old_level;
+
+	ASSERT (wq != NULL);
+	ASSERT (work != NULL);
+
+	old_level = intr_disable ();
+	if (work->pending) {
+		intr_set_level (old_level);
+		return false;
+	}
+
+	work->pending = true;
+	work->queued_tsc = rdtsc ();
+	list_push_back (&wq->items, &work->elem);
+	if (++wq->depth > wq->max_depth)
+		wq->max_depth = wq->depth;
+
+	if (!list_empty (&idle_workers)) {
+		struct worker *w = list_entry (list_pop_front (&idle_workers),
+				struct worker, elem);
+		set_worker_priority (w->thread, wq->priority);
+		thread_unblock (w->thread);
+	}
+	intr_set_level (old_level);
+
+	thread_yield_if_outranked ();
+	return true;
+}
+
+/* Waits until WORK is neither pending nor running.  If WORK is
+   queued again meanwhile, waits for that run too.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler, nor by the function of a work item, which
+   could wait forever for itself. */
+void
+flush_work (struct work *work) {
+	enum intr_level old_level;
+
+	ASSERT (work != NULL);
+	ASSERT (!intr_context ());
+
+	old_level = intr_disable ();
+	if (work->pending || is_running (work)) {
+		struct flusher f;
+
+		f.work = work;
+		sema_init (&f.done, 0);
+		list_push_back (&flushers, &f.elem);
+		sema_down (&f.done);
+	}
+	intr_set_level (old_level);
+}
+
+/* Prints workqueue statistics. */
+void
+workqueue_print_stats (void) {
+	struct list_elem *e;
+
+	if (worker_cnt == 0)
+		return;
+
+	for (e = list_begin (&workqueues); e != list_end (&workqueues);
+			e = list_next (e)) {
+		struct workqueue *wq = list_entry (e, struct workqueue, elem);
+
+		printf ("Workqueue %s: %lld items in %lld batches, max depth %zu, "
+				"latency avg %llu max %llu cycles\n",
+				wq->name, wq->run_cnt, wq->batch_cnt, wq->max_depth,
+				wq->run_cnt > 0 ? wq->latency_sum / wq->run_cnt : 0,
+				wq->latency_max);
+	}
+}
+
+/* Worker thread.  Takes batches of items off the workqueues and
+   runs them, sleeping while there are none. */
+static void
+worker_thread (void *w_) {
+	struct worker *w = w_;
+
+	w->thread = thread_current ();
+	w->batch_cnt = w->batch_done = 0;
+
+	for (;;) {
+		struct workqueue *wq;
+		uint64_t now;
+
+		intr_disable ();
+		while ((wq = next_workqueue ()) == NULL) {
+			list_push_back (&idle_workers, &w->elem);
+			thread_block ();
+		}
+
+		now = rdtsc ();
+		w->batch_cnt = w->batch_done = 0;
+		while (w->batch_cnt < WORK_BATCH && !list_empty (&wq->items)) {
+			struct work *work = list_entry (list_pop_front (&wq->items),
+					struct work, elem);
+			uint64_t latency = now - work->queued_tsc;
+
+			work->pending = false;
+			wq->depth--;
+			wq->latency_sum += latency;
+			if (latency > wq->latency_max)
+				wq->latency_max = latency;
+			w->batch[w->batch_cnt++] = work;
+		}
+		wq->run_cnt += w->batch_cnt;
+		wq->batch_cnt++;
+		set_worker_priority (w->thread, wq->priority);
+		intr_enable ();
+		thread_yield_if_outranked ();
+
+		while (w->batch_done < w->batch_cnt) {
+			struct work *work = w->batch[w->batch_done];
+
+			work->func (work->aux);
+
+			intr_disable ();
+			w->batch_done++;
+			finish_work (work);
+			intr_enable ();
+			thread_yield_if_outranked ();
+		}
+	}
+}
+
+/* Returns the highest-priority workqueue with pending items, or a
+   null pointer if there is none. */
+static struct workqueue *
+next_workqueue (void) {
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (e = list_begin (&workqueues); e != list_end (&workqueues);
+			e = list_next (e)) {
+		struct workqueue *wq = list_entry (e, struct workqueue, elem);
+		if (!list_empty (&wq->items))
+			return wq;
+	}
+	return NULL;
+}
+
+/* Returns true if a worker has taken WORK off its workqueue and
+   not yet finished running it. */
+static bool
+is_running (const struct work *work) {
+	int i, j;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (i = 0; i < worker_cnt; i++)
+		for (j = workers[i].batch_done; j < workers[i].batch_cnt; j++)
+			if (workers[i].batch[j] == work)
+				return true;
+	return false;
+}
+
+/* Wakes up the threads waiting in flush_work() for WORK, which a
+   worker just finished running, if it is now idle.  WORK may
+   have been freed, so it is looked at only if a thread is
+   waiting for it, which means it has not been. */
+static void
+finish_work (struct work *work) {
+	struct list_elem *e;
+
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	for (e = list_begin (&flushers); e != list_end (&flushers); ) {
+		struct flusher *f = list_entry (e, struct flusher, elem);
+
+		if (f->work == work && !work->pending && !is_running (work)) {
+			e = list_remove (e);
+			sema_up (&f->done);
+		} else
+			e = list_next (e);
+	}
+}
+
+/* Sets the priority of worker thread T to PRIORITY, except with
+   -mlfqs, which computes priorities itself.  T must not hold any
+   locks, which could have raised its priority by donation. */
+static void
+set_worker_priority (struct thread *t, int priority) {
+	ASSERT (intr_get_level () == INTR_OFF);
+
+	if (thread_mlfqs)
+		return;
+	t->base_priority = priority;
+	thread_refresh_priority (t);
+}
+
+/* Orders workqueues by descending priority. */
+static bool
+workqueue_higher (const struct list_elem *a_, const struct list_elem *b_,
+		void *aux UNUSED) {
+	const struct workqueue *a = list_entry (a_, struct workqueue, elem);
+	const struct workqueue *b = list_entry (b_, struct workqueue, elem);
+
+	return a->priority > b->priority;
+}
@@ -11,26 +11,74 @@
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
+#include "userprog/syscall.h"
 #include "intrinsic.h"
 #ifdef VM
 #include "vm/vm.h"
 #endif
 
+static bool process_init (void);
 static void process_cleanup (void);
-static bool load (const char *file_name, struct intr_frame *if_);
-static void initd (void *f_name);
+static bool load (char *cmd_line, struct intr_frame *if_);
+static void initd (void *args);
 static void __do_fork (void *);
+static struct child *child_create (void);
+static void child_release (struct child *);
+static bool push_arguments (struct intr_frame *if_, int argc, char **argv);
+
+/* A child process, as its parent sees it.  Shared by the parent
+ * and the child, and freed by whichever lets go of it last. */
+struct child {
+	tid_t tid;                      /* Child's thread. */
+	int exit_status;                /* Valid once `exited' is up. */
+	struct semaphore exited;        /* Upped when the child exits. */
+	struct list_elem elem;          /* Element in parent's `children'. */
+	int ref_cnt;                    /* Parent, child, or both. */
+};
 
-/* General process initializer for initd and other process. */
-static void
+/* What process_create_initd() passes to initd(). */
+struct initd_args {
+	char *file_name;                /* Command line, in its own page. */
+	struct child *child;
+};
+
+/* What process_fork() passes to the child, on its stack. */
+struct fork_args {
+	struct thread *parent;
+	struct child *child;
+	struct intr_frame if_;          /* Parent's user context. */
+	struct semaphore done;          /* Upped when the child is set up. */
+	bool success;                   /* Whether it was set up. */
+};
+
+/* Most words on a command line: LOADER_ARGS_LEN bytes of
+ * one-letter words. */
+#define MAX_ARGS (LOADER_ARGS_LEN / 2)
+
+/* Size of a process's file descriptor table, which takes a page.
+ * Descriptors 0 and 1 are the console's. */
+#define FD_MAX (PGSIZE / sizeof (struct file *))
+#define FD_FIRST 2
+
+/* General process initializer for initd and other process.
+ * Gives the current thread an empty file descriptor table.
+ * Returns false if memory is not available. */
+static bool
 process_init (void) {
 	struct thread *current = thread_current ();
+
+	current->fds = palloc_get_page (PAL_ZERO);
+	return current->fds != NULL;
 }
 
 /* Starts the first userland program, called "initd", loaded from FILE_NAME.
@@ -40,33 +88,58 @@ process_init (void) {
  * Notice that THIS SHOULD BE CALLED ONCE. */
 tid_t
 process_create_initd (const char *file_name) {
-	char *fn_copy;
+	struct initd_args *args;
+	char name[16];
 	tid_t tid;
 
-	/* Make a copy of FILE_NAME.
-	 * Otherwise there's a race between the caller and load(). */
-	fn_copy = palloc_get_page (0);
-	if (fn_copy == NULL)
+	args = malloc (sizeof *args);
+	if (args == NULL)
 		return TID_ERROR;
-	strlcpy (fn_copy, file_name, PGSIZE);
 
-	/* Create a new thread to execute FILE_NAME. */
-	tid = thread_create (file_name, PRI_DEFAULT, initd, fn_copy);
-	if (tid == TID_ERROR)
-		palloc_free_page (fn_copy);
+	/* Make a copy of FILE_NAME.
+	 * Otherwise there's a race between the caller and load(). */
+	args->file_name = palloc_get_page (0);
+	if (args->file_name == NULL)
+		goto fail;
+	strlcpy (args->file_name, file_name, PGSIZE);
+
+	args->child = child_create ();
+	if (args->child == NULL)
+		goto fail;
+
+	/* Create a new thread to execute FILE_NAME, named after the
+	 * program alone. */
+	strlcpy (name, file_name, sizeof name);
+	name[strcspn (name, " ")] = '\0';
+	tid = thread_create (name, PRI_DEFAULT, initd, args);
+	if (tid == TID_ERROR) {
+		list_remove (&args->child->elem);
+		free (args->child);
+		goto fail;
+	}
+	args->child->tid = tid;
 	return tid;
+
+fail:
+	palloc_free_page (args->file_name);
+	free (args);
+	return TID_ERROR;
 }
 
 /* A thread function that launches first user process. */
 static void
-initd (void *f_name) {
+initd (void *args_) {
+	struct initd_args *args = args_;
+	char *f_name = args->file_name;
+
+	thread_current ()->child = args->child;
+	free (args);
+
 #ifdef VM
 	supplemental_page_table_init (&thread_current ()->spt);
 #endif
 
-	process_init ();
-
-	if (process_exec (f_name) < 0)
+	if (!process_init () || process_exec (f_name) < 0)
 		PANIC("Fail to launch initd\n");
 	NOT_REACHED ();
 }
@@ -74,10 +147,40 @@ initd (void *f_name) {
 /* Clones the current process as `name`. Returns the new process's thread id, or
  * TID_ERROR if the thread cannot be created. */
 tid_t
-process_fork (const char *name, struct intr_frame *if_ UNUSED) {
+process_fork (const char *name, struct intr_frame *if_) {
+	struct fork_args args;
+	tid_t tid;
+
+	args.child = child_create ();
+	if (args.child == NULL)
+		return TID_ERROR;
+	args.parent = thread_current ();
+	memcpy (&args.if_, if_, sizeof args.if_);
+	sema_init (&args.done, 0);
+	args.success = false;
+
+	/* The child copies our FPU state from memory. */
+	fpu_save (thread_current ());
+
 	/* Clone current thread to new thread.*/
-	return thread_create (name,
-			PRI_DEFAULT, __do_fork, thread_current ());
+	tid = thread_create (name,
+			PRI_DEFAULT, __do_fork, &args);
+	if (tid == TID_ERROR) {
+		list_remove (&args.child->elem);
+		free (args.child);
+		return TID_ERROR;
+	}
+	args.child->tid = tid;
+
+	/* Wait for the child to copy our address space, which it may
+	 * change under us by sharing our pages copy-on-write. */
+	sema_down (&args.done);
+	if (!args.success) {
+		list_remove (&args.child->elem);
+		child_release (args.child);
+		return TID_ERROR;
+	}
+	return tid;
 }
 
 #ifndef VM
@@ -91,22 +194,31 @@ duplicate_pte (uint64_t *pte, void *va, void *aux) {
 	void *newpage;
 	bool writable;
 
-	/* 1. TODO: If the parent_page is kernel page, then return immediately. */
+	/* 1. If the parent_page is kernel page, then return immediately. */
+	if (is_kernel_vaddr (va))
+		return true;
 
 	/* 2. Resolve VA from the parent's page map level 4. */
 	parent_page = pml4_get_page (parent->pml4, va);
 
-	/* 3. TODO: Allocate new PAL_USER page for the child and set result to
-	 *    TODO: NEWPAGE. */
+	/* 3. Allocate new PAL_USER page for the child and set result to
+	 *    NEWPAGE. */
+	newpage = palloc_get_page (PAL_USER);
+	if (newpage == NULL)
+		return false;
 
-	/* 4. TODO: Duplicate parent's page to the new page and
-	 *    TODO: check whether parent's page is writable or not (set WRITABLE
-	 *    TODO: according to the result). */
+	/* 4. Duplicate parent's page to the new page and
+	 *    check whether parent's page is writable or not (set WRITABLE
+	 *    according to the result). */
+	memcpy (newpage, parent_page, PGSIZE);
+	writable = is_writable (pte);
 
 	/* 5. Add new page to child's page table at address VA with WRITABLE
 	 *    permission. */
 	if (!pml4_set_page (current->pml4, va, newpage, writable)) {
-		/* 6. TODO: if fail to insert page, do error handling. */
+		/* 6. if fail to insert page, do error handling. */
+		palloc_free_page (newpage);
+		return false;
 	}
 	return true;
 }
@@ -119,14 +231,20 @@ duplicate_pte (uint64_t *pte, void *va, void *aux) {
 static void
 __do_fork (void *aux) {
 	struct intr_frame if_;
-	struct thread *parent = (struct thread *) aux;
+	struct fork_args *args = aux;
+	struct thread *parent = args->parent;
 	struct thread *current = thread_current ();
-	/* TODO: somehow pass the parent_if. (i.e. process_fork()'s if_) */
-	struct intr_frame *parent_if;
+	struct intr_frame *parent_if = &args->if_;
 	bool succ = true;
+	size_t fd;
+
+	current->child = args->child;
 
 	/* 1. Read the cpu context to local stack. */
 	memcpy (&if_, parent_if, sizeof (struct intr_frame));
+	if_.R.rax = 0;
+	if (!fpu_copy (current, parent))
+		goto error;
 
 	/* 2. Duplicate PT */
 	current->pml4 = pml4_create();
@@ -143,18 +261,31 @@ __do_fork (void *aux) {
 		goto error;
 #endif
 
-	/* TODO: Your code goes here.
-	 * TODO: Hint) To duplicate the file object, use `file_duplicate`
-	 * TODO:       in include/filesys/file.h. Note that parent should not return
-	 * TODO:       from the fork() until this function successfully duplicates
-	 * TODO:       the resources of parent.*/
-
-	process_init ();
+	/* Duplicate the open files.  The parent waits for us, so its
+	 * table holds still. */
+	if (!process_init ())
+		goto error;
+	lock_acquire (&filesys_lock);
+	for (fd = FD_FIRST; fd < FD_MAX && succ; fd++)
+		if (parent->fds[fd] != NULL) {
+			current->fds[fd] = file_duplicate (parent->fds[fd]);
+			succ = current->fds[fd] != NULL;
+		}
+	if (succ && parent->exec_file != NULL) {
+		current->exec_file = file_duplicate (parent->exec_file);
+		succ = current->exec_file != NULL;
+	}
+	lock_release (&filesys_lock);
 
-	/* Finally, switch to the newly created process. */
-	if (succ)
+	/* Finally, switch to the newly created process.  Let the parent
+	 * go on first; ARGS is gone once it does. */
+	if (succ) {
+		args->success = true;
+		sema_up (&args->done);
 		do_iret (&if_);
+	}
 error:
+	sema_up (&args->done);
 	thread_exit ();
 }
 
@@ -175,9 +306,15 @@ process_exec (void *f_name) {
 
 	/* We first kill the current context */
 	process_cleanup ();
+#ifdef VM
+	supplemental_page_table_init (&thread_current ()->spt);
+#endif
+	fpu_release (thread_current ());
 
 	/* And then load the binary */
+	lock_acquire (&filesys_lock);
 	success = load (file_name, &_if);
+	lock_release (&filesys_lock);
 
 	/* If load failed, quit. */
 	palloc_free_page (file_name);
@@ -200,10 +337,23 @@ process_exec (void *f_name) {
  * This function will be implemented in problem 2-2.  For now, it
  * does nothing. */
 int
-process_wait (tid_t child_tid UNUSED) {
-	/* XXX: Hint) The pintos exit if process_wait (initd), we recommend you
-	 * XXX:       to add infinite loop here before
-	 * XXX:       implementing the process_wait. */
+process_wait (tid_t child_tid) {
+	struct thread *curr = thread_current ();
+	struct list_elem *e;
+
+	for (e = list_begin (&curr->children); e != list_end (&curr->children);
+			e = list_next (e)) {
+		struct child *c = list_entry (e, struct child, elem);
+		int status;
+
+		if (c->tid != child_tid)
+			continue;
+		sema_down (&c->exited);
+		status = c->exit_status;
+		list_remove (&c->elem);
+		child_release (c);
+		return status;
+	}
 	return -1;
 }
 
@@ -211,12 +361,100 @@ process_wait (tid_t child_tid UNUSED) {
 void
 process_exit (void) {
 	struct thread *curr = thread_current ();
-	/* TODO: Your code goes here.
-	 * TODO: Implement process termination message (see
-	 * TODO: project2/process_termination.html).
-	 * TODO: We recommend you to implement process resource cleanup here. */
+	size_t fd;
+
+	if (curr->pml4 != NULL)
+		printf ("%s: exit(%d)\n", curr->name, curr->exit_status);
 
 	process_cleanup ();
+
+	if (curr->fds != NULL) {
+		for (fd = FD_FIRST; fd < FD_MAX; fd++)
+			process_close_file (fd);
+		palloc_free_page (curr->fds);
+		curr->fds = NULL;
+	}
+
+	/* Let the parent know, after our memory is gone, so that
+	 * modified file mappings are written back by then. */
+	while (!list_empty (&curr->children))
+		child_release (list_entry (list_pop_front (&curr->children),
+					struct child, elem));
+	if (curr->child != NULL) {
+		curr->child->exit_status = curr->exit_status;
+		sema_up (&curr->child->exited);
+		child_release (curr->child);
+		curr->child = NULL;
+	}
+}
+
+/* Creates the record of a new child of the current thread, held
+ * by both, and adds it to the current thread's children.  Returns
+ * a null pointer if memory is not available. */
+static struct child *
+child_create (void) {
+	struct child *c = malloc (sizeof *c);
+
+	if (c == NULL)
+		return NULL;
+	c->tid = TID_ERROR;
+	c->exit_status = -1;
+	sema_init (&c->exited, 0);
+	c->ref_cnt = 2;
+	list_push_back (&thread_current ()->children, &c->elem);
+	return c;
+}
+
+/* Lets go of C, and frees it if neither the parent nor the child
+ * holds it any more. */
+static void
+child_release (struct child *c) {
+	enum intr_level old_level = intr_disable ();
+	bool last = --c->ref_cnt == 0;
+
+	intr_set_level (old_level);
+	if (last)
+		free (c);
+}
+
+/* Gives FILE the lowest free file descriptor of the current
+ * process, which then owns it, and returns the descriptor, or -1
+ * if the table is full. */
+int
+process_add_file (struct file *file) {
+	struct thread *curr = thread_current ();
+	size_t fd;
+
+	for (fd = FD_FIRST; fd < FD_MAX; fd++)
+		if (curr->fds[fd] == NULL) {
+			curr->fds[fd] = file;
+			return fd;
+		}
+	return -1;
+}
+
+/* Returns the file that the current process has open as FD, or
+ * a null pointer if FD is not an open file. */
+struct file *
+process_get_file (int fd) {
+	struct thread *curr = thread_current ();
+
+	if (fd < FD_FIRST || (size_t) fd >= FD_MAX)
+		return NULL;
+	return curr->fds[fd];
+}
+
+/* Closes the current process's file FD, if it is open. */
+void
+process_close_file (int fd) {
+	struct file *file = process_get_file (fd);
+
+	if (file != NULL) {
+		thread_current ()->fds[fd] = NULL;
+		lock_acquire (&filesys_lock);
+		file_close (file);
+		lock_release (&filesys_lock);
+	}
 }
 
 /* Free the current process's resources. */
@@ -232,6 +470,15 @@ process_cleanup (void) {
 	/* Destroy the current process's page directory and switch back
 	 * to the kernel-only page directory. */
 	pml4 = curr->pml4;
+
+	/* Let our executable be written again. */
+	if (curr->exec_file != NULL) {
+		lock_acquire (&filesys_lock);
+		file_close (curr->exec_file);
+		lock_release (&filesys_lock);
+		curr->exec_file = NULL;
+	}
+
 	if (pml4 != NULL) {
 		/* Correct ordering here is crucial.  We must set
 		 * cur->pagedir to NULL before switching page directories,
@@ -316,19 +563,36 @@ static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 		uint32_t read_bytes, uint32_t zero_bytes,
 		bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads the ELF executable named by the first word of CMD_LINE
+ * into the current thread, with the words as its arguments.
+ * Splits CMD_LINE in place.
  * Stores the executable's entry point into *RIP
  * and its initial stack pointer into *RSP.
  * Returns true if successful, false otherwise. */
 static bool
-load (const char *file_name, struct intr_frame *if_) {
+load (char *cmd_line, struct intr_frame *if_) {
 	struct thread *t = thread_current ();
 	struct ELF ehdr;
 	struct file *file = NULL;
+	const char *file_name;
+	char *argv[MAX_ARGS];
+	char *token, *save_ptr;
+	int argc = 0;
 	off_t file_ofs;
 	bool success = false;
 	int i;
 
+	/* Split the command line into words. */
+	for (token = strtok_r (cmd_line, " ", &save_ptr); token != NULL;
+			token = strtok_r (NULL, " ", &save_ptr)) {
+		if (argc == MAX_ARGS)
+			return false;
+		argv[argc++] = token;
+	}
+	if (argc == 0)
+		return false;
+	file_name = argv[0];
+
 	/* Allocate and activate page directory. */
 	t->pml4 = pml4_create ();
 	if (t->pml4 == NULL)
@@ -414,18 +678,62 @@ load (const char *file_name, struct intr_frame *if_) {
 	/* Start address. */
 	if_->rip = ehdr.e_entry;
 
-	/* TODO: Your code goes here.
-	 * TODO: Implement argument passing (see project2/argument_passing.html). */
+	/* Arguments. */
+	if (!push_arguments (if_, argc, argv))
+		goto done;
 
+	/* Keep the executable open, and unwritable, while it runs. */
+	file_deny_write (file);
+	t->exec_file = file;
 	success = true;
 
 done:
 	/* We arrive here whether the load is successful or not. */
-	file_close (file);
+	if (!success)
+		file_close (file);
 	return success;
 }
 
 
+/* Pushes ARGC words ARGV onto the user stack at IF_->rsp, as
+ * main (argc, argv) expects them: the strings, then a null
+ * pointer and the pointers to them, 8-byte aligned, then a fake
+ * return address.  Points IF_'s rdi at argc and rsi at argv.
+ * Returns false if they do not fit in the stack's first page. */
+static bool
+push_arguments (struct intr_frame *if_, int argc, char **argv) {
+	uintptr_t floor = if_->rsp - PGSIZE;
+	uintptr_t sp = if_->rsp;
+	char *uargv[MAX_ARGS];
+	int i;
+
+	for (i = argc - 1; i >= 0; i--) {
+		size_t len = strlen (argv[i]) + 1;
+
+		if (sp - floor < len)
+			return false;
+		sp -= len;
+		memcpy ((void *) sp, argv[i], len);
+		uargv[i] = (char *) sp;
+	}
+	sp &= ~(uintptr_t) 7;
+
+	/* argv[argc], argv[0..argc-1], and the return address. */
+	if (sp - floor < (argc + 2) * sizeof (char *))
+		return false;
+	sp -= sizeof (char *);
+	*(char **) sp = NULL;
+	sp -= argc * sizeof (char *);
+	memcpy ((void *) sp, uargv, argc * sizeof (char *));
+	if_->R.rdi = argc;
+	if_->R.rsi = sp;
+	sp -= sizeof (void *);
+	*(void **) sp = NULL;
+
+	if_->rsp = sp;
+	return true;
+}
+
 /* Checks whether PHDR describes a valid, loadable segment in
  * FILE and returns true if so, false otherwise. */
 static bool
@@ -574,13 +882,6 @@ install_page (void *upage, void *kpage, bool writable) {
  * If you want to implement the function for only project 2, implement it on the
  * upper block. */
 
-static bool
-lazy_load_segment (struct page *page, void *aux) {
-	/* TODO: Load the segment from the file */
-	/* TODO: This called when the first page fault occurs on address VA. */
-	/* TODO: VA is available when calling this function. */
-}
-
 /* Loads a segment starting at offset OFS in FILE at address
  * UPAGE.  In total, READ_BYTES + ZERO_BYTES bytes of virtual
  * memory are initialized, as follows:
@@ -593,6 +894,9 @@ lazy_load_segment (struct page *page, void *aux) {
  * The pages initialized by this function must be writable by the
  * user process if WRITABLE is true, read-only otherwise.
  *
+ * The segment becomes one VMA, whose pages are read in as they
+ * are first touched.
+ *
  * Return true if successful, false if a memory allocation error
  * or disk read error occurs. */
 static bool
@@ -602,25 +906,8 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
 	ASSERT (pg_ofs (upage) == 0);
 	ASSERT (ofs % PGSIZE == 0);
 
-	while (read_bytes > 0 || zero_bytes > 0) {
-		/* Do calculate how to fill this page.
-		 * We will read PAGE_READ_BYTES bytes from FILE
-		 * and zero the final PAGE_ZERO_BYTES bytes. */
-		size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-		size_t page_zero_bytes = PGSIZE - page_read_bytes;
-
-		/* TODO: Set up aux to pass information to the lazy_load_segment. */
-		void *aux = NULL;
-		if (!vm_alloc_page_with_initializer (VM_ANON, upage,
-					writable, lazy_load_segment, aux))
-			return false;
-
-		/* Advance. */
-		read_bytes -= page_read_bytes;
-		zero_bytes -= page_zero_bytes;
-		upage += PGSIZE;
-	}
-	return true;
+	return vm_map_range (upage, read_bytes + zero_bytes, VM_ANON, writable,
+			read_bytes > 0 ? file : NULL, ofs, read_bytes);
 }
 
 /* Create a PAGE of stack at the USER_STACK. Return true on success. */
@@ -629,10 +916,12 @@ setup_stack (struct intr_frame *if_) {
 	bool success = false;
 	void *stack_bottom = (void *) (((uint8_t *) USER_STACK) - PGSIZE);
 
-	/* TODO: Map the stack on stack_bottom and claim the page immediately.
-	 * TODO: If success, set the rsp accordingly.
-	 * TODO: You should mark the page is stack. */
-	/* TODO: Your code goes here */
+	/* VM_MARKER_0 marks the page as stack. */
+	if (vm_alloc_page (VM_ANON | VM_MARKER_0, stack_bottom, true)
+			&& vm_claim_page (stack_bottom)) {
+		if_->rsp = USER_STACK;
+		success = true;
+	}
 
 	return success;
 }
@@ -1,16 +1,53 @@
 #include "userprog/syscall.h"
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include "devices/input.h"
+#include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "threads/cpu.h"
+#include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/loader.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
 #include "userprog/gdt.h"
+#include "userprog/process.h"
 #include "threads/flags.h"
 #include "intrinsic.h"
+#ifdef VM
+#include "vm/vm.h"
+#endif
 
 void syscall_entry (void);
 void syscall_handler (struct intr_frame *);
 
+static void sys_exit (int status) NO_RETURN;
+static int sys_exec (const char *cmd_line);
+static bool sys_create (const char *file, unsigned initial_size);
+static bool sys_remove (const char *file);
+static int sys_open (const char *file);
+static int sys_filesize (int fd);
+static int sys_read (int fd, void *buffer, unsigned size);
+static int sys_write (int fd, const void *buffer, unsigned size);
+static void sys_seek (int fd, unsigned position);
+static unsigned sys_tell (int fd);
+#ifdef VM
+static void *sys_mmap (void *addr, size_t length, int writable, int fd,
+		off_t offset);
+static void sys_munmap (void *addr);
+#endif
+static bool user_page_ok (const void *uaddr, bool write);
+static void check_buffer (const void *buffer, size_t size, bool write);
+static void check_string (const char *str);
+
+/* Serializes the system calls that use the file system, which
+ * has no locking of its own. */
+struct lock filesys_lock;
+
 /* System call.
  *
  * Previously system call services was handled by the interrupt handler
@@ -23,7 +60,9 @@ void syscall_handler (struct intr_frame *);
 #define MSR_STAR 0xc0000081         /* Segment selector msr */
 #define MSR_LSTAR 0xc0000082        /* Long mode SYSCALL target */
 #define MSR_SYSCALL_MASK 0xc0000084 /* Mask for the eflags */
+#define MSR_KERNEL_GS_BASE 0xc0000102 /* GS base swapped in by swapgs */
 
+/* Initializes system calls on the running CPU. */
 void
 syscall_init (void) {
 	write_msr(MSR_STAR, ((uint64_t)SEL_UCSEG - 0x10) << 48  |
@@ -35,12 +74,374 @@ syscall_init (void) {
 	 * mode stack. Therefore, we masked the FLAG_FL. */
 	write_msr(MSR_SYSCALL_MASK,
 			FLAG_IF | FLAG_TF | FLAG_DF | FLAG_IOPL | FLAG_AC | FLAG_NT);
+
+	/* The syscall_entry finds this CPU's TSS, and scratch space
+	 * for the registers it clobbers, in the struct cpu that the
+	 * swapgs instruction makes GS point to. */
+	ASSERT (offsetof (struct cpu, syscall_scratch) == 0);
+	ASSERT (offsetof (struct cpu, tss) == 16);
+	write_msr(MSR_KERNEL_GS_BASE, (uint64_t) cpu_current ());
+
+	/* Only once, though every CPU comes through here. */
+	if (cpu_current () == &cpus[0])
+		lock_init (&filesys_lock);
 }
 
-/* The main system call interface */
+/* The main system call interface.  The system call number is in
+ * rax and its arguments in rdi, rsi, rdx, r10, r8 and r9; the
+ * result goes back in rax.  A call with an unknown number, or
+ * with a bad pointer, kills the process. */
 void
-syscall_handler (struct intr_frame *f UNUSED) {
-	// TODO: Your implementation goes here.
-	printf ("system call!\n");
+syscall_handler (struct intr_frame *f) {
+	switch (f->R.rax) {
+		case SYS_HALT:
+			power_off ();
+		case SYS_EXIT:
+			sys_exit (f->R.rdi);
+		case SYS_FORK:
+			check_string ((const char *) f->R.rdi);
+			f->R.rax = process_fork ((const char *) f->R.rdi, f);
+			break;
+		case SYS_EXEC:
+			f->R.rax = sys_exec ((const char *) f->R.rdi);
+			break;
+		case SYS_WAIT:
+			f->R.rax = process_wait (f->R.rdi);
+			break;
+		case SYS_CREATE:
+			f->R.rax = sys_create ((const char *) f->R.rdi, f->R.rsi);
+			break;
+		case SYS_REMOVE:
+			f->R.rax = sys_remove ((const char *) f->R.rdi);
+			break;
+		case SYS_OPEN:
+			f->R.rax = sys_open ((const char *) f->R.rdi);
+			break;
+		case SYS_FILESIZE:
+			f->R.rax = sys_filesize (f->R.rdi);
+			break;
+		case SYS_READ:
+			f->R.rax = sys_read (f->R.rdi, (void *) f->R.rsi, f->R.rdx);
+			break;
+		case SYS_WRITE:
+			f->R.rax = sys_write (f->R.rdi, (const void *) f->R.rsi, f->R.rdx);
+			break;
+		case SYS_SEEK:
+			sys_seek (f->R.rdi, f->R.rsi);
+			break;
+		case SYS_TELL:
+			f->R.rax = sys_tell (f->R.rdi);
+			break;
+		case SYS_CLOSE:
+			process_close_file (f->R.rdi);
+			break;
+#ifdef VM
+		case SYS_MMAP:
+			f->R.rax = (uint64_t) sys_mmap ((void *) f->R.rdi, f->R.rsi,
+					f->R.rdx, f->R.r10, f->R.r8);
+			break;
+		case SYS_MUNMAP:
+			sys_munmap ((void *) f->R.rdi);
+			break;
+#endif
+		default:
+			sys_exit (-1);
+	}
+}
+
+/* Terminates the current process with STATUS. */
+static void
+sys_exit (int status) {
+	thread_current ()->exit_status = status;
 	thread_exit ();
 }
+
+/* Replaces the current process's program with the one that
+ * CMD_LINE names, passing it the arguments that follow.  Returns
+ * -1 only if there is no memory to copy CMD_LINE into.  The old
+ * program is gone before the new one loads, so if loading fails
+ * the process exits with status -1. */
+static int
+sys_exec (const char *cmd_line) {
+	char *copy;
+
+	check_string (cmd_line);
+	copy = palloc_get_page (0);
+	if (copy == NULL)
+		return -1;
+	strlcpy (copy, cmd_line, PGSIZE);
+
+	/* process_exec() frees COPY. */
+	if (process_exec (copy) < 0)
+		sys_exit (-1);
+	NOT_REACHED ();
+}
+
+/* Creates a file named FILE, INITIAL_SIZE bytes long.  Returns
+ * true if successful. */
+static bool
+sys_create (const char *file, unsigned initial_size) {
+	bool success;
+
+	check_string (file);
+	lock_acquire (&filesys_lock);
+	success = filesys_create (file, initial_size);
+	lock_release (&filesys_lock);
+	return success;
+}
+
+/* Deletes the file named FILE.  Returns true if successful. */
+static bool
+sys_remove (const char *file) {
+	bool success;
+
+	check_string (file);
+	lock_acquire (&filesys_lock);
+	success = filesys_remove (file);
+	lock_release (&filesys_lock);
+	return success;
+}
+
+/* Opens the file named FILE and returns a new file descriptor
+ * for it, or -1 on failure. */
+static int
+sys_open (const char *file) {
+	struct file *f;
+	int fd;
+
+	check_string (file);
+	lock_acquire (&filesys_lock);
+	f = filesys_open (file);
+	lock_release (&filesys_lock);
+	if (f == NULL)
+		return -1;
+
+	fd = process_add_file (f);
+	if (fd < 0) {
+		lock_acquire (&filesys_lock);
+		file_close (f);
+		lock_release (&filesys_lock);
+	}
+	return fd;
+}
+
+/* Returns the size in bytes of the file open as FD, or -1. */
+static int
+sys_filesize (int fd) {
+	struct file *f = process_get_file (fd);
+	int size;
+
+	if (f == NULL)
+		return -1;
+	lock_acquire (&filesys_lock);
+	size = file_length (f);
+	lock_release (&filesys_lock);
+	return size;
+}
+
+/* Reads up to SIZE bytes into BUFFER from FD, which is the
+ * keyboard if it is 0.  Returns the number of bytes read, or -1
+ * if FD is not open for reading. */
+static int
+sys_read (int fd, void *buffer, unsigned size) {
+	uint8_t *dst = buffer;
+	struct file *f;
+	uint8_t *bounce;
+	unsigned ofs;
+
+	check_buffer (buffer, size, true);
+	if (fd == STDIN_FILENO) {
+		for (ofs = 0; ofs < size; ofs++)
+			dst[ofs] = input_getc ();
+		return size;
+	}
+
+	f = process_get_file (fd);
+	if (f == NULL)
+		return -1;
+
+	/* Read into a kernel page and copy from there, so that the
+	 * file system never takes a page fault while we hold its
+	 * lock. */
+	bounce = palloc_get_page (0);
+	if (bounce == NULL)
+		return -1;
+	for (ofs = 0; ofs < size; ) {
+		size_t chunk = size - ofs < PGSIZE ? size - ofs : PGSIZE;
+		off_t n;
+
+		lock_acquire (&filesys_lock);
+		n = file_read (f, bounce, chunk);
+		lock_release (&filesys_lock);
+		memcpy (dst + ofs, bounce, n);
+		ofs += n;
+		if ((size_t) n < chunk)
+			break;
+	}
+	palloc_free_page (bounce);
+	return ofs;
+}
+
+/* Writes SIZE bytes from BUFFER to FD, which is the console if
+ * it is 1.  Returns the number of bytes written, which may be
+ * less than SIZE at the end of a file, or -1 if FD is not open
+ * for writing. */
+static int
+sys_write (int fd, const void *buffer, unsigned size) {
+	const uint8_t *src = buffer;
+	struct file *f;
+	uint8_t *bounce;
+	unsigned ofs;
+
+	check_buffer (buffer, size, false);
+	if (fd == STDOUT_FILENO) {
+		char buf[256];
+
+		/* Copy through a kernel buffer in chunks, so that putbuf(),
+		 * which holds the console lock, never takes a page fault. */
+		for (ofs = 0; ofs < size; ofs += sizeof buf) {
+			size_t n = size - ofs < sizeof buf ? size - ofs : sizeof buf;
+
+			memcpy (buf, src + ofs, n);
+			putbuf (buf, n);
+		}
+		return size;
+	}
+
+	f = process_get_file (fd);
+	if (f == NULL)
+		return -1;
+
+	/* As in sys_read(). */
+	bounce = palloc_get_page (0);
+	if (bounce == NULL)
+		return -1;
+	for (ofs = 0; ofs < size; ) {
+		size_t chunk = size - ofs < PGSIZE ? size - ofs : PGSIZE;
+		off_t n;
+
+		memcpy (bounce, src + ofs, chunk);
+		lock_acquire (&filesys_lock);
+		n = file_write (f, bounce, chunk);
+		lock_release (&filesys_lock);
+		ofs += n;
+		if ((size_t) n < chunk)
+			break;
+	}
+	palloc_free_page (bounce);
+	return ofs;
+}
+
+/* Sets the position of the file open as FD to POSITION. */
+static void
+sys_seek (int fd, unsigned position) {
+	struct file *f = process_get_file (fd);
+
+	if (f == NULL)
+		return;
+	lock_acquire (&filesys_lock);
+	file_seek (f, position);
+	lock_release (&filesys_lock);
+}
+
+/* Returns the position of the file open as FD. */
+static unsigned
+sys_tell (int fd) {
+	struct file *f = process_get_file (fd);
+	unsigned position;
+
+	if (f == NULL)
+		return -1;
+	lock_acquire (&filesys_lock);
+	position = file_tell (f);
+	lock_release (&filesys_lock);
+	return position;
+}
+
+#ifdef VM
+/* Maps LENGTH bytes of the file open as FD, from OFFSET on, at
+ * ADDR.  Returns ADDR, or a null pointer if ADDR or OFFSET is not
+ * page-aligned, the range is empty, not all user memory, or
+ * overlaps another mapping, or FD is not a mappable file. */
+static void *
+sys_mmap (void *addr, size_t length, int writable, int fd, off_t offset) {
+	struct file *f = process_get_file (fd);
+	void *mapping;
+
+	if (f == NULL || addr == NULL || pg_ofs (addr) != 0 || length == 0
+			|| (uint64_t) addr + length < (uint64_t) addr
+			|| !is_user_vaddr (addr)
+			|| !is_user_vaddr ((uint8_t *) addr + length - 1))
+		return NULL;
+
+	lock_acquire (&filesys_lock);
+	mapping = do_mmap (addr, length, writable, f, offset);
+	lock_release (&filesys_lock);
+	return mapping;
+}
+
+/* Removes the mapping that sys_mmap() made at ADDR, writing back
+ * the pages that were modified. */
+static void
+sys_munmap (void *addr) {
+	lock_acquire (&filesys_lock);
+	do_munmap (addr);
+	lock_release (&filesys_lock);
+}
+#endif
+
+/* Returns true if UADDR is in a page that the current process may
+ * read, or write if WRITE is true, which under VM need not be
+ * present yet. */
+static bool
+user_page_ok (const void *uaddr, bool write) {
+	struct thread *t = thread_current ();
+	void *upage = pg_round_down (uaddr);
+
+	if (uaddr == NULL || !is_user_vaddr (uaddr))
+		return false;
+#ifdef VM
+	struct page *page = spt_find_page (&t->spt, upage);
+	if (page != NULL)
+		return !write || page->writable;
+
+	struct vma *vma = spt_find_vma (&t->spt, upage);
+	return vma != NULL && (!write || vma->writable);
+#else
+	uint64_t *pte = pml4e_walk (t->pml4, (uint64_t) upage, 0);
+	return pte != NULL && (*pte & PTE_P) != 0
+		&& (!write || is_writable (pte));
+#endif
+}
+
+/* Kills the current process unless all of the SIZE bytes at
+ * BUFFER are user memory it may read, or write if WRITE is
+ * true. */
+static void
+check_buffer (const void *buffer, size_t size, bool write) {
+	const uint8_t *p = buffer;
+
+	if (size == 0)
+		return;
+	if ((uint64_t) p + size < (uint64_t) p)
+		sys_exit (-1);
+	for (p = pg_round_down (p); p < (const uint8_t *) buffer + size;
+			p += PGSIZE)
+		if (!user_page_ok (p < (const uint8_t *) buffer ? buffer : p, write))
+			sys_exit (-1);
+}
+
+/* Kills the current process unless STR is a null-terminated string
+ * in user memory it may read. */
+static void
+check_string (const char *str) {
+	for (;;) {
+		const char *end = pg_round_up (str + 1);
+
+		if (!user_page_ok (str, false))
+			sys_exit (-1);
+		for (; str < end; str++)
+			if (*str == '\0')
+				return;
+	}
+}
@@ -2,6 +2,7 @@
 #include <debug.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/cpu.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -43,32 +44,48 @@
  *      not in use, so we can always use that.  Thus, when the
  *      scheduler switches threads, it also changes the TSS's
  *      stack pointer to point to the new thread's kernel stack.
- *      (The call is in schedule in thread.c.) */
-
-/* Kernel TSS. */
-struct task_state *tss;
+ *      (The call is in schedule in thread.c.)
+ *
+ *  Each CPU needs a TSS of its own, since each runs a different
+ *  thread.  The TSS of each CPU hangs off its struct cpu. */
 
-/* Initializes the kernel TSS. */
+/* Initializes the kernel TSS of the running CPU, which must be
+ * the BSP. */
 void
 tss_init (void) {
+	struct cpu *c = cpu_current ();
+
 	/* Our TSS is never used in a call gate or task gate, so only a
 	 * few fields of it are ever referenced, and those are the only
 	 * ones we initialize. */
-	tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	c->tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
 	tss_update (thread_current ());
 }
 
-/* Returns the kernel TSS. */
+/* Initializes the kernel TSS of AP C, which has not been started
+ * yet.  Called by the BSP, so that the AP does not need to
+ * allocate memory before it can take part in scheduling. */
+void
+tss_init_ap (struct cpu *c) {
+	c->tss = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+	c->tss->rsp0 = (uint64_t) c->idle_thread + PGSIZE;
+}
+
+/* Returns the running CPU's kernel TSS. */
 struct task_state *
 tss_get (void) {
+	struct task_state *tss = cpu_current ()->tss;
+
 	ASSERT (tss != NULL);
 	return tss;
 }
 
-/* Sets the ring 0 stack pointer in the TSS to point to the end
- * of the thread stack. */
+/* Sets the ring 0 stack pointer in the running CPU's TSS to
+ * point to the end of the thread stack. */
 void
 tss_update (struct thread *next) {
+	struct task_state *tss = cpu_current ()->tss;
+
 	ASSERT (tss != NULL);
 	tss->rsp0 = (uint64_t) next + PGSIZE;
 }
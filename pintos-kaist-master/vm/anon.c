@@ -1,6 +1,7 @@
 /* anon.c: Implementation of page for non-disk image (a.k.a. anonymous page). */
 
 #include "vm/vm.h"
+#include "vm/zswap.h"
 #include "devices/disk.h"
 
 /* DO NOT MODIFY BELOW LINE */
@@ -20,33 +21,83 @@ static const struct page_operations anon_ops = {
 /* Initialize the data for anonymous pages */
 void
 vm_anon_init (void) {
-	/* TODO: Set up the swap_disk. */
-	swap_disk = NULL;
+	swap_disk = disk_get (1, 1);
+	swap_init (swap_disk);
+	zswap_init ();
 }
 
 /* Initialize the file mapping */
 bool
-anon_initializer (struct page *page, enum vm_type type, void *kva) {
+anon_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &anon_ops;
 
 	struct anon_page *anon_page = &page->anon;
+	anon_page->slot = SWAP_SLOT_NONE;
+	anon_page->zswap = NULL;
+	return true;
 }
 
-/* Swap in the page by read contents from the swap disk. */
+/* Swap in the page by read contents from the swap disk, or from
+ * the compressed pool if it went there. */
 static bool
 anon_swap_in (struct page *page, void *kva) {
 	struct anon_page *anon_page = &page->anon;
+
+	if (zswap_load (anon_page->zswap, kva)) {
+		zswap_free (anon_page->zswap);
+		anon_page->zswap = NULL;
+		return true;
+	}
+
+	ASSERT (anon_page->slot != SWAP_SLOT_NONE);
+	swap_read (anon_page->slot, kva);
+	swap_free (anon_page->slot);
+	anon_page->slot = SWAP_SLOT_NONE;
+	return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
+/* Reads the contents of PAGE, which is swapped out, into the page
+ * at KVA, leaving PAGE swapped out as it was.  For fork(), which
+ * gives the child its own copy of a page that is not in memory. */
+void
+anon_read_swapped (struct page *page, void *kva) {
+	struct anon_page *anon_page = &page->anon;
+
+	if (zswap_load (anon_page->zswap, kva))
+		return;
+
+	ASSERT (anon_page->slot != SWAP_SLOT_NONE);
+	swap_read (anon_page->slot, kva);
+}
+
+/* Swap out the page by writing contents to the swap disk, unless
+ * it fits in the compressed pool.  A write to disk is only
+ * queued, in the slots its owner has reserved; the caller must
+ * call swap_flush() before it reuses the frame. */
 static bool
 anon_swap_out (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+	size_t slot;
+
+	anon_page->zswap = zswap_store (page->frame->kva);
+	if (anon_page->zswap != NULL)
+		return true;
+
+	slot = swap_write (&page->owner->spt.swap_cursor, page->frame->kva);
+	if (slot == SWAP_SLOT_NONE)
+		return false;
+	anon_page->slot = slot;
+	return true;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void
 anon_destroy (struct page *page) {
 	struct anon_page *anon_page = &page->anon;
+
+	zswap_free (anon_page->zswap);
+	if (anon_page->slot != SWAP_SLOT_NONE)
+		swap_free (anon_page->slot);
 }
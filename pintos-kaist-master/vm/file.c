@@ -1,5 +1,9 @@
 /* file.c: Implementation of memory backed file object (mmaped object). */
 
+#include <string.h>
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 
 static bool file_backed_swap_in (struct page *page, void *kva);
@@ -21,38 +25,100 @@ vm_file_init (void) {
 
 /* Initialize the file backed page */
 bool
-file_backed_initializer (struct page *page, enum vm_type type, void *kva) {
+file_backed_initializer (struct page *page, enum vm_type type UNUSED,
+		void *kva UNUSED) {
 	/* Set up the handler */
 	page->operations = &file_ops;
 
 	struct file_page *file_page = &page->file;
+	struct vma *vma = page->vma;
+
+	*file_page = (struct file_page) { .file = NULL };
+	if (vma != NULL && vma->file != NULL) {
+		size_t ofs = (uint8_t *) page->va - (uint8_t *) vma->start;
+
+		file_page->file = vma->file;
+		file_page->offset = vma->offset + ofs;
+		if (ofs < vma->file_bytes)
+			file_page->bytes = vma->file_bytes - ofs < PGSIZE
+				? vma->file_bytes - ofs : PGSIZE;
+	}
+	return true;
 }
 
 /* Swap in the page by read contents from the file. */
 static bool
 file_backed_swap_in (struct page *page, void *kva) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (file_page->bytes > 0
+			&& file_read_at (file_page->file, kva, file_page->bytes,
+				file_page->offset) != (off_t) file_page->bytes)
+		return false;
+	memset ((uint8_t *) kva + file_page->bytes, 0,
+			PGSIZE - file_page->bytes);
+	return true;
 }
 
-/* Swap out the page by writeback contents to the file. */
+/* Swap out the page by writeback contents to the file.  A clean
+ * page is dropped: swapping it in reads it again. */
 static bool
 file_backed_swap_out (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (file_page->file == NULL || file_page->bytes == 0
+			|| !pml4_is_dirty (page->owner->pml4, page->va))
+		return true;
+	if (file_write_at (file_page->file, page->frame->kva, file_page->bytes,
+				file_page->offset) != (off_t) file_page->bytes)
+		return false;
+	pml4_set_dirty (page->owner->pml4, page->va, false);
+	return true;
 }
 
-/* Destory the file backed page. PAGE will be freed by the caller. */
+/* Destory the file backed page. PAGE will be freed by the caller.
+ * Writes the page back to its file first if it was modified. */
 static void
 file_backed_destroy (struct page *page) {
-	struct file_page *file_page UNUSED = &page->file;
+	struct file_page *file_page = &page->file;
+
+	if (page->frame != NULL && file_page->file != NULL
+			&& file_page->bytes > 0
+			&& pml4_is_dirty (thread_current ()->pml4, page->va))
+		file_write_at (file_page->file, page->frame->kva, file_page->bytes,
+				file_page->offset);
 }
 
-/* Do the mmap */
+/* Do the mmap.  Maps LENGTH bytes of FILE, starting at OFFSET,
+ * at ADDR, with the part past the end of the file reading as
+ * zeros.  Returns ADDR, or a null pointer on failure.  The pages
+ * are only read in as they are touched. */
 void *
 do_mmap (void *addr, size_t length, int writable,
 		struct file *file, off_t offset) {
+	off_t file_len;
+	size_t file_bytes;
+
+	if (file == NULL || offset < 0 || offset % PGSIZE != 0)
+		return NULL;
+	file_len = file_length (file);
+	if (file_len <= offset)
+		return NULL;
+	file_bytes = (size_t) (file_len - offset) < length
+		? (size_t) (file_len - offset) : length;
+
+	if (!vm_map_range (addr, length, VM_FILE, writable, file, offset,
+				file_bytes))
+		return NULL;
+	return addr;
 }
 
-/* Do the munmap */
+/* Do the munmap.  Unmaps the mapping that do_mmap() made at
+ * ADDR, writing back the pages that were modified. */
 void
 do_munmap (void *addr) {
+	struct vma *vma = spt_find_vma (&thread_current ()->spt, addr);
+
+	if (vma != NULL && vma->start == addr && VM_TYPE (vma->type) == VM_FILE)
+		vm_unmap_range (vma);
 }
@@ -0,0 +1,266 @@
+/* swap.c: Swap disk management for anonymous pages. */
+
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/disk.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "intrinsic.h"
+
+/* Swapping a page at a time, to wherever a free slot happens to
+ * be, spends most of the disk's time on seeks and commands rather
+ * than on transfers.  To keep transfers long and sequential:
+ *
+ * - Slots are handed out to processes SWAP_CLUSTER adjacent slots
+ *   at a time, through each process's swap_cursor, so that one
+ *   process's pages sit next to each other on disk however many
+ *   processes are swapping at once.
+ *
+ * - swap_write() only queues a page.  swap_flush(), or a full
+ *   queue, writes the queued pages in slot order, with one disk
+ *   command for each run of adjacent slots.
+ *
+ * - swap_read() reads the slot asked for together with the slots
+ *   in use just after it, up to SWAP_CLUSTER in all, into a
+ *   read-ahead buffer.  They most likely belong to the same
+ *   process and will be faulted in soon, and then they are copied
+ *   from the buffer instead of being read again. */
+
+/* Sectors per slot. */
+#define SLOT_SECTORS (PGSIZE / DISK_SECTOR_SIZE)
+
+/* Most pages swap_write() queues before writing them. */
+#define WRITE_BATCH 16
+
+static struct disk *swap_disk;      /* Null if there is no swap disk. */
+static struct bitmap *slots;        /* Slots in use or reserved. */
+static size_t slot_hint;            /* Where to look for free slots. */
+static struct lock swap_lock;       /* Protects everything here. */
+
+/* A page queued for writing.  Its memory must stay as it is until
+ * it is written. */
+struct pending_write {
+	size_t slot;
+	const void *kva;
+};
+static struct pending_write pending[WRITE_BATCH];
+static size_t pending_cnt;
+static uint8_t *write_buf;          /* WRITE_BATCH pages. */
+
+/* Read-ahead buffer.  Holds slots RA_START...RA_START+RA_CNT-1, of
+ * which those whose RA_VALID[] entry is true have not been freed
+ * or written since they were read. */
+static uint8_t *ra_buf;             /* SWAP_CLUSTER pages. */
+static size_t ra_start;
+static size_t ra_cnt;
+static bool ra_valid[SWAP_CLUSTER];
+
+/* Statistics. */
+static long long out_cnt;           /* Pages written. */
+static long long write_cnt;         /* Disk commands that wrote them. */
+static long long in_cnt;            /* Pages swapped in. */
+static long long ra_hit_cnt;        /* ...found in the read-ahead buffer. */
+static long long read_page_cnt;     /* Pages read from disk. */
+static long long read_cnt;          /* Disk commands that read them. */
+static uint64_t out_cycles;         /* TSC cycles spent writing. */
+static uint64_t in_cycles;          /* TSC cycles spent reading. */
+
+static size_t reserve_slots (size_t cnt);
+static void flush_pending (void);
+static void ra_invalidate (size_t slot);
+
+/* Sets up swapping to DISK, or no swapping if DISK is null. */
+void
+swap_init (struct disk *disk) {
+	lock_init (&swap_lock);
+	if (disk == NULL)
+		return;
+
+	slots = bitmap_create (disk_size (disk) / SLOT_SECTORS);
+	write_buf = palloc_get_multiple (0, WRITE_BATCH);
+	ra_buf = palloc_get_multiple (0, SWAP_CLUSTER);
+	if (slots == NULL || write_buf == NULL || ra_buf == NULL)
+		PANIC ("swap_init: out of memory");
+	swap_disk = disk;
+}
+
+/* Prints swap statistics. */
+void
+swap_print_stats (void) {
+	if (swap_disk == NULL)
+		return;
+
+	printf ("Swap: %lld pages out in %lld writes, "
+			"%llu cycles per page\n",
+			out_cnt, write_cnt,
+			out_cnt > 0 ? out_cycles / out_cnt : 0);
+	printf ("Swap: %lld pages in, %lld read ahead, "
+			"%lld read in %lld reads, %llu cycles per page\n",
+			in_cnt, ra_hit_cnt, read_page_cnt, read_cnt,
+			read_page_cnt > 0 ? in_cycles / read_page_cnt : 0);
+}
+
+/* Initializes CUR as a cursor with no slots reserved. */
+void
+swap_cursor_init (struct swap_cursor *cur) {
+	cur->next = cur->end = 0;
+}
+
+/* Gives back the slots that CUR has reserved but not used. */
+void
+swap_cursor_release (struct swap_cursor *cur) {
+	lock_acquire (&swap_lock);
+	if (cur->next < cur->end)
+		bitmap_set_multiple (slots, cur->next, cur->end - cur->next, false);
+	cur->next = cur->end = 0;
+	lock_release (&swap_lock);
+}
+
+/* Queues the page at KVA to be written to the next slot of CUR,
+ * reserving a new cluster for CUR if it has none left, and
+ * returns the slot.  The page is written by swap_flush() at the
+ * latest, and KVA must not change until then.  Returns
+ * SWAP_SLOT_NONE if the swap disk is full or missing. */
+size_t
+swap_write (struct swap_cursor *cur, const void *kva) {
+	size_t slot;
+
+	if (swap_disk == NULL)
+		return SWAP_SLOT_NONE;
+
+	lock_acquire (&swap_lock);
+	if (cur->next == cur->end) {
+		size_t cnt = SWAP_CLUSTER;
+		size_t start = reserve_slots (cnt);
+
+		/* Too fragmented for a cluster: any slot will do. */
+		if (start == BITMAP_ERROR) {
+			cnt = 1;
+			start = reserve_slots (cnt);
+		}
+		if (start == BITMAP_ERROR) {
+			lock_release (&swap_lock);
+			return SWAP_SLOT_NONE;
+		}
+		cur->next = start;
+		cur->end = start + cnt;
+	}
+	slot = cur->next++;
+
+	if (pending_cnt == WRITE_BATCH)
+		flush_pending ();
+	pending[pending_cnt++] = (struct pending_write) { slot, kva };
+	lock_release (&swap_lock);
+	return slot;
+}
+
+/* Writes the pages queued by swap_write(). */
+void
+swap_flush (void) {
+	lock_acquire (&swap_lock);
+	if (pending_cnt > 0)
+		flush_pending ();
+	lock_release (&swap_lock);
+}
+
+/* Reads SLOT, which must have been written, into the page at KVA,
+ * with read-ahead as described at the top of the file. */
+void
+swap_read (size_t slot, void *kva) {
+	ASSERT (swap_disk != NULL);
+
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (slots, slot));
+
+	in_cnt++;
+	if (slot - ra_start < ra_cnt && ra_valid[slot - ra_start])
+		ra_hit_cnt++;
+	else {
+		uint64_t start = rdtsc ();
+		size_t cnt = 1;
+		size_t i;
+
+		while (cnt < SWAP_CLUSTER && slot + cnt < bitmap_size (slots)
+				&& bitmap_test (slots, slot + cnt))
+			cnt++;
+		disk_read_sectors (swap_disk, slot * SLOT_SECTORS, cnt * SLOT_SECTORS,
+				ra_buf);
+		ra_start = slot;
+		ra_cnt = cnt;
+		for (i = 0; i < cnt; i++)
+			ra_valid[i] = true;
+
+		read_page_cnt += cnt;
+		read_cnt++;
+		in_cycles += rdtsc () - start;
+	}
+	memcpy (kva, ra_buf + (slot - ra_start) * PGSIZE, PGSIZE);
+	lock_release (&swap_lock);
+}
+
+/* Frees SLOT. */
+void
+swap_free (size_t slot) {
+	lock_acquire (&swap_lock);
+	ASSERT (bitmap_test (slots, slot));
+	bitmap_reset (slots, slot);
+	ra_invalidate (slot);
+	lock_release (&swap_lock);
+}
+
+/* Marks CNT adjacent free slots in use and returns the first, or
+ * BITMAP_ERROR if there are not that many together. */
+static size_t
+reserve_slots (size_t cnt) {
+	size_t start = bitmap_scan_and_flip (slots, slot_hint, cnt, false);
+
+	if (start == BITMAP_ERROR)
+		start = bitmap_scan_and_flip (slots, 0, cnt, false);
+	if (start != BITMAP_ERROR)
+		slot_hint = start + cnt;
+	return start;
+}
+
+/* Writes the queued pages, one disk command per run of adjacent
+ * slots. */
+static void
+flush_pending (void) {
+	uint64_t start = rdtsc ();
+	size_t i, j;
+
+	ASSERT (lock_held_by_current_thread (&swap_lock));
+
+	for (i = 1; i < pending_cnt; i++) {
+		struct pending_write w = pending[i];
+
+		for (j = i; j > 0 && pending[j - 1].slot > w.slot; j--)
+			pending[j] = pending[j - 1];
+		pending[j] = w;
+	}
+
+	for (i = 0; i < pending_cnt; i = j) {
+		for (j = i; j < pending_cnt
+				&& pending[j].slot == pending[i].slot + (j - i); j++) {
+			memcpy (write_buf + (j - i) * PGSIZE, pending[j].kva, PGSIZE);
+			ra_invalidate (pending[j].slot);
+		}
+		disk_write_sectors (swap_disk, pending[i].slot * SLOT_SECTORS,
+				(j - i) * SLOT_SECTORS, write_buf);
+		write_cnt++;
+	}
+
+	out_cnt += pending_cnt;
+	pending_cnt = 0;
+	out_cycles += rdtsc () - start;
+}
+
+/* Forgets any copy of SLOT in the read-ahead buffer. */
+static void
+ra_invalidate (size_t slot) {
+	if (slot - ra_start < ra_cnt)
+		ra_valid[slot - ra_start] = false;
+}
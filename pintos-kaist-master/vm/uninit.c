@@ -8,6 +8,8 @@
  * function.
  * */
 
+#include <string.h>
+#include "threads/vaddr.h"
 #include "vm/vm.h"
 #include "vm/uninit.h"
 
@@ -51,7 +53,9 @@ uninit_initialize (struct page *page, void *kva) {
 	vm_initializer *init = uninit->init;
 	void *aux = uninit->aux;
 
-	/* TODO: You may need to fix this function. */
+	/* A page with no initializer starts out as zeros. */
+	if (init == NULL)
+		memset (kva, 0, PGSIZE);
 	return uninit->page_initializer (page, uninit->type, kva) &&
 		(init ? init (page, aux) : true);
 }
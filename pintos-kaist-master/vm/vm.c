@@ -1,8 +1,52 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
+#include <round.h>
+#include <string.h>
+#include <stdio.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "devices/lapic.h"
+#include "intrinsic.h"
 #include "vm/vm.h"
 #include "vm/inspect.h"
+#include "vm/zswap.h"
+
+/* Cache that `struct page's are allocated from.  free() returns
+ * them to it, so vm_dealloc_page() needs no change. */
+struct kmem_cache page_struct_cache;
+
+/* Frame table: every frame that holds a user page, in the order
+ * the clock hand sweeps them.  New frames go in just behind the
+ * hand, so that they are the last to be looked at.
+ *
+ * FRAME_LOCK protects the frame table and, while a page is being
+ * evicted, the page's `frame' member: a process that faults on
+ * the page, or destroys it, waits for the eviction to finish by
+ * acquiring the lock. */
+static struct list frame_table;
+static struct list_elem *clock_hand;    /* Next frame to look at. */
+static struct lock frame_lock;
+
+/* Maximum number of frames evicted at a time. */
+#define EVICT_BATCH 8
+
+/* Statistics. */
+static long long scanned_cnt;       /* Frames looked at by the clock. */
+static long long reclaimed_cnt;     /* Frames evicted. */
+static long long written_back_cnt;  /* Evicted pages that were written. */
+static long long shared_cnt;        /* Frames shared with a child by fork. */
+static long long cow_copy_cnt;      /* Shared frames copied on write. */
+
+/* Number of TLB flush IPIs that each CPU has handled. */
+static volatile unsigned tlb_flush_cnt[CPU_MAX];
+
+static intr_handler_func tlb_flush_ipi;
+static void tlb_shootdown (struct thread *);
 
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
@@ -15,7 +59,24 @@ vm_init (void) {
 #endif
 	register_inspect_intr ();
 	/* DO NOT MODIFY UPPER LINES. */
-	/* TODO: Your code goes here. */
+	kmem_cache_init (&page_struct_cache, "page", sizeof (struct page), 0,
+			NULL);
+	list_init (&frame_table);
+	clock_hand = list_end (&frame_table);
+	lock_init (&frame_lock);
+	intr_register_ipi (LAPIC_IPI_TLB, tlb_flush_ipi, "TLB flush IPI");
+}
+
+/* Prints frame eviction statistics. */
+void
+vm_print_stats (void) {
+	printf ("Frames: %lld scanned, %lld reclaimed, %lld written back\n",
+			scanned_cnt, reclaimed_cnt, written_back_cnt);
+	if (shared_cnt > 0)
+		printf ("COW: %lld frames shared by fork, %lld copied on write\n",
+				shared_cnt, cow_copy_cnt);
+	swap_print_stats ();
+	zswap_print_stats ();
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -32,10 +93,30 @@ page_get_type (struct page *page) {
 	}
 }
 
+/* Turns an uninit page into a page of a particular type. */
+typedef bool page_initializer_func (struct page *, enum vm_type, void *kva);
+
 /* Helpers */
-static struct frame *vm_get_victim (void);
+static struct frame *clock_advance (void);
+static void frame_table_remove (struct frame *frame);
+static void frame_link (struct frame *frame, struct page *page);
+static void frame_unlink (struct page *page);
+static bool page_needs_write (struct page *page);
+static size_t vm_get_victims (struct frame *victims[], size_t max);
+static bool vm_evict_page (struct frame *frame);
 static bool vm_do_claim_page (struct page *page);
 static struct frame *vm_evict_frame (void);
+static void vm_free_frame (struct frame *frame);
+static struct page *vma_new_page (struct supplemental_page_table *spt,
+		struct vma *vma, void *va);
+static bool vma_load_page (struct page *page, void *aux);
+static void spt_destroy_page (struct page *page);
+static bool page_copy (struct supplemental_page_table *dst,
+		struct page *src);
+static page_initializer_func *initializer_of (enum vm_type type);
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static rb_less_func vma_less;
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -47,74 +128,415 @@ vm_alloc_page_with_initializer (enum vm_type type, void *upage, bool writable,
 	ASSERT (VM_TYPE(type) != VM_UNINIT)
 
 	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct page *page;
 
 	/* Check wheter the upage is already occupied or not. */
-	if (spt_find_page (spt, upage) == NULL) {
-		/* TODO: Create the page, fetch the initialier according to the VM type,
-		 * TODO: and then create "uninit" page struct by calling uninit_new. You
-		 * TODO: should modify the field after calling the uninit_new. */
-
-		/* TODO: Insert the page into the spt. */
+	if (spt_find_page (spt, upage) == NULL
+			&& spt_find_vma (spt, upage) == NULL) {
+		page = kmem_cache_alloc (&page_struct_cache);
+		if (page == NULL)
+			goto err;
+		uninit_new (page, upage, init, type, aux, initializer_of (type));
+		page->owner = thread_current ();
+		page->writable = writable;
+
+		if (!spt_insert_page (spt, page)) {
+			free (page);
+			goto err;
+		}
+		return true;
 	}
 err:
 	return false;
 }
 
-/* Find VA from spt and return page. On error, return NULL. */
+/* Find VA from spt and return page. On error, return NULL.
+ * Pages of a VMA that have not been touched yet do not exist, so
+ * they are not found. */
 struct page *
-spt_find_page (struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function. */
+spt_find_page (struct supplemental_page_table *spt, void *va) {
+	struct page key = { .va = pg_round_down (va) };
+	struct hash_elem *e;
 
-	return page;
+	e = hash_find (&spt->pages, &key.spt_elem);
+	return e != NULL ? hash_entry (e, struct page, spt_elem) : NULL;
 }
 
 /* Insert PAGE into spt with validation. */
 bool
-spt_insert_page (struct supplemental_page_table *spt UNUSED,
-		struct page *page UNUSED) {
-	int succ = false;
-	/* TODO: Fill this function. */
+spt_insert_page (struct supplemental_page_table *spt, struct page *page) {
+	ASSERT (pg_ofs (page->va) == 0);
 
-	return succ;
+	return hash_insert (&spt->pages, &page->spt_elem) == NULL;
 }
 
 void
 spt_remove_page (struct supplemental_page_table *spt, struct page *page) {
-	vm_dealloc_page (page);
+	hash_delete (&spt->pages, &page->spt_elem);
+	if (page->vma != NULL)
+		list_remove (&page->vma_elem);
+	spt_destroy_page (page);
+}
+
+/* Returns the VMA in SPT that contains VA, or a null pointer if
+ * there is none.  Takes constant time if it is the same VMA as
+ * last time. */
+struct vma *
+spt_find_vma (struct supplemental_page_table *spt, void *va) {
+	struct vma *vma = spt->last_vma;
+	struct vma key = { .start = va };
+	struct rb_elem *e;
+
+	if (vma != NULL && vma->start <= va && va < vma->end)
+		return vma;
+
+	e = rb_floor (&spt->vmas, &key.elem);
+	if (e == NULL)
+		return NULL;
+	vma = rb_entry (e, struct vma, elem);
+	if (va >= vma->end)
+		return NULL;
+	spt->last_vma = vma;
+	return vma;
+}
+
+/* Maps the LENGTH bytes at ADDR, which must be page-aligned, in
+ * the current process as a VMA of TYPE, writable by the user if
+ * WRITABLE is true.  The first FILE_BYTES bytes come from FILE,
+ * starting at OFFSET, and the rest are zeros; FILE may be null
+ * if FILE_BYTES is 0.  The VMA keeps its own handle on FILE.
+ *
+ * No memory is used for the pages until they are touched.
+ * Returns false if ADDR is not a valid user range, if it overlaps
+ * memory that is already mapped, or if memory is not available. */
+bool
+vm_map_range (void *addr, size_t length, enum vm_type type, bool writable,
+		struct file *file, off_t offset, size_t file_bytes) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+	struct vma *vma;
+	struct rb_elem *e;
+	size_t page_cnt = DIV_ROUND_UP (length, PGSIZE);
+
+	ASSERT (VM_TYPE (type) == VM_ANON || VM_TYPE (type) == VM_FILE);
+	ASSERT (file_bytes <= length);
+	ASSERT (file != NULL || file_bytes == 0);
+
+	if (addr == NULL || pg_ofs (addr) != 0 || length == 0
+			|| !is_user_vaddr (addr)
+			|| page_cnt > ((uint64_t) KERN_BASE - (uint64_t) addr) / PGSIZE)
+		return false;
+
+	vma = malloc (sizeof *vma);
+	if (vma == NULL)
+		return false;
+	vma->start = addr;
+	vma->end = (uint8_t *) addr + page_cnt * PGSIZE;
+	vma->type = type;
+	vma->writable = writable;
+	vma->file = NULL;
+	vma->offset = offset;
+	vma->file_bytes = file_bytes;
+	list_init (&vma->pages);
+
+	/* Must not overlap the VMA below, the VMA above, or any page
+	 * that was created on its own. */
+	e = rb_floor (&spt->vmas, &vma->elem);
+	if (e != NULL && rb_entry (e, struct vma, elem)->end > vma->start)
+		goto fail;
+	e = e != NULL ? rb_next (e) : rb_min (&spt->vmas);
+	if (e != NULL && rb_entry (e, struct vma, elem)->start < vma->end)
+		goto fail;
+	if (hash_size (&spt->pages) < page_cnt) {
+		struct hash_iterator i;
+
+		hash_first (&i, &spt->pages);
+		while (hash_next (&i)) {
+			struct page *p = hash_entry (hash_cur (&i), struct page, spt_elem);
+			if (p->va >= vma->start && p->va < vma->end)
+				goto fail;
+		}
+	} else {
+		uint8_t *va;
+
+		for (va = vma->start; va < (uint8_t *) vma->end; va += PGSIZE)
+			if (spt_find_page (spt, va) != NULL)
+				goto fail;
+	}
+
+	if (file != NULL) {
+		vma->file = file_reopen (file);
+		if (vma->file == NULL)
+			goto fail;
+	}
+	rb_insert (&spt->vmas, &vma->elem);
 	return true;
+
+fail:
+	free (vma);
+	return false;
+}
+
+/* Removes VMA, and each of its pages that has been created, from
+ * the current process. */
+void
+vm_unmap_range (struct vma *vma) {
+	struct supplemental_page_table *spt = &thread_current ()->spt;
+
+	while (!list_empty (&vma->pages)) {
+		struct page *page = list_entry (list_front (&vma->pages),
+				struct page, vma_elem);
+		spt_remove_page (spt, page);
+	}
+
+	rb_remove (&spt->vmas, &vma->elem);
+	if (spt->last_vma == vma)
+		spt->last_vma = NULL;
+	file_close (vma->file);
+	free (vma);
+}
+
+/* Flushes this CPU's TLB, at the request of a CPU that changed a
+ * page table that may be in use here. */
+static void
+tlb_flush_ipi (struct intr_frame *f UNUSED) {
+	lcr3 (rcr3 ());
+	tlb_flush_cnt[cpu_current ()->id]++;
+}
+
+/* Makes sure that no CPU keeps a stale TLB entry for a page of
+ * process T that was just unmapped.  pml4_clear_page() already
+ * flushed this CPU's; the only other CPU that can have one is
+ * the one T is running on, if any, since switching address
+ * spaces reloads CR3.  Interrupts must be on. */
+static void
+tlb_shootdown (struct thread *t) {
+	enum intr_level old_level = intr_disable ();
+	struct cpu *c = t->cpu;
+	unsigned cnt;
+
+	if (c == NULL || c == cpu_current () || c->curr != t) {
+		intr_set_level (old_level);
+		return;
+	}
+	cnt = tlb_flush_cnt[c->id];
+	lapic_send_ipi (c->apic_id, LAPIC_IPI_TLB);
+	intr_set_level (old_level);
+
+	/* The other CPU needs the interrupt lock to take the IPI. */
+	while (tlb_flush_cnt[c->id] == cnt)
+		barrier ();
 }
 
-/* Get the struct frame, that will be evicted. */
+/* Returns the frame under the clock hand and moves the hand on
+ * to the next one, wrapping around at the end of the frame
+ * table, which must not be empty. */
 static struct frame *
-vm_get_victim (void) {
-	struct frame *victim = NULL;
-	 /* TODO: The policy for eviction is up to you. */
+clock_advance (void) {
+	struct frame *frame;
 
-	return victim;
+	if (clock_hand == list_end (&frame_table))
+		clock_hand = list_begin (&frame_table);
+	frame = list_entry (clock_hand, struct frame, elem);
+	clock_hand = list_next (clock_hand);
+	return frame;
+}
+
+/* Removes FRAME from the frame table. */
+static void
+frame_table_remove (struct frame *frame) {
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+
+	if (clock_hand == &frame->elem)
+		clock_hand = list_next (clock_hand);
+	list_remove (&frame->elem);
+}
+
+/* Adds PAGE to the pages that FRAME holds.  The caller must hold
+ * FRAME_LOCK, unless FRAME is pinned and holds no page yet. */
+static void
+frame_link (struct frame *frame, struct page *page) {
+	list_push_back (&frame->pages, &page->frame_elem);
+	frame->ref_cnt++;
+	frame->page = list_entry (list_front (&frame->pages), struct page,
+			frame_elem);
+	page->frame = frame;
+}
+
+/* Takes PAGE out of the pages that its frame holds.  The caller
+ * must hold FRAME_LOCK. */
+static void
+frame_unlink (struct page *page) {
+	struct frame *frame = page->frame;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (frame != NULL && frame->ref_cnt > 0);
+
+	list_remove (&page->frame_elem);
+	frame->ref_cnt--;
+	frame->page = list_empty (&frame->pages) ? NULL
+		: list_entry (list_front (&frame->pages), struct page, frame_elem);
+	page->frame = NULL;
+}
+
+/* Returns true if evicting PAGE means writing it somewhere,
+ * false if its contents can simply be dropped and read again. */
+static bool
+page_needs_write (struct page *page) {
+	if (VM_TYPE (page->operations->type) != VM_FILE)
+		return true;
+	return page->file.file != NULL && page->file.bytes > 0
+		&& pml4_is_dirty (page->owner->pml4, page->va);
+}
+
+/* Chooses up to MAX frames to evict, at most EVICT_BATCH, stores
+ * them in VICTIMS, and returns the number chosen.
+ *
+ * The clock hand sweeps the frame table.  A frame whose page was
+ * accessed since the hand last passed it gets a second chance:
+ * its accessed bit is cleared and it is skipped.  Of the rest,
+ * clean pages are taken first, since they cost nothing to evict;
+ * pages that must be written out are only taken if two sweeps
+ * turn up too few clean ones.  Frames shared copy-on-write are
+ * passed over: they stay in memory until the sharing ends. */
+static size_t
+vm_get_victims (struct frame *victims[], size_t max) {
+	struct frame *dirty[EVICT_BATCH];
+	size_t victim_cnt = 0;
+	size_t dirty_cnt = 0;
+	size_t budget;
+	size_t i;
+
+	ASSERT (lock_held_by_current_thread (&frame_lock));
+	ASSERT (max <= EVICT_BATCH);
+
+	for (budget = 2 * list_size (&frame_table);
+			budget > 0 && victim_cnt < max; budget--) {
+		struct frame *frame = clock_advance ();
+		struct page *page = frame->page;
+		uint64_t *pml4;
+
+		scanned_cnt++;
+		if (frame->pinned || frame->selected || frame->ref_cnt != 1)
+			continue;
+		pml4 = page->owner->pml4;
+		if (pml4_is_accessed (pml4, page->va))
+			pml4_set_accessed (pml4, page->va, false);
+		else if (!page_needs_write (page)) {
+			frame->selected = true;
+			victims[victim_cnt++] = frame;
+		} else if (dirty_cnt < max) {
+			frame->selected = true;
+			dirty[dirty_cnt++] = frame;
+		}
+	}
+
+	for (i = 0; i < dirty_cnt; i++)
+		if (victim_cnt < max)
+			victims[victim_cnt++] = dirty[i];
+		else
+			dirty[i]->selected = false;
+	return victim_cnt;
+}
+
+/* Takes the page out of FRAME: unmaps it, so that its owner
+ * faults and waits on FRAME_LOCK if it touches the page again,
+ * and swaps it out.  Returns true if successful.  On failure,
+ * the page is left mapped in FRAME as it was. */
+static bool
+vm_evict_page (struct frame *frame) {
+	struct page *page = frame->page;
+	uint64_t *pml4 = page->owner->pml4;
+	bool dirty = pml4_is_dirty (pml4, page->va);
+	bool write = page_needs_write (page);
+
+	pml4_clear_page (pml4, page->va);
+	tlb_shootdown (page->owner);
+
+	/* The page may have been written through a stale TLB entry
+	 * after its dirty bit was read above. */
+	if (!dirty && pml4_is_dirty (pml4, page->va)) {
+		dirty = true;
+		write = true;
+	}
+
+	if (!swap_out (page)) {
+		pml4_set_page (pml4, page->va, frame->kva, page->writable);
+		pml4_set_dirty (pml4, page->va, dirty);
+		return false;
+	}
+	if (write)
+		written_back_cnt++;
+	frame_unlink (page);
+	return true;
 }
 
 /* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
+ * Return NULL on error.
+ *
+ * Evicts up to EVICT_BATCH pages at once, so that the cost of a
+ * sweep is spread over several allocations: the first frame
+ * freed goes to the caller and the rest back to the page
+ * allocator, for the next few calls to vm_get_frame(). */
 static struct frame *
 vm_evict_frame (void) {
-	struct frame *victim UNUSED = vm_get_victim ();
-	/* TODO: swap out the victim and return the evicted frame. */
+	struct frame *victims[EVICT_BATCH];
+	size_t cnt, freed_cnt;
+	size_t i;
+
+	lock_acquire (&frame_lock);
+	cnt = vm_get_victims (victims, EVICT_BATCH);
+	for (i = freed_cnt = 0; i < cnt; i++) {
+		struct frame *victim = victims[i];
+
+		victim->selected = false;
+		if (!vm_evict_page (victim))
+			continue;
+		frame_table_remove (victim);
+		reclaimed_cnt++;
+		victims[freed_cnt++] = victim;
+	}
+
+	/* Anonymous pages were only queued for writing.  Write them
+	 * all together before their frames are reused, and before
+	 * their owners, waiting on FRAME_LOCK, can fault them in. */
+	swap_flush ();
+	lock_release (&frame_lock);
 
-	return NULL;
+	for (i = 1; i < freed_cnt; i++)
+		vm_free_frame (victims[i]);
+	return freed_cnt > 0 ? victims[0] : NULL;
 }
 
 /* palloc() and get frame. If there is no available page, evict the page
- * and return it. This always return valid address. That is, if the user pool
- * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * and return it.  Returns a null pointer if no page can be evicted
+ * either.  The frame is in the frame table, pinned, so that it is
+ * not evicted before the caller has filled it and unpinned it. */
 static struct frame *
 vm_get_frame (void) {
 	struct frame *frame = NULL;
-	/* TODO: Fill this function. */
+	void *kva = palloc_get_page (PAL_USER);
+
+	if (kva != NULL) {
+		frame = malloc (sizeof *frame);
+		if (frame == NULL) {
+			palloc_free_page (kva);
+			return NULL;
+		}
+		frame->kva = kva;
+	} else {
+		frame = vm_evict_frame ();
+		if (frame == NULL)
+			return NULL;
+	}
 
-	ASSERT (frame != NULL);
-	ASSERT (frame->page == NULL);
+	frame->page = NULL;
+	list_init (&frame->pages);
+	frame->ref_cnt = 0;
+	frame->pinned = true;
+	frame->selected = false;
+	lock_acquire (&frame_lock);
+	list_insert (clock_hand, &frame->elem);
+	lock_release (&frame_lock);
 	return frame;
 }
 
@@ -123,19 +545,95 @@ static void
 vm_stack_growth (void *addr UNUSED) {
 }
 
-/* Handle the fault on write_protected page */
+/* Handle the fault on write_protected page
+ *
+ * PAGE is writable, so it is mapped read-only because its frame
+ * was shared by fork().  If other pages still share the frame,
+ * PAGE gets a copy of its own; otherwise it just becomes
+ * writable again. */
 static bool
-vm_handle_wp (struct page *page UNUSED) {
+vm_handle_wp (struct page *page) {
+	uint64_t *pml4 = thread_current ()->pml4;
+	struct frame *frame = NULL;
+	struct frame *old;
+
+	lock_acquire (&frame_lock);
+	old = page->frame;
+	if (old != NULL && old->ref_cnt > 1) {
+		lock_release (&frame_lock);
+		frame = vm_get_frame ();
+		if (frame == NULL)
+			return false;
+		lock_acquire (&frame_lock);
+		old = page->frame;
+	}
+
+	/* If the page was evicted meanwhile, which the last sharer's
+	 * page may be, it faults in again writable. */
+	if (old != NULL && old->ref_cnt == 1)
+		pml4_set_writable (pml4, page->va, true);
+	else if (old != NULL) {
+		memcpy (frame->kva, old->kva, PGSIZE);
+		frame_unlink (page);
+		frame_link (frame, page);
+		pml4_clear_page (pml4, page->va);
+		pml4_set_page (pml4, page->va, frame->kva, true);
+		pml4_set_accessed (pml4, page->va, true);
+		frame->pinned = false;
+		frame = NULL;
+		cow_copy_cnt++;
+	}
+
+	/* Not needed after all. */
+	if (frame != NULL)
+		frame_table_remove (frame);
+	lock_release (&frame_lock);
+	if (frame != NULL)
+		vm_free_frame (frame);
+	return true;
 }
 
 /* Return true on success */
 bool
 vm_try_handle_fault (struct intr_frame *f UNUSED, void *addr UNUSED,
 		bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-	struct supplemental_page_table *spt UNUSED = &thread_current ()->spt;
+	struct supplemental_page_table *spt = &thread_current ()->spt;
 	struct page *page = NULL;
-	/* TODO: Validate the fault */
-	/* TODO: Your code goes here */
+	bool present;
+
+	if (addr == NULL || !is_user_vaddr (addr))
+		return false;
+
+	/* A write to a page that is present but read-only is a write
+	 * to a frame shared by fork(). */
+	if (!not_present) {
+		page = spt_find_page (spt, addr);
+		if (page == NULL || !write || !page->writable)
+			return false;
+		return vm_handle_wp (page);
+	}
+
+	/* The page may exist already, or it may be the first touch of
+	 * a page in a VMA. */
+	page = spt_find_page (spt, addr);
+	if (page == NULL) {
+		struct vma *vma = spt_find_vma (spt, addr);
+		if (vma == NULL)
+			return false;
+		page = vma_new_page (spt, vma, pg_round_down (addr));
+		if (page == NULL)
+			return false;
+	}
+	if (write && !page->writable)
+		return false;
+
+	/* If the page is being evicted, wait for that to finish.  If
+	 * it could not be, it is mapped again already. */
+	lock_acquire (&frame_lock);
+	present = page->frame != NULL;
+	lock_release (&frame_lock);
+	if (present)
+		return true;
 
 	return vm_do_claim_page (page);
 }
@@ -150,41 +648,318 @@ vm_dealloc_page (struct page *page) {
 
 /* Claim the page that allocate on VA. */
 bool
-vm_claim_page (void *va UNUSED) {
-	struct page *page = NULL;
-	/* TODO: Fill this function */
+vm_claim_page (void *va) {
+	struct page *page = spt_find_page (&thread_current ()->spt, va);
 
+	if (page == NULL)
+		return false;
 	return vm_do_claim_page (page);
 }
 
 /* Claim the PAGE and set up the mmu. */
 static bool
 vm_do_claim_page (struct page *page) {
+	uint64_t *pml4 = thread_current ()->pml4;
 	struct frame *frame = vm_get_frame ();
 
+	if (frame == NULL)
+		return false;
+
 	/* Set links */
-	frame->page = page;
-	page->frame = frame;
+	frame_link (frame, page);
+	page->owner = thread_current ();
+
+	if (!pml4_set_page (pml4, page->va, frame->kva, page->writable))
+		goto fail;
+	if (!swap_in (page, frame->kva)) {
+		pml4_clear_page (pml4, page->va);
+		goto fail;
+	}
+
+	/* Just brought in because it was needed: not a good victim
+	 * for the next sweep. */
+	pml4_set_accessed (pml4, page->va, true);
+	lock_acquire (&frame_lock);
+	frame->pinned = false;
+	lock_release (&frame_lock);
+	return true;
+
+fail:
+	lock_acquire (&frame_lock);
+	frame_unlink (page);
+	frame_table_remove (frame);
+	lock_release (&frame_lock);
+	vm_free_frame (frame);
+	return false;
+}
+
+/* Gives FRAME's memory back to the page allocator and frees it.
+ * FRAME must not be in the frame table. */
+static void
+vm_free_frame (struct frame *frame) {
+	palloc_free_page (frame->kva);
+	free (frame);
+}
+
+/* Creates the page at VA, which must be in VMA, as an uninit page
+ * that fills itself from the VMA's backing when it is claimed,
+ * and adds it to SPT.  Returns the new page, or a null pointer if
+ * memory is not available. */
+static struct page *
+vma_new_page (struct supplemental_page_table *spt, struct vma *vma,
+		void *va) {
+	struct page *page = kmem_cache_alloc (&page_struct_cache);
+
+	if (page == NULL)
+		return NULL;
+	uninit_new (page, va, vma_load_page, vma->type, vma,
+			initializer_of (vma->type));
+	page->owner = thread_current ();
+	page->vma = vma;
+	page->writable = vma->writable;
+	if (!spt_insert_page (spt, page)) {
+		free (page);
+		return NULL;
+	}
+	list_push_back (&vma->pages, &page->vma_elem);
+	return page;
+}
+
+/* Fills PAGE, which belongs to VMA AUX and has just been given a
+ * frame, from the VMA's file and with zeros. */
+static bool
+vma_load_page (struct page *page, void *aux) {
+	struct vma *vma = aux;
+	uint8_t *kva = page->frame->kva;
+	size_t ofs = (uint8_t *) page->va - (uint8_t *) vma->start;
+	size_t read_bytes = 0;
+
+	if (ofs < vma->file_bytes) {
+		read_bytes = vma->file_bytes - ofs < PGSIZE
+			? vma->file_bytes - ofs : PGSIZE;
+		if (file_read_at (vma->file, kva, read_bytes, vma->offset + ofs)
+				!= (off_t) read_bytes)
+			return false;
+	}
+	memset (kva + read_bytes, 0, PGSIZE - read_bytes);
+	return true;
+}
+
+/* Frees PAGE, which has been taken out of its supplemental page
+ * table, with its frame, if it has one and no other page shares
+ * it. */
+static void
+spt_destroy_page (struct page *page) {
+	struct frame *frame;
+	bool shared = false;
+	void *va = page->va;
+
+	/* Take the frame out of the frame table first, after any
+	 * eviction of the page has finished, so that it cannot be
+	 * chosen while the page is destroyed.  A frame that is still
+	 * shared stays, but the lock is held until PAGE is destroyed,
+	 * since the frame may be evicted as soon as it is not shared:
+	 * a file page is written back from it. */
+	lock_acquire (&frame_lock);
+	frame = page->frame;
+	if (frame != NULL) {
+		frame_unlink (page);
+		page->frame = frame;
+		shared = frame->ref_cnt > 0;
+		if (!shared)
+			frame_table_remove (frame);
+	}
+	if (!shared)
+		lock_release (&frame_lock);
+
+	vm_dealloc_page (page);
+	if (shared)
+		lock_release (&frame_lock);
+	if (frame != NULL) {
+		pml4_clear_page (thread_current ()->pml4, va);
+		if (!shared)
+			vm_free_frame (frame);
+	}
+}
 
-	/* TODO: Insert page table entry to map page's VA to frame's PA. */
+/* Adds a copy of SRC, a page of the parent process, to DST, the
+ * current process's supplemental page table, whose VMAs must
+ * already be copied.
+ *
+ * If SRC is in memory, the copy shares its frame, read-only in
+ * both processes, until one of them writes to it.  A swapped-out
+ * anonymous page is read into a frame of the child's own, since
+ * there is no sharing of swap slots.  Anything else is created
+ * again from its VMA when it is touched. */
+static bool
+page_copy (struct supplemental_page_table *dst, struct page *src) {
+	uint64_t *pml4 = thread_current ()->pml4;
+	struct page *page = kmem_cache_alloc (&page_struct_cache);
+	struct frame *frame = NULL;
+	enum vm_type type = VM_TYPE (src->operations->type);
+	bool success = true;
+
+	if (page == NULL)
+		return false;
+	*page = *src;
+	page->owner = thread_current ();
+	page->frame = NULL;
+	page->vma = src->vma != NULL ? spt_find_vma (dst, src->va) : NULL;
+	if (type == VM_UNINIT) {
+		if (page->vma != NULL)
+			page->uninit.aux = page->vma;
+	} else
+		initializer_of (type) (page, type, NULL);
+
+	if (!spt_insert_page (dst, page)) {
+		free (page);
+		return false;
+	}
+	if (page->vma != NULL)
+		list_push_back (&page->vma->pages, &page->vma_elem);
+
+	/* The parent waits for fork() to finish, so none of its pages
+	 * come into memory meanwhile, but they may be evicted. */
+	lock_acquire (&frame_lock);
+	while (src->frame == NULL && type == VM_ANON && frame == NULL) {
+		lock_release (&frame_lock);
+		frame = vm_get_frame ();
+		if (frame == NULL)
+			return false;
+		lock_acquire (&frame_lock);
+	}
+
+	if (src->frame != NULL) {
+		uint64_t *src_pml4 = src->owner->pml4;
+
+		success = pml4_set_page (pml4, page->va, src->frame->kva, false);
+		if (success) {
+			/* A modified file page must still be written back,
+			 * by whichever process keeps it. */
+			if (type == VM_FILE && pml4_is_dirty (src_pml4, src->va))
+				pml4_set_dirty (pml4, page->va, true);
+			pml4_set_writable (src_pml4, src->va, false);
+			frame_link (src->frame, page);
+			shared_cnt++;
+		}
+	} else if (type == VM_ANON) {
+		anon_read_swapped (src, frame->kva);
+		success = pml4_set_page (pml4, page->va, frame->kva, page->writable);
+		if (success) {
+			frame_link (frame, page);
+			frame->pinned = false;
+			frame = NULL;
+		}
+	}
+
+	if (frame != NULL)
+		frame_table_remove (frame);
+	lock_release (&frame_lock);
+	if (frame != NULL)
+		vm_free_frame (frame);
+	return success;
+}
+
+/* Returns the function that turns an uninit page into a page of
+ * TYPE. */
+static page_initializer_func *
+initializer_of (enum vm_type type) {
+	switch (VM_TYPE (type)) {
+		case VM_ANON:
+			return anon_initializer;
+		case VM_FILE:
+			return file_backed_initializer;
+		default:
+			PANIC ("no initializer for page type %d", type);
+	}
+}
 
-	return swap_in (page, frame->kva);
+/* Returns a hash value for page P. */
+static uint64_t
+page_hash (const struct hash_elem *p_, void *aux UNUSED) {
+	const struct page *p = hash_entry (p_, struct page, spt_elem);
+	return hash_bytes (&p->va, sizeof p->va);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+		void *aux UNUSED) {
+	const struct page *a = hash_entry (a_, struct page, spt_elem);
+	const struct page *b = hash_entry (b_, struct page, spt_elem);
+	return a->va < b->va;
+}
+
+/* Returns true if VMA A starts below VMA B. */
+static bool
+vma_less (const struct rb_elem *a_, const struct rb_elem *b_,
+		void *aux UNUSED) {
+	const struct vma *a = rb_entry (a_, struct vma, elem);
+	const struct vma *b = rb_entry (b_, struct vma, elem);
+	return a->start < b->start;
 }
 
 /* Initialize new supplemental page table */
 void
-supplemental_page_table_init (struct supplemental_page_table *spt UNUSED) {
+supplemental_page_table_init (struct supplemental_page_table *spt) {
+	if (!hash_init (&spt->pages, page_hash, page_less, NULL))
+		PANIC ("supplemental_page_table_init: out of memory");
+	rb_init (&spt->vmas, vma_less, NULL);
+	spt->last_vma = NULL;
+	swap_cursor_init (&spt->swap_cursor);
 }
 
-/* Copy supplemental page table from src to dst */
+/* Copy supplemental page table from src to dst
+ *
+ * DST must be the current process's, newly initialized, with its
+ * page table active, and SRC that of its parent, which must not
+ * run until this returns.  Pages are shared copy-on-write, as
+ * page_copy() describes, so that fork() costs little more for a
+ * large process than for a small one. */
 bool
-supplemental_page_table_copy (struct supplemental_page_table *dst UNUSED,
-		struct supplemental_page_table *src UNUSED) {
+supplemental_page_table_copy (struct supplemental_page_table *dst,
+		struct supplemental_page_table *src) {
+	struct hash_iterator i;
+	struct rb_elem *e;
+
+	ASSERT (dst == &thread_current ()->spt);
+
+	for (e = rb_min (&src->vmas); e != NULL; e = rb_next (e)) {
+		struct vma *vma = rb_entry (e, struct vma, elem);
+
+		if (!vm_map_range (vma->start,
+					(uint8_t *) vma->end - (uint8_t *) vma->start, vma->type,
+					vma->writable, vma->file, vma->offset, vma->file_bytes))
+			return false;
+	}
+
+	hash_first (&i, &src->pages);
+	while (hash_next (&i))
+		if (!page_copy (dst, hash_entry (hash_cur (&i), struct page,
+						spt_elem)))
+			return false;
+	return true;
 }
 
-/* Free the resource hold by the supplemental page table */
+/* Hash action that frees the page at E. */
+static void
+page_destructor (struct hash_elem *e, void *aux UNUSED) {
+	spt_destroy_page (hash_entry (e, struct page, spt_elem));
+}
+
+/* Free the resource hold by the supplemental page table.
+ * Modified file-backed pages are written back as they are
+ * destroyed.  SPT must be initialized again before it is used. */
 void
-supplemental_page_table_kill (struct supplemental_page_table *spt UNUSED) {
-	/* TODO: Destroy all the supplemental_page_table hold by thread and
-	 * TODO: writeback all the modified contents to the storage. */
+supplemental_page_table_kill (struct supplemental_page_table *spt) {
+	hash_destroy (&spt->pages, page_destructor);
+
+	while (!rb_empty (&spt->vmas)) {
+		struct vma *vma = rb_entry (rb_min (&spt->vmas), struct vma, elem);
+		rb_remove (&spt->vmas, &vma->elem);
+		file_close (vma->file);
+		free (vma);
+	}
+	spt->last_vma = NULL;
+	swap_cursor_release (&spt->swap_cursor);
 }
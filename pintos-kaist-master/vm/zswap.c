@@ -0,0 +1,172 @@
+/* zswap.c: Compressed page pool in front of the swap disk. */
+
+#include "vm/zswap.h"
+#include <debug.h>
+#include <lz.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* An anonymous page that is swapped out first tries to go into
+ * this pool, compressed, so that swapping it in costs a
+ * decompression instead of a disk read.  Zeroed buffers and
+ * sparse arrays, which many anonymous pages are, compress many
+ * times over.
+ *
+ * Compressed pages are kept in blobs from a kmem_cache per size
+ * class.  Each class is the largest size of which a slab holds
+ * some whole number of blobs, so that slabs are packed with
+ * little waste past the rounding up of each blob to its class.
+ * A page that does not fit the largest class, which holds two
+ * to a slab, does not compress even 2:1 and goes to disk, as
+ * do pages that come while the pool is full. */
+
+/* Most memory that blobs may take, in pages. */
+#define POOL_MAX_PAGES 512
+
+/* A compressed page. */
+struct blob {
+	uint16_t size;              /* Bytes in `data'. */
+	uint8_t class;              /* Index in `classes'. */
+	uint8_t data[];             /* Compressed page. */
+};
+
+/* Size classes, smallest first. */
+static const size_t class_sizes[] = {
+	56, 80, 120, 160, 200, 248, 336, 400, 504, 672, 808, 1008, 1344, 2024,
+};
+#define CLASS_CNT (sizeof class_sizes / sizeof *class_sizes)
+#define MAX_BLOB 2024
+static struct kmem_cache classes[CLASS_CNT];
+static char class_names[CLASS_CNT][16];
+
+/* Most bytes of compressed data that a blob holds. */
+#define MAX_DATA (MAX_BLOB - sizeof (struct blob))
+
+/* ZSWAP_LOCK protects the compressor's scratch space and
+ * everything below it. */
+static struct lock zswap_lock;
+static uint8_t work[LZ_WORK_SIZE];
+static uint8_t scratch[MAX_DATA];
+
+static size_t pool_bytes;           /* Bytes in blobs. */
+
+/* Statistics. */
+static long long store_cnt;         /* Pages stored. */
+static long long store_bytes;       /* Compressed size of those pages. */
+static long long incompressible_cnt; /* Pages that did not compress. */
+static long long full_cnt;          /* Pages turned away, pool full. */
+static long long hit_cnt;           /* Swap-ins served by the pool. */
+static long long miss_cnt;          /* Swap-ins that went to disk. */
+
+/* Initializes the pool. */
+void
+zswap_init (void) {
+	size_t i;
+
+	ASSERT (class_sizes[CLASS_CNT - 1] == MAX_BLOB);
+
+	lock_init (&zswap_lock);
+	for (i = 0; i < CLASS_CNT; i++) {
+		snprintf (class_names[i], sizeof class_names[i], "zswap-%zu",
+				class_sizes[i]);
+		kmem_cache_init (&classes[i], class_names[i], class_sizes[i], 0,
+				NULL);
+	}
+}
+
+/* Prints pool statistics. */
+void
+zswap_print_stats (void) {
+	long long ratio = store_bytes > 0
+		? store_cnt * PGSIZE * 100 / store_bytes : 0;
+	long long swap_in_cnt = hit_cnt + miss_cnt;
+
+	if (store_cnt == 0 && incompressible_cnt == 0 && full_cnt == 0)
+		return;
+
+	printf ("Zswap: %lld pages stored, %lld incompressible, "
+			"%lld with pool full, compression ratio %lld.%02lld\n",
+			store_cnt, incompressible_cnt, full_cnt, ratio / 100, ratio % 100);
+	printf ("Zswap: %lld of %lld swap-ins from pool (%lld%%)\n",
+			hit_cnt, swap_in_cnt,
+			swap_in_cnt > 0 ? hit_cnt * 100 / swap_in_cnt : 0);
+}
+
+/* Compresses the page at KVA into the pool and returns a handle
+ * for it, or returns a null pointer if the page does not compress
+ * well enough or the pool is full. */
+void *
+zswap_store (const void *kva) {
+	struct blob *blob = NULL;
+	size_t size;
+	size_t class;
+
+	lock_acquire (&zswap_lock);
+	size = lz_compress (kva, PGSIZE, scratch, MAX_DATA, work);
+	if (size == 0) {
+		incompressible_cnt++;
+		goto done;
+	}
+
+	for (class = 0; class_sizes[class] < sizeof *blob + size; class++)
+		continue;
+	if (pool_bytes + classes[class].obj_size > POOL_MAX_PAGES * PGSIZE
+			|| (blob = kmem_cache_alloc (&classes[class])) == NULL) {
+		full_cnt++;
+		goto done;
+	}
+	blob->size = size;
+	blob->class = class;
+	memcpy (blob->data, scratch, size);
+
+	pool_bytes += classes[class].obj_size;
+	store_cnt++;
+	store_bytes += size;
+
+done:
+	lock_release (&zswap_lock);
+	return blob;
+}
+
+/* Decompresses the page that HANDLE, as returned by zswap_store(),
+ * refers to into the page at KVA, and returns true.  HANDLE may be
+ * a null pointer, for a page that went to disk instead, in which
+ * case this only counts the miss and returns false. */
+bool
+zswap_load (const void *handle, void *kva) {
+	const struct blob *blob = handle;
+
+	lock_acquire (&zswap_lock);
+	if (blob != NULL)
+		hit_cnt++;
+	else
+		miss_cnt++;
+	lock_release (&zswap_lock);
+
+	if (blob == NULL)
+		return false;
+	if (lz_decompress (blob->data, blob->size, kva, PGSIZE) != PGSIZE)
+		PANIC ("zswap: compressed page at %p is corrupt", blob);
+	return true;
+}
+
+/* Frees the compressed page that HANDLE refers to.  Does nothing
+ * if HANDLE is a null pointer. */
+void
+zswap_free (void *handle) {
+	struct blob *blob = handle;
+	struct kmem_cache *cache;
+
+	if (blob == NULL)
+		return;
+
+	cache = &classes[blob->class];
+	lock_acquire (&zswap_lock);
+	pool_bytes -= cache->obj_size;
+	lock_release (&zswap_lock);
+	kmem_cache_free (cache, blob);
+}